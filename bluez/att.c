@@ -718,6 +718,115 @@ ssize_t dec_read_resp(const uint8_t *pdu, size_t len, uint8_t *value,
   return len - 1;
 }
 
+ssize_t dec_read_blob_resp(const uint8_t *pdu, size_t len, uint8_t *value,
+                size_t vlen)
+{
+  if (pdu == NULL)
+    return -EINVAL;
+
+  if (len < 1 || pdu[0] != ATT_OP_READ_BLOB_RESP)
+    return -EINVAL;
+
+  if (value == NULL)
+    return len - 1;
+
+  if (vlen < (len - 1))
+    return -ENOBUFS;
+
+  memcpy(value, pdu + 1, len - 1);
+
+  return len - 1;
+}
+
+static uint16_t enc_handles(uint8_t opcode, const uint16_t *handles,
+            uint16_t num, uint8_t *pdu, size_t len)
+{
+  uint16_t i;
+
+  if (pdu == NULL || handles == NULL)
+    return 0;
+
+  /* At least two handles, as many as fit in the PDU */
+  if (num < 2 || len < 5)
+    return 0;
+
+  if (num > (len - 1) / 2)
+    num = (len - 1) / 2;
+
+  pdu[0] = opcode;
+  for (i = 0; i < num; i++)
+    att_put_u16(handles[i], &pdu[1 + 2 * i]);
+
+  return 1 + 2 * num;
+}
+
+/* The number of handles sent is (returned length - 1) / 2. */
+uint16_t enc_read_multi_req(const uint16_t *handles, uint16_t num,
+                uint8_t *pdu, size_t len)
+{
+  return enc_handles(ATT_OP_READ_MULTI_REQ, handles, num, pdu, len);
+}
+
+/* The values are concatenated, their lengths have to be known. */
+ssize_t dec_read_multi_resp(const uint8_t *pdu, size_t len, uint8_t *value,
+                size_t vlen)
+{
+  if (pdu == NULL)
+    return -EINVAL;
+
+  if (len < 1 || pdu[0] != ATT_OP_READ_MULTI_RESP)
+    return -EINVAL;
+
+  if (value == NULL)
+    return len - 1;
+
+  if (vlen < (len - 1))
+    return -ENOBUFS;
+
+  memcpy(value, pdu + 1, len - 1);
+
+  return len - 1;
+}
+
+uint16_t enc_read_multi_var_req(const uint16_t *handles, uint16_t num,
+                uint8_t *pdu, size_t len)
+{
+  return enc_handles(ATT_OP_READ_MULTI_VAR_REQ, handles, num, pdu, len);
+}
+
+/* Split the length value tuples of the response, at most num of them. The
+ * values point into pdu. The response is cut at the MTU: a tuple cut short
+ * is left out, unless it is the first one, then given with the octets
+ * received as a Read Response would be. Returns the number of values. */
+int dec_read_multi_var_resp(const uint8_t *pdu, size_t len,
+                const uint8_t **values, uint16_t *vlens, int num)
+{
+  size_t offset = 1;
+  int n = 0;
+
+  if (pdu == NULL || values == NULL || vlens == NULL)
+    return -EINVAL;
+
+  if (len < 1 || pdu[0] != ATT_OP_READ_MULTI_VAR_RESP)
+    return -EINVAL;
+
+  while (n < num && offset + 2 <= len) {
+    uint16_t vlen = att_get_u16(&pdu[offset]);
+
+    offset += 2;
+    if (offset + vlen > len) {
+      if (n > 0)
+        break;
+      vlen = len - offset;
+    }
+    values[n] = &pdu[offset];
+    vlens[n++] = vlen;
+    offset += vlen;
+  }
+
+  return n;
+}
+
 uint16_t enc_error_resp(uint8_t opcode, uint16_t handle, uint8_t status,
             uint8_t *pdu, size_t len)
 {
@@ -152,6 +152,8 @@ static inline bt_uuid_t att_get_uuid128(const void *ptr)
 #define ATT_OP_EXEC_WRITE_RESP              0x19
 #define ATT_OP_HANDLE_CNF                   0x1E
 #define ATT_OP_SIGNED_WRITE_CMD             0xD2
+#define ATT_OP_READ_MULTI_VAR_REQ           0x20
+#define ATT_OP_READ_MULTI_VAR_RESP          0x21
 
 /* Error codes for Error response PDU */
 #define ATT_ECODE_INVALID_HANDLE            0x01
@@ -250,6 +252,16 @@ uint16_t enc_read_blob_resp(uint8_t *value, size_t vlen, uint16_t offset,
             uint8_t *pdu, size_t len);
 ssize_t dec_read_resp(const uint8_t *pdu, size_t len, uint8_t *value,
                 size_t vlen);
+ssize_t dec_read_blob_resp(const uint8_t *pdu, size_t len, uint8_t *value,
+                size_t vlen);
+uint16_t enc_read_multi_req(const uint16_t *handles, uint16_t num,
+                uint8_t *pdu, size_t len);
+ssize_t dec_read_multi_resp(const uint8_t *pdu, size_t len, uint8_t *value,
+                size_t vlen);
+uint16_t enc_read_multi_var_req(const uint16_t *handles, uint16_t num,
+                uint8_t *pdu, size_t len);
+int dec_read_multi_var_resp(const uint8_t *pdu, size_t len,
+                const uint8_t **values, uint16_t *vlens, int num);
 uint16_t enc_error_resp(uint8_t opcode, uint16_t handle, uint8_t status,
             uint8_t *pdu, size_t len);
 uint16_t enc_find_info_req(uint16_t start, uint16_t end, uint8_t *pdu,
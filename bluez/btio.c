@@ -79,6 +79,7 @@ struct set_opts {
   int flushable;
   uint32_t priority;
   uint16_t voice;
+  GMainContext *context;
 };
 
 struct connect {
@@ -287,18 +288,23 @@ static void server_add(GIOChannel *io, BtIOConnect connect,
 }
 
 static void connect_add(GIOChannel *io, BtIOConnect connect,
-        gpointer user_data, GDestroyNotify destroy)
+        gpointer user_data, GDestroyNotify destroy,
+        GMainContext *context)
 {
   struct connect *conn;
   GIOCondition cond;
+  GSource *source;
 
   conn = g_new0(struct connect, 1);
   conn->connect = connect;
   conn->user_data = user_data;
   conn->destroy = destroy;
   cond = G_IO_OUT | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
-  g_io_add_watch_full(io, G_PRIORITY_DEFAULT, cond, connect_cb, conn,
+  source = g_io_create_watch(io, cond);
+  g_source_set_callback(source, (GSourceFunc) connect_cb, conn,
           (GDestroyNotify) connect_remove);
+  g_source_attach(source, context);
+  g_source_unref(source);
 }
 
 static void accept_add(GIOChannel *io, BtIOConnect connect, gpointer user_data,
@@ -838,6 +844,9 @@ static gboolean parse_set_opts(struct set_opts *opts, GError **err,
     case BT_IO_OPT_VOICE:
       opts->voice = va_arg(args, int);
       break;
+    case BT_IO_OPT_CONTEXT:
+      opts->context = va_arg(args, GMainContext *);
+      break;
     default:
       g_set_error(err, BT_IO_ERROR, EINVAL,
           "Unknown option %d", opt);
@@ -1451,7 +1460,7 @@ GIOChannel *bt_io_connect(BtIOConnect connect, gpointer user_data,
     return NULL;
   }
 
-  connect_add(io, connect, user_data, destroy);
+  connect_add(io, connect, user_data, destroy, opts.context);
 
   return io;
 }
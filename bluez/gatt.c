@@ -569,9 +569,12 @@ guint gatt_read_char_by_uuid(GAttrib *attrib, uint16_t start, uint16_t end,
 struct read_long_data {
   GAttrib *attrib;
   GAttribResultFunc func;
+  gatt_chunk_cb_t chunk;
   gpointer user_data;
   guint8 *buffer;
   guint16 size;
+  guint16 alloc;
+  gboolean stopped;
   guint16 handle;
   guint id;
   int ref;
@@ -590,13 +593,62 @@ static void read_long_destroy(gpointer user_data)
   g_free(long_read);
 }
 
+/* Add a response to the value: given to the chunk function if the read is
+ * streamed, else appended to the buffer which grows geometrically. Like
+ * size, the buffer starts with the opcode of the first response. */
+static guint8 read_long_add(struct read_long_data *long_read,
+          const guint8 *rpdu, guint16 rlen)
+{
+  const guint8 *data = long_read->size ? &rpdu[1] : rpdu;
+  guint16 len = long_read->size ? rlen - 1 : rlen;
+  guint32 alloc;
+  guint8 *tmp;
+
+  if ((guint32) long_read->size + len > G_MAXUINT16)
+    return ATT_ECODE_INSUFF_RESOURCES;
+
+  if (long_read->chunk) {
+    if (!long_read->chunk(&rpdu[1], rlen - 1,
+          long_read->size ? long_read->size - 1 : 0,
+          long_read->user_data))
+      long_read->stopped = TRUE;
+    long_read->size += len;
+    return 0;
+  }
+
+  if (long_read->size + len > long_read->alloc) {
+    alloc = MAX((guint32) long_read->alloc * 2,
+          (guint32) long_read->size + len);
+    alloc = MIN(alloc, G_MAXUINT16);
+    tmp = g_try_realloc(long_read->buffer, alloc);
+    if (tmp == NULL)
+      return ATT_ECODE_INSUFF_RESOURCES;
+    long_read->buffer = tmp;
+    long_read->alloc = alloc;
+  }
+
+  memcpy(&long_read->buffer[long_read->size], data, len);
+  long_read->size += len;
+  return 0;
+}
+
+static void read_long_done(struct read_long_data *long_read, guint8 status)
+{
+  if (long_read->chunk)
+    long_read->func(status, NULL,
+          long_read->size ? long_read->size - 1 : 0,
+          long_read->user_data);
+  else
+    long_read->func(status, long_read->buffer, long_read->size,
+          long_read->user_data);
+}
+
 static void read_blob_helper(guint8 status, const guint8 *rpdu, guint16 rlen,
               gpointer user_data)
 {
   struct read_long_data *long_read = user_data;
   uint8_t *buf;
   size_t buflen;
-  guint8 *tmp;
   guint16 plen;
   guint id;
 
@@ -605,16 +657,9 @@ static void read_blob_helper(guint8 status, const guint8 *rpdu, guint16 rlen,
     goto done;
   }
 
-  tmp = g_try_realloc(long_read->buffer, long_read->size + rlen - 1);
-
-  if (tmp == NULL) {
-    status = ATT_ECODE_INSUFF_RESOURCES;
+  status = read_long_add(long_read, rpdu, rlen);
+  if (status != 0 || long_read->stopped)
     goto done;
-  }
-
-  memcpy(&tmp[long_read->size], &rpdu[1], rlen - 1);
-  long_read->buffer = tmp;
-  long_read->size += rlen - 1;
 
   buf = g_attrib_get_buffer(long_read->attrib, &buflen);
   if (rlen < buflen)
@@ -633,8 +678,7 @@ static void read_blob_helper(guint8 status, const guint8 *rpdu, guint16 rlen,
   status = ATT_ECODE_IO;
 
 done:
-  long_read->func(status, long_read->buffer, long_read->size,
-              long_read->user_data);
+  read_long_done(long_read, status);
 }
 
 static void read_char_helper(guint8 status, const guint8 *rpdu,
@@ -646,17 +690,16 @@ static void read_char_helper(guint8 status, const guint8 *rpdu,
   guint16 plen;
   guint id;
 
-  if (status != 0 || rlen < buflen)
+  if (status != 0)
     goto done;
 
-  long_read->buffer = g_malloc(rlen);
-  if (long_read->buffer == NULL) {
-    status = ATT_ECODE_INSUFF_RESOURCES;
+  /* A short value is given as it is, unless streamed */
+  if (rlen < buflen && long_read->chunk == NULL)
     goto done;
-  }
 
-  memcpy(long_read->buffer, rpdu, rlen);
-  long_read->size = rlen;
+  status = read_long_add(long_read, rpdu, rlen);
+  if (status != 0 || long_read->stopped || rlen < buflen)
+    goto done;
 
   plen = enc_read_blob_req(long_read->handle, rlen - 1, buf, buflen);
 
@@ -670,11 +713,15 @@ static void read_char_helper(guint8 status, const guint8 *rpdu,
   status = ATT_ECODE_IO;
 
 done:
-  long_read->func(status, rpdu, rlen, long_read->user_data);
+  if (long_read->chunk)
+    read_long_done(long_read, status);
+  else
+    long_read->func(status, rpdu, rlen, long_read->user_data);
 }
 
-guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
-              gpointer user_data)
+static guint read_char(GAttrib *attrib, uint16_t handle, guint16 size_hint,
+          gatt_chunk_cb_t chunk, GAttribResultFunc func,
+          gpointer user_data)
 {
   uint8_t *buf;
   size_t buflen;
@@ -689,16 +736,26 @@ guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
 
   long_read->attrib = attrib;
   long_read->func = func;
+  long_read->chunk = chunk;
   long_read->user_data = user_data;
   long_read->handle = handle;
 
+  /* The opcode is kept in front of the value */
+  if (size_hint != 0 && chunk == NULL) {
+    long_read->alloc = MIN((guint32) size_hint + 1, G_MAXUINT16);
+    long_read->buffer = g_try_malloc(long_read->alloc);
+    if (long_read->buffer == NULL)
+      long_read->alloc = 0;
+  }
+
   buf = g_attrib_get_buffer(attrib, &buflen);
   plen = enc_read_req(handle, buf, buflen);
   id = g_attrib_send(attrib, 0, buf, plen, read_char_helper,
             long_read, read_long_destroy);
-  if (id == 0)
+  if (id == 0) {
+    g_free(long_read->buffer);
     g_free(long_read);
-  else {
+  } else {
     __sync_fetch_and_add(&long_read->ref, 1);
     long_read->id = id;
   }
@@ -706,6 +763,26 @@ guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
   return id;
 }
 
+guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
+              gpointer user_data)
+{
+  return read_char(attrib, handle, 0, NULL, func, user_data);
+}
+
+guint gatt_read_char_sized(GAttrib *attrib, uint16_t handle,
+              guint16 size_hint, GAttribResultFunc func,
+              gpointer user_data)
+{
+  return read_char(attrib, handle, size_hint, NULL, func, user_data);
+}
+
+guint gatt_read_char_stream(GAttrib *attrib, uint16_t handle,
+              gatt_chunk_cb_t chunk, GAttribResultFunc func,
+              gpointer user_data)
+{
+  return read_char(attrib, handle, 0, chunk, func, user_data);
+}
+
 struct write_long_data {
   GAttrib *attrib;
   GAttribResultFunc func;
@@ -55,6 +55,9 @@
 #define GATT_CLIENT_CHARAC_CFG_IND_BIT    0x0002
 
 typedef void (*gatt_cb_t) (GSList *l, guint8 status, gpointer user_data);
+/* Part of a long value read at offset, FALSE stops the read */
+typedef gboolean (*gatt_chunk_cb_t) (const guint8 *value, guint16 vlen,
+          guint16 offset, gpointer user_data);
 
 struct gatt_primary {
   char uuid[MAX_LEN_UUID_STR + 1];
@@ -88,6 +91,17 @@ guint gatt_discover_char(GAttrib *attrib, uint16_t start, uint16_t end,
 guint gatt_read_char(GAttrib *attrib, uint16_t handle, GAttribResultFunc func,
               gpointer user_data);
 
+/* The buffer of a long value starts with size_hint octets */
+guint gatt_read_char_sized(GAttrib *attrib, uint16_t handle,
+              guint16 size_hint, GAttribResultFunc func,
+              gpointer user_data);
+
+/* The value is given to chunk as it arrives, without buffer. func ends the
+ * read with a NULL pdu and the length of the value. */
+guint gatt_read_char_stream(GAttrib *attrib, uint16_t handle,
+              gatt_chunk_cb_t chunk, GAttribResultFunc func,
+              gpointer user_data);
+
 guint gatt_write_char(GAttrib *attrib, uint16_t handle, uint8_t *value,
           size_t vlen, GAttribResultFunc func,
           gpointer user_data);
@@ -53,6 +53,7 @@
 
 struct _GAttrib {
   GIOChannel *io;
+  GMainContext *context;
   int refs;
   uint8_t *buf;
   size_t buflen;
@@ -62,9 +63,14 @@ struct _GAttrib {
   GQueue *requests;
   GQueue *responses;
   GSList *events;
+  GHashTable *events_by_handle; /* First event of each handle */
   guint next_cmd_id;
   GDestroyNotify destroy;
   gpointer destroy_user_data;
+  GAttribRttFunc rtt_func;
+  gpointer rtt_user_data;
+  GAttribNotifyFunc event_func;
+  gpointer event_user_data;
   bool stale;
 };
 
@@ -75,6 +81,7 @@ struct command {
   guint16 len;
   guint8 expected;
   bool sent;
+  gint64 sent_time;
   GAttribResultFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -117,6 +124,9 @@ static guint8 opcode2expected(guint8 opcode)
   case ATT_OP_READ_BY_GROUP_REQ:
     return ATT_OP_READ_BY_GROUP_RESP;
 
+  case ATT_OP_READ_MULTI_VAR_REQ:
+    return ATT_OP_READ_MULTI_VAR_RESP;
+
   case ATT_OP_WRITE_REQ:
     return ATT_OP_WRITE_RESP;
 
@@ -145,6 +155,7 @@ static bool is_response(guint8 opcode)
   case ATT_OP_READ_BLOB_RESP:
   case ATT_OP_READ_MULTI_RESP:
   case ATT_OP_READ_BY_GROUP_RESP:
+  case ATT_OP_READ_MULTI_VAR_RESP:
   case ATT_OP_WRITE_RESP:
   case ATT_OP_PREP_WRITE_RESP:
   case ATT_OP_EXEC_WRITE_RESP:
@@ -170,6 +181,50 @@ GAttrib *g_attrib_ref(GAttrib *attrib)
   return attrib;
 }
 
+/* GLib only wakes up a context owned by another thread. A context polled
+ * from outside of GLib, and owned by nobody meanwhile, must be woken up
+ * too so that the poller sees the new source. */
+static void attrib_context_wakeup(struct _GAttrib *attrib)
+{
+  if (!g_main_context_is_owner(attrib->context))
+    g_main_context_wakeup(attrib->context);
+}
+
+static guint attrib_io_add_watch(struct _GAttrib *attrib, GIOCondition cond,
+          GIOFunc func, GDestroyNotify notify)
+{
+  GSource *source = g_io_create_watch(attrib->io, cond);
+  guint id;
+
+  g_source_set_priority(source, G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, (GSourceFunc) func, attrib, notify);
+  id = g_source_attach(source, attrib->context);
+  g_source_unref(source);
+  attrib_context_wakeup(attrib);
+  return id;
+}
+
+static guint attrib_timeout_add(struct _GAttrib *attrib, guint interval,
+          GSourceFunc func)
+{
+  GSource *source = g_timeout_source_new_seconds(interval);
+  guint id;
+
+  g_source_set_callback(source, func, attrib, NULL);
+  id = g_source_attach(source, attrib->context);
+  g_source_unref(source);
+  attrib_context_wakeup(attrib);
+  return id;
+}
+
+static void attrib_source_remove(struct _GAttrib *attrib, guint id)
+{
+  GSource *source = g_main_context_find_source_by_id(attrib->context, id);
+
+  if (source)
+    g_source_destroy(source);
+}
+
 static void command_destroy(struct command *cmd)
 {
   if (cmd->notify)
@@ -209,19 +264,23 @@ static void attrib_destroy(GAttrib *attrib)
 
   g_slist_free(attrib->events);
   attrib->events = NULL;
+  g_hash_table_destroy(attrib->events_by_handle);
 
   if (attrib->timeout_watch > 0)
-    g_source_remove(attrib->timeout_watch);
+    attrib_source_remove(attrib, attrib->timeout_watch);
 
   if (attrib->write_watch > 0)
-    g_source_remove(attrib->write_watch);
+    attrib_source_remove(attrib, attrib->write_watch);
 
   if (attrib->read_watch > 0)
-    g_source_remove(attrib->read_watch);
+    attrib_source_remove(attrib, attrib->read_watch);
 
   if (attrib->io)
     g_io_channel_unref(attrib->io);
 
+  if (attrib->context)
+    g_main_context_unref(attrib->context);
+
   g_free(attrib->buf);
 
   if (attrib->destroy)
@@ -267,6 +326,30 @@ gboolean g_attrib_set_destroy_function(GAttrib *attrib,
   return TRUE;
 }
 
+gboolean g_attrib_set_rtt_function(GAttrib *attrib, GAttribRttFunc func,
+    gpointer user_data)
+{
+  if (attrib == NULL)
+    return FALSE;
+
+  attrib->rtt_func = func;
+  attrib->rtt_user_data = user_data;
+
+  return TRUE;
+}
+
+gboolean g_attrib_set_event_function(GAttrib *attrib, GAttribNotifyFunc func,
+    gpointer user_data)
+{
+  if (attrib == NULL)
+    return FALSE;
+
+  attrib->event_func = func;
+  attrib->event_user_data = user_data;
+
+  return TRUE;
+}
+
 static gboolean disconnect_timeout(gpointer data)
 {
   struct _GAttrib *attrib = data;
@@ -348,10 +431,11 @@ static gboolean can_write_data(GIOChannel *io, GIOCondition cond,
   }
 
   cmd->sent = true;
+  cmd->sent_time = g_get_monotonic_time();
 
   if (attrib->timeout_watch == 0)
-    attrib->timeout_watch = g_timeout_add_seconds(GATT_TIMEOUT,
-            disconnect_timeout, attrib);
+    attrib->timeout_watch = attrib_timeout_add(attrib, GATT_TIMEOUT,
+            disconnect_timeout);
 
   return FALSE;
 }
@@ -370,9 +454,8 @@ static void wake_up_sender(struct _GAttrib *attrib)
     return;
 
   attrib = g_attrib_ref(attrib);
-  attrib->write_watch = g_io_add_watch_full(attrib->io,
-        G_PRIORITY_DEFAULT, G_IO_OUT,
-        can_write_data, attrib, destroy_sender);
+  attrib->write_watch = attrib_io_add_watch(attrib, G_IO_OUT,
+        can_write_data, destroy_sender);
 }
 
 static bool match_event(struct event *evt, const uint8_t *pdu, gsize len)
@@ -425,6 +508,10 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
     goto done;
   }
 
+  if (attrib->event_func && (buf[0] == ATT_OP_HANDLE_NOTIFY ||
+        buf[0] == ATT_OP_HANDLE_IND))
+    attrib->event_func(buf, len, attrib->event_user_data);
+
   for (l = attrib->events; l; l = l->next) {
     struct event *evt = l->data;
 
@@ -436,7 +523,7 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
     return TRUE;
 
   if (attrib->timeout_watch > 0) {
-    g_source_remove(attrib->timeout_watch);
+    attrib_source_remove(attrib, attrib->timeout_watch);
     attrib->timeout_watch = 0;
   }
 
@@ -446,6 +533,10 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
     return attrib->events != NULL;
   }
 
+  if (cmd->sent && attrib->rtt_func)
+    attrib->rtt_func(g_get_monotonic_time() - cmd->sent_time,
+        attrib->rtt_user_data);
+
   if (buf[0] == ATT_OP_ERROR) {
     status = buf[4];
     goto done;
@@ -474,6 +565,11 @@ done:
 }
 
 GAttrib *g_attrib_new(GIOChannel *io)
+{
+  return g_attrib_new_full(io, NULL);
+}
+
+GAttrib *g_attrib_new_full(GIOChannel *io, GMainContext *context)
 {
   struct _GAttrib *attrib;
   uint16_t imtu;
@@ -502,12 +598,15 @@ GAttrib *g_attrib_new(GIOChannel *io)
   attrib->buflen = att_mtu;
 
   attrib->io = g_io_channel_ref(io);
+  if (context)
+    attrib->context = g_main_context_ref(context);
   attrib->requests = g_queue_new();
   attrib->responses = g_queue_new();
+  attrib->events_by_handle = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-  attrib->read_watch = g_io_add_watch(attrib->io,
+  attrib->read_watch = attrib_io_add_watch(attrib,
       G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-      received_data, attrib);
+      received_data, NULL);
 
   return g_attrib_ref(attrib);
 }
@@ -574,6 +673,22 @@ static int command_cmp_by_id(gconstpointer a, gconstpointer b)
   return cmd->id - id;
 }
 
+/* Rebuilt after each change of the events, which are rare compared to the
+ * lookups by handle. */
+static void index_events(GAttrib *attrib)
+{
+  GSList *l;
+
+  g_hash_table_remove_all(attrib->events_by_handle);
+  for (l = attrib->events; l; l = l->next) {
+    struct event *evt = l->data;
+    gpointer key = GUINT_TO_POINTER(evt->handle);
+
+    if (!g_hash_table_lookup(attrib->events_by_handle, key))
+      g_hash_table_insert(attrib->events_by_handle, key, evt);
+  }
+}
+
 static int event_cmp_by_handle(gconstpointer a, gconstpointer b)
 {
   const struct event    *evt    =  a;
@@ -713,6 +828,7 @@ guint g_attrib_register(GAttrib *attrib, guint8 opcode, char *uuid_str,
   event->id = ++next_evt_id;
 
   attrib->events = g_slist_append(attrib->events, event);
+  index_events(attrib);
 
   return event->id;
 }
@@ -747,6 +863,7 @@ gboolean g_attrib_unregister(GAttrib *attrib, char *uuid_str)
   evt = l->data;
 
   attrib->events = g_slist_remove(attrib->events, evt);
+  index_events(attrib);
 
   if (evt->notify)
     evt->notify(evt->user_data);
@@ -774,10 +891,36 @@ gboolean g_attrib_unregister_all(GAttrib *attrib)
 
   g_slist_free(attrib->events);
   attrib->events = NULL;
+  index_events(attrib);
 
   return TRUE;
 }
 
+void g_attrib_remap_events(GAttrib *attrib, guint16 start, guint16 end,
+    GAttribRemapFunc func, gpointer user_data)
+{
+  GSList *l = attrib->events;
+
+  while (l) {
+    struct event *evt = l->data;
+
+    l = l->next;
+    if ((evt->handle == GATTRIB_ALL_HANDLES) || (evt->handle < start) ||
+        (evt->handle > end))
+      continue;
+
+    evt->handle = func(evt->uuid_str, evt->handle, evt->expected, user_data);
+    if (evt->handle != GATTRIB_ALL_HANDLES)
+      continue;
+
+    attrib->events = g_slist_remove(attrib->events, evt);
+    if (evt->notify)
+      evt->notify(evt->user_data);
+    g_free(evt);
+  }
+  index_events(attrib);
+}
+
 void event_list_print(GAttrib *attrib)
 {
   GSList *l;
@@ -798,13 +941,10 @@ void event_list_print(GAttrib *attrib)
 
 char *event_get_uuid_by_handle(GAttrib *attrib, guint16 handle)
 {
-  GSList *l = g_slist_find_custom(attrib->events, GUINT_TO_POINTER(handle),
-      event_cmp_by_handle);
-  if (l && l->data){
-    struct event *event = l->data;
-    return event->uuid_str;
-  }
-  return NULL;
+  struct event *event = g_hash_table_lookup(attrib->events_by_handle,
+      GUINT_TO_POINTER(handle));
+
+  return event ? event->uuid_str : NULL;
 }
 
 gboolean has_event_by_uuid(GAttrib *attrib, char *uuid_str)
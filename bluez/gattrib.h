@@ -39,10 +39,15 @@ typedef void (*GAttribResultFunc) (guint8 status, const guint8 *pdu,
           guint16 len, gpointer user_data);
 typedef void (*GAttribDisconnectFunc)(gpointer user_data);
 typedef void (*GAttribDebugFunc)(const char *str, gpointer user_data);
+typedef void (*GAttribRttFunc)(gint64 rtt_us, gpointer user_data);
 typedef void (*GAttribNotifyFunc)(const guint8 *pdu, guint16 len,
               gpointer user_data);
+/* Returns the new handle of an event, GATTRIB_ALL_HANDLES to unregister it */
+typedef guint16 (*GAttribRemapFunc)(const char *uuid_str, guint16 handle,
+              guint8 opcode, gpointer user_data);
 
 GAttrib *g_attrib_new(GIOChannel *io);
+GAttrib *g_attrib_new_full(GIOChannel *io, GMainContext *context);
 GAttrib *g_attrib_ref(GAttrib *attrib);
 void g_attrib_unref(GAttrib *attrib);
 
@@ -51,6 +56,14 @@ GIOChannel *g_attrib_get_channel(GAttrib *attrib);
 gboolean g_attrib_set_destroy_function(GAttrib *attrib,
     GDestroyNotify destroy, gpointer user_data);
 
+/* Called with the round trip time of each request answered */
+gboolean g_attrib_set_rtt_function(GAttrib *attrib, GAttribRttFunc func,
+    gpointer user_data);
+
+/* Called with each notification and indication, before the events */
+gboolean g_attrib_set_event_function(GAttrib *attrib, GAttribNotifyFunc func,
+    gpointer user_data);
+
 guint g_attrib_send(GAttrib *attrib, guint id, const guint8 *pdu,
     guint16 len, GAttribResultFunc func, gpointer user_data,
     GDestroyNotify notify);
@@ -73,6 +86,10 @@ guint g_attrib_register(GAttrib *attrib, guint8 opcode, char *uuid_str,
 gboolean g_attrib_unregister(GAttrib *attrib, char *uuid_str);
 gboolean g_attrib_unregister_all(GAttrib *attrib);
 
+/* Change the handle of the events registered between start and end */
+void g_attrib_remap_events(GAttrib *attrib, guint16 start, guint16 end,
+    GAttribRemapFunc func, gpointer user_data);
+
 void event_list_print(GAttrib *attrib);
 
 char *event_get_uuid_by_handle(GAttrib *attrib, guint16 handle);
@@ -0,0 +1,306 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bluelib.h"
+#include <glib.h>
+
+#include "gatt_def.h"
+
+#define DEFAULT_ITERATIONS 100
+
+static void usage(void)
+{
+  printf("Usage: bench <MAC address>[,<MAC address>...] [iterations] "
+      "[reactors] [busy_poll_us]\n");
+  printf("Each device gets its own context, all driven from this process.\n");
+  printf("The connections are spread over the reactor threads.\n");
+  printf("With busy_poll_us, the bench is run again in inline mode.\n");
+  printf("The database of each device is first discovered twice: by a walk\n"
+      "service by service and characteristic by characteristic, then by\n"
+      "bl_get_database.\n");
+}
+
+// Print the round trip statistics of a set of samples in microseconds.
+static void print_stats(const char *name, gint64 *samples, int n)
+{
+  gint64 min = G_MAXINT64, max = 0, sum = 0;
+
+  if (n == 0) {
+    printf("%-20s no sample\n", name);
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    sum += samples[i];
+    if (samples[i] < min)
+      min = samples[i];
+    if (samples[i] > max)
+      max = samples[i];
+  }
+  printf("%-20s n=%d min=%lldus avg=%lldus max=%lldus\n", name, n,
+      (long long) min, (long long) (sum / n), (long long) max);
+}
+
+typedef struct {
+  char                 *mac;
+  int                   iterations;
+  bl_ctx_t             *ctx;
+  gint64                connect_time;
+  bl_connect_timings_t  timings;
+  gint64               *samples;
+  int                   n;
+  gint64                walk_time;
+  int                   walk_lookups;
+  guint64               walk_misses;  // Lookups sent to the device
+  gint64                db_time;
+  int                   db_attrs;
+} device_t;
+
+// Nested walk of get_ble_tree, one lookup per service and per
+// characteristic. Returns the number of lookups.
+static int walk_database(bl_ctx_t *ctx, GError **gerr)
+{
+  GSList *bl_primary_list = bl_ctx_get_all_primary(ctx, NULL, gerr);
+  int     lookups         = 1;
+
+  for (GSList *lp = bl_primary_list; lp && !*gerr; lp = lp->next) {
+    bl_primary_t *bl_primary = lp->data;
+    GSList       *bl_char_list;
+
+    bl_included_list_free(bl_ctx_get_included(ctx, bl_primary, gerr));
+    bl_char_list = bl_ctx_get_all_char_in_primary(ctx, bl_primary, gerr);
+    lookups += 2;
+    for (GSList *lc = bl_char_list; lc && !*gerr; lc = lc->next) {
+      bl_desc_list_free(bl_ctx_get_all_desc_by_char(ctx, lc->data,
+            lc->next ? lc->next->data : NULL, bl_primary, gerr));
+      lookups++;
+    }
+    bl_char_list_free(bl_char_list);
+  }
+  bl_primary_list_free(bl_primary_list);
+  return lookups;
+}
+
+// Discover the whole database from the device with the walk, then with
+// bl_get_database. The cache in memory is cleared before each of them.
+static void bench_discovery(device_t *dev)
+{
+  GError           *gerr = NULL;
+  bl_cache_stats_t  before, after;
+  bl_database_t    *bl_db;
+  gint64            start;
+
+  bl_ctx_clear_cache(dev->ctx);
+  bl_ctx_get_cache_stats(dev->ctx, &before);
+  start = g_get_monotonic_time();
+  dev->walk_lookups = walk_database(dev->ctx, &gerr);
+  dev->walk_time    = g_get_monotonic_time() - start;
+  bl_ctx_get_cache_stats(dev->ctx, &after);
+  dev->walk_misses  = after.misses - before.misses;
+  if (gerr) {
+    printf("%s: Walk error: %s", dev->mac, gerr->message);
+    g_clear_error(&gerr);
+    dev->walk_time = 0;
+  }
+
+  bl_ctx_clear_cache(dev->ctx);
+  start = g_get_monotonic_time();
+  bl_db = bl_ctx_get_database(dev->ctx, &gerr);
+  dev->db_time = g_get_monotonic_time() - start;
+  if (gerr) {
+    printf("%s: Database error: %s", dev->mac, gerr->message);
+    g_clear_error(&gerr);
+    dev->db_time = 0;
+    return;
+  }
+  dev->db_attrs = bl_db->n_attrs;
+  bl_database_free(bl_db);
+}
+
+// Read the device name characteristic: one ATT request per iteration.
+static void bench_read(device_t *dev, bl_char_t *bl_char)
+{
+  GError *gerr = NULL;
+
+  for (int i = 0; i < dev->iterations; i++) {
+    gint64 start = g_get_monotonic_time();
+    bl_value_t *bl_value = bl_ctx_read_char_by_char(dev->ctx, bl_char, &gerr);
+
+    if (gerr) {
+      printf("%s: Read error: %s", dev->mac, gerr->message);
+      g_error_free(gerr);
+      gerr = NULL;
+      continue;
+    }
+    dev->samples[dev->n++] = g_get_monotonic_time() - start;
+    bl_value_free(bl_value);
+  }
+}
+
+// Connect and read one device, each device runs in its own thread.
+static gpointer bench_device(gpointer data)
+{
+  device_t  *dev     = data;
+  GError    *gerr    = NULL;
+  bl_char_t *bl_char = NULL;
+  gint64     start   = g_get_monotonic_time();
+
+  if (bl_ctx_connect(dev->ctx, dev->mac, NULL)) {
+    printf("Unable to connect to %s\n", dev->mac);
+    return NULL;
+  }
+  dev->connect_time = g_get_monotonic_time() - start;
+  bl_ctx_get_connect_timings(dev->ctx, &dev->timings);
+  bench_discovery(dev);
+
+  bl_char = bl_ctx_get_char(dev->ctx, GATT_CHARAC_DEVICE_NAME_STR, NULL,
+      &gerr);
+  if (gerr || !bl_char) {
+    printf("%s: Device name characteristic not found\n", dev->mac);
+    goto disconnect;
+  }
+
+  bench_read(dev, bl_char);
+  bl_char_free(bl_char);
+
+disconnect:
+  if (gerr)
+    g_error_free(gerr);
+  bl_ctx_disconnect(dev->ctx);
+  return NULL;
+}
+
+// Run the bench on all the devices at the same time. With busy_poll_us >= 0
+// the connections are in inline mode, otherwise they are served by the
+// reactors.
+static void run_bench(char **macs, int n_devices, int iterations,
+    int busy_poll_us)
+{
+  device_t  devices[n_devices];
+  GThread  *threads[n_devices];
+  gint64    connect_times[n_devices];
+  gint64    loop_times[n_devices];
+  gint64    socket_times[n_devices];
+  gint64    att_times[n_devices];
+  int       n_connected = 0;
+  gint64    start, total = 0;
+
+  if (busy_poll_us < 0)
+    printf("Threaded mode\n");
+  else
+    printf("Inline mode, busy poll %dus\n", busy_poll_us);
+
+  for (int i = 0; i < n_devices; i++) {
+    devices[i] = (device_t) {
+      .mac        = macs[i],
+      .iterations = iterations,
+      .ctx        = bl_ctx_new(NULL, NULL, NULL, 0, SECURITY_LEVEL_LOW),
+      .samples    = g_new(gint64, iterations),
+    };
+    if (busy_poll_us >= 0)
+      bl_ctx_set_inline(devices[i].ctx, busy_poll_us);
+  }
+
+  start = g_get_monotonic_time();
+  for (int i = 0; i < n_devices; i++)
+    threads[i] = g_thread_new(macs[i], bench_device, &devices[i]);
+  for (int i = 0; i < n_devices; i++)
+    g_thread_join(threads[i]);
+  start = g_get_monotonic_time() - start;
+
+  for (int i = 0; i < n_devices; i++) {
+    device_t *dev = &devices[i];
+
+    if (dev->walk_time)
+      printf("%-20s walk: %lldus, %d lookups, %llu sent to the device\n",
+          dev->mac, (long long) dev->walk_time, dev->walk_lookups,
+          (unsigned long long) dev->walk_misses);
+    if (dev->db_time)
+      printf("%-20s bl_get_database: %lldus, %d attributes\n", dev->mac,
+          (long long) dev->db_time, dev->db_attrs);
+  }
+
+  for (int i = 0; i < n_devices; i++) {
+    print_stats(devices[i].mac, devices[i].samples, devices[i].n);
+    if (devices[i].connect_time) {
+      loop_times[n_connected]      = devices[i].timings.loop_ready_us;
+      socket_times[n_connected]    = devices[i].timings.socket_connect_us;
+      att_times[n_connected]       = devices[i].timings.att_ready_us;
+      connect_times[n_connected++] = devices[i].connect_time;
+    }
+    total += devices[i].n;
+    g_free(devices[i].samples);
+    bl_ctx_free(devices[i].ctx);
+  }
+  print_stats("connect", connect_times, n_connected);
+  print_stats(" loop ready", loop_times, n_connected);
+  print_stats(" socket connect", socket_times, n_connected);
+  print_stats(" ATT ready", att_times, n_connected);
+  if (start > 0)
+    printf("%d devices, %lld reads in %lldms: %lld reads/s\n", n_devices,
+        (long long) total, (long long) (start / 1000),
+        (long long) (total * G_TIME_SPAN_SECOND / start));
+  if (busy_poll_us >= 0)
+    return;
+
+  for (int i = 0; i < bl_get_reactors(); i++) {
+    bl_reactor_stats_t stats;
+
+    if (bl_get_reactor_stats(i, &stats) || (stats.uptime_us == 0))
+      continue;
+    printf("reactor %-12d wakeups=%llu busy=%lldus (%lld%%)\n", i,
+        (unsigned long long) stats.wakeups, (long long) stats.busy_us,
+        (long long) (stats.busy_us * 100 / stats.uptime_us));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  char   **macs;
+  int      iterations = DEFAULT_ITERATIONS;
+  int      n_devices;
+
+  if ((argc < 2) || (argc > 5)) {
+    usage();
+    return 0;
+  }
+  if (argc >= 3)
+    iterations = atoi(argv[2]);
+  if (iterations <= 0)
+    iterations = DEFAULT_ITERATIONS;
+  if ((argc >= 4) && bl_set_reactors(atoi(argv[3]))) {
+    printf("Invalid number of reactors, maximum is %d\n", BL_MAX_REACTORS);
+    return 1;
+  }
+
+  macs      = g_strsplit(argv[1], ",", 0);
+  n_devices = g_strv_length(macs);
+
+  run_bench(macs, n_devices, iterations, -1);
+  if (argc == 5)
+    run_bench(macs, n_devices, iterations, MAX(atoi(argv[4]), 0));
+
+  g_strfreev(macs);
+  return 0;
+}
@@ -148,7 +148,7 @@ int main(int argc, char **argv)
   GSList  *bl_primary_list  = NULL;
   GSList  *bl_included_list = NULL;
   GSList  *bl_char_list     = NULL;
-  GSList  *bl_desc_list     = NULL;
+  GSList  *bl_desc_lists    = NULL;
   bl_value_t  *bl_value     = NULL;
 
   FILE  *file = fopen(file_path, "w");
@@ -210,28 +210,28 @@ int main(int argc, char **argv)
         bl_char_list = bl_get_all_char_in_primary(bl_primary, &gerr);
       } while (check_gerrors(gerr));
       if (bl_char_list) {
+        // Get all descriptors of the characteristics at once
+        do {
+          bl_desc_lists = bl_get_all_desc_in_primary(bl_primary,
+              bl_char_list, &gerr);
+        } while (check_gerrors(gerr));
+
+        GSList *ld = bl_desc_lists;
         for (GSList *lc = bl_char_list; lc; lc = lc->next) {
           putchar('.');
           bl_char_t *bl_char = lc->data;
 
           bl_char_fprint(file, bl_char);
 
-          // Get all descriptors of the characteristic
-          {
-            bl_char_t *next_bl_char = NULL;
-            if (lc->next)
-              next_bl_char = lc->next->data;
-            do {
-              bl_desc_list = bl_get_all_desc_by_char(bl_char,
-                  next_bl_char, bl_primary, &gerr);
-            } while (check_gerrors(gerr));
+          if (ld) {
+            if (ld->data)
+              bl_desc_list_fprint(file, ld->data);
+            ld = ld->next;
           }
-          if (bl_desc_list)
-            bl_desc_list_fprint(file, bl_desc_list);
-            bl_desc_list_free(bl_desc_list);
           if (lc->next)
             fprintf(file, "       | |\n");
         }
+        bl_desc_lists_free(bl_desc_lists);
         bl_char_list_free(bl_char_list);
       }
       if (lp->next)
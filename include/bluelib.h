@@ -60,6 +60,7 @@ GQuark bl_error_domain(void);
 #define BL_PROTOCOL_ERROR             -17
 #define BL_NOT_NOTIFIABLE_ERROR       -18
 #define BL_NOT_INDICABLE_ERROR        -19
+#define BL_CANCELLED_ERROR            -20
 
 #define INVALID_HANDLE             0x0000
 
@@ -92,18 +93,56 @@ GQuark bl_error_domain(void);
 //   All of them has handle in it and every function that use them can
 //   work only if we are asssured that the handles mapping haven't changed.
 //
-// - In order to know when the handle mapping has changed. I recommend you
-//   to subsribe to the notification "service changed" (correspondant UUID
-//   defined in gatt_def.h).
+// - BlueLib follows the changes of the handle mapping itself: on connection
+//   it enables the indications of the "service changed" characteristic
+//   (UUID defined in gatt_def.h) in the background, without delaying
+//   bl_connect, and confirms them unless you subscribe to them too.
 //
-// - Also notifications are based on handles and may need to be reassigned in
-//   case the service changed.
+// - When the service changed, bluelib discovers again the range indicated.
+//   The notifications registered there follow their characteristic (by UUID)
+//   and are enabled again, the bl_*_t structures held by the user are not.
 
 /********************** Initialisation of the context **********************/
+// A context is one connection to a device, see bluelib_ctx.h to use several
+// of them. bl_init creates the context used by all the functions below.
+typedef struct bl_ctx bl_ctx_t;
+
 // NOTE: Set the arguments to (NULL, NULL, NULL, 0, 0) for default values.
 int bl_init(const char *src, const char *dst, const char *dst_type, int psm,
     const int sec_level);
 
+// Context created by bl_init, NULL before.
+bl_ctx_t *bl_get_default_ctx(void);
+
+// Drive the connection from a main context of the application instead of a
+// reactor thread (NULL to go back to the reactors), before connecting.
+// The sockets are watched from this context and the asynchronous callbacks
+// are called while it is dispatched. The application must keep running it.
+// A synchronous call made from the thread owning it iterates it until its
+// answer: do not call synchronous functions from a callback of the
+// same connection then.
+int bl_set_main_context(GMainContext *context);
+
+// For event loops not based on GLib (epoll, io_uring...): returns a fd that
+// becomes readable when bl_dispatch has work to do, completions or
+// notifications, -1 on error. It is an epoll fd, it must not be read.
+// The connection is then driven by a main context owned by BlueLib (or the
+// one given to bl_set_main_context) and no thread is used. Call it before
+// connecting, the callbacks are only called from bl_dispatch and the
+// synchronous calls.
+int bl_get_fd(GError **gerr);
+
+// Call the callbacks ready without blocking, in the modes above.
+int bl_dispatch(void);
+
+// Inline mode: no thread at all, the I/O of the connection is done by the
+// thread making a synchronous call, until its answer is received. It spins
+// on the socket up to busy_poll_us before sleeping in poll. The callbacks
+// of the notifications received meanwhile are called by this thread, and
+// by bl_dispatch between the calls. A negative busy_poll_us goes back to the
+// reactors. To be called before connecting.
+int bl_set_inline(int busy_poll_us);
+
 
 /******************** Connect/Disconnect from a device *********************/
 // Connect to a device.
@@ -112,6 +151,17 @@ int bl_connect(char *mac_dst, char *dst_type);
 // Disconnect from the device, delete the nofication list.
 int bl_disconnect(void);
 
+// Duration of the phases of the last connection, 0 for the phases not
+// reached.
+typedef struct {
+  gint64 loop_ready_us;     // Event loop ready to watch the socket
+  gint64 socket_connect_us; // L2CAP socket connected
+  gint64 att_ready_us;      // ATT channel set up, bl_connect woken up
+  gint64 total_us;          // Whole bl_connect
+} bl_connect_timings_t;
+
+int bl_get_connect_timings(bl_connect_timings_t *timings);
+
 typedef int (user_cb_fct_t)(void);
 // Set a function to call each time you succeed to connect.
 // If the connection go well, the return value of bl_connect will be the one
@@ -129,6 +179,110 @@ typedef enum state {
 conn_state_t get_conn_state(void);
 
 
+/******************************** Timeouts *********************************/
+// A request fails with BL_NO_CALLBACK_ERROR when the connection stays
+// silent for the timeout, it is then cancelled and the connection kept.
+// The timeout follows the round trip time measured on the connection
+// (SRTT + 4 * RTTVAR, between 1 and 30 seconds, 30 seconds before the
+// first answer).
+
+// Fixed timeout for the following calls, 0 to go back to the adaptive one.
+int bl_set_timeout(int timeout_ms);
+
+// Timeout currently applied, in ms.
+int bl_get_timeout(void);
+
+
+/******************************** Reactors *********************************/
+// The connections are served by a fixed pool of reactor threads, each one
+// running its own event loop. A new connection is given to the reactor with
+// the fewest connections. A reactor thread is started by its first
+// connection and kept alive for the following ones.
+#define BL_MAX_REACTORS 16
+
+typedef struct {
+  int     connections; // Connections currently served
+  guint64 wakeups;     // Returns from poll since the thread started
+  gint64  busy_us;     // Time spent outside of poll
+  gint64  uptime_us;   // Lifetime of the thread, 0 if not started
+} bl_reactor_stats_t;
+
+// Set the number of reactors (1 by default), between 1 and BL_MAX_REACTORS.
+// Must be called while no context is connected.
+int bl_set_reactors(int n);
+
+int bl_get_reactors(void);
+
+// Load of the reactor index, from 0 to bl_get_reactors() - 1.
+int bl_get_reactor_stats(int index, bl_reactor_stats_t *stats);
+
+
+/*************************** GATT database cache ***************************/
+// The database of each device (services, characteristics and descriptors)
+// can be kept on disk, in one file per device named after its address. It
+// is loaded by bl_connect and the lookups below (bl_get_primary,
+// bl_get_char, bl_get_desc...) are then answered without request.
+// If the device has the Database Hash characteristic (0x2B2A), it is read by
+// bl_connect and the cache is dropped when it changed. The cache of a device
+// without it is trusted until bl_clear_cache.
+// Without cache, the first lookup after the connection discovers the whole
+// database and saves it. The asynchronous lookups always use the device.
+
+// Directory of the caches, NULL (default) to disable them.
+int bl_set_cache_dir(const char *dir);
+
+// Forget the database of the connected device, in memory and on disk.
+int bl_clear_cache(void);
+
+// Besides, the attributes discovered on a connection are kept in memory
+// until the disconnection. When the device indicates a Service Changed, only
+// the range indicated is discovered again.
+// The lookups covered by the previous discoveries are answered from there.
+typedef struct {
+  guint64 hits;   // Lookups answered from memory
+  guint64 misses; // Lookups which made a discovery
+} bl_cache_stats_t;
+
+int bl_get_cache_stats(bl_cache_stats_t *stats);
+
+// Share the database discovered on a device with the devices of the same
+// layout, e.g. a fleet of identical products: in this process, and in the
+// cache directory if there is one. A layout is identified by the Database
+// Hash, or for the devices without it by the values of the characteristics
+// in key_uuids (comma separated, e.g. "2a24,2a26" for the Model Number and
+// the Firmware Revision). bl_connect reads the identifier of a device
+// without cache, and takes the database of its layout if the handles of
+// the characteristics read match. bl_clear_cache forgets the layout too.
+int bl_set_layout_sharing(gboolean enable, const char *key_uuids);
+
+
+/***************************** Whole database ******************************/
+// Discover all the services, included services, characteristics and
+// descriptors of the device at once. The whole discovery is run by the
+// event loop with as few requests as possible, the caller waits only once.
+// Unlike bl_get_all_desc_by_char, the characteristic values are not listed
+// among the descriptors.
+// The result replaces the cache of the device (see bl_set_cache_dir), and
+// comes from it without request when it is already complete.
+// Returns the database, to free with bl_database_free.
+bl_database_t *bl_get_database(GError **gerr);
+
+// Service and characteristic owning a handle: the declaration, the value or
+// a descriptor of the characteristic, or an attribute of the service before
+// its first characteristic. Answered from the attributes known for the
+// connection without going through them, the whole database is discovered
+// first if needed.
+// bl_primary and bl_char (both optional) are set to copies, NULL if the
+// handle has no owner.
+int bl_lookup_handle(uint16_t handle, bl_primary_t **bl_primary,
+    bl_char_t **bl_char);
+
+// Characteristics owning a handle between start and end, e.g. the ones
+// affected by a Service Changed.
+// Return a list of characteristics (bl_char_t *).
+GSList *bl_lookup_range(uint16_t start, uint16_t end, GError **gerr);
+
+
 /*************************** Get Primary Service ***************************/
 // Get a specific primary service.
 // Return the primary service associated to this UUID, if unique.
@@ -194,6 +348,42 @@ bl_desc_t *bl_get_desc_by_char(bl_char_t *start_bl_char,
 GSList *bl_get_all_desc_by_char(bl_char_t *start_bl_char,
     bl_char_t *end_bl_char, bl_primary_t *bl_primary, GError **gerr);
 
+// Get all the descriptors of all the characteristics of a primary service.
+// bl_char_list is the list of the characteristics of the service, as given
+// by bl_get_all_char_in_primary. Instead of one discovery per
+// characteristic, the whole service is read by one Find Information sweep:
+// it takes as many requests as pages of attributes, whatever the number of
+// characteristics.
+// Returns a list with, in the order of bl_char_list, the list of the
+// descriptors of each characteristic (GSList of bl_desc_t *), the same as
+// bl_get_all_desc_by_char. To free with bl_desc_lists_free.
+GSList *bl_get_all_desc_in_primary(bl_primary_t *bl_primary,
+    GSList *bl_char_list, GError **gerr);
+
+
+/*************************** First match lookups ***************************/
+// Single attribute searches: the discovery stops at the first attribute with
+// the UUID instead of going through the whole range. Nothing is added to the
+// cache, but an answer already in the cache is used.
+// Return the attribute, or NULL without error if there is none.
+
+// Search the first primary service of the UUID by Find By Type Value.
+bl_primary_t *bl_find_primary(char *uuid_str, GError **gerr);
+
+// Search the first characteristic of the UUID on a primary service, or on the
+// whole device if bl_primary is NULL.
+bl_char_t *bl_find_char(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr);
+
+// Search the first descriptor of the UUID of the specified characteristic.
+bl_desc_t *bl_find_desc_by_char(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr);
+
+// Search the Client Characteristic Configuration descriptor of bl_char,
+// from its value up to the next declaration at most.
+bl_desc_t *bl_get_cccd(bl_char_t *bl_char, GError **gerr);
+
 
 /************************** Read characteristic value **********************/
 // NOTE: Read functions by UUID doesn't supply the blob readings. Use the
@@ -203,6 +393,8 @@ bl_value_t *bl_read_char(char *uuid_str, bl_primary_t *bl_primary,
     GError **gerr);
 
 // Read all the characteristics value associated to this UUID.
+// The Read By Type requests go on from the last handle of each response
+// until the end of the range, the size of a response is limited by the MTU.
 // Return a list of values (bl_value_t *).
 GSList *bl_read_char_all(char *uuid_str, bl_primary_t *bl_primary,
     GError **gerr);
@@ -219,6 +411,52 @@ GSList *bl_read_char_all_blob(char *uuid_str, bl_primary_t *bl_primary,
 // Read a characteristic value of a characteristic.
 bl_value_t *bl_read_char_by_char(bl_char_t *bl_char, GError **gerr);
 
+// Read a long value of a handle, with Read Blob requests after the first
+// read. The buffer is allocated for expected_size bytes at once, then
+// doubled if the value is larger. 0 if the size isn't known.
+bl_value_t *bl_read_long(uint16_t handle, size_t expected_size,
+    GError **gerr);
+
+// Read a long value of a handle without buffering it: each part is given to
+// chunk_func as it is received.
+//  data, size: Part of the value, only valid during the call.
+//  offset:     Place of the part in the value.
+// Return FALSE to stop the read, the parts left are not requested.
+// chunk_func is called from the event loop thread, it must not call
+// BlueLib.
+typedef gboolean (*bl_chunk_cb_t)(const uint8_t *data, size_t size,
+    size_t offset, void *user_data);
+
+// value_size is set to the size of the value read, up to the stop.
+// Return BL_NO_ERROR, or the error code.
+int bl_read_stream(uint16_t handle, bl_chunk_cb_t chunk_func, void *user_data,
+    size_t *value_size);
+
+// Read the value of a handle, of a characteristic or a descriptor, into buf
+// of size bytes, without any allocation of the value: one Read Request, its
+// response is copied into buf. The allocations left are the ones of any
+// request: its bl_req_t and its node in the pending list, the command queued
+// by GAttrib, its node in the queue and its copy of the request PDU.
+// buf may only be NULL with a size of 0, to get the size of the value.
+// value_size is set to the size of the value received, at most ATT_MTU - 1
+// bytes. A value of ATT_MTU - 1 bytes may be longer: its first part only is
+// read, see bl_read_long or bl_long_read_run for the whole value. If
+// value_size is larger than size, the value has been truncated to the first
+// size bytes.
+// Return BL_NO_ERROR, or the error code.
+int bl_read_into(uint16_t handle, uint8_t *buf, size_t size,
+    size_t *value_size);
+
+// Read the values of n handles, of characteristics or descriptors. Each
+// Read Multiple Variable Length request takes as many handles as the MTU
+// allows, a response cut by the MTU is completed by the next request. If
+// the device doesn't support it, or a request fails with an ATT error, the
+// handles left are read one by one. The whole read fails if one of the
+// handles can't be read on its own.
+// Return a list of values (bl_value_t *) in the order of handles, without
+// UUID.
+GSList *bl_read_multiple(uint16_t *handles, int n, GError **gerr);
+
 
 /******************************* Read descriptor ***************************/
 // Read a descriptor of a characteristic by UUID on a primary service.
@@ -271,6 +509,98 @@ int bl_write_desc_by_char(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
     size_t size);
 
 
+/********************************* Batches *********************************/
+// A batch sends several reads and writes back to back and waits once for
+// all of their answers.
+typedef struct bl_batch bl_batch_t;
+
+typedef struct {
+  int         status; // BL_NO_ERROR or the error code of the operation
+  bl_value_t *value;  // Value read, NULL for a write or on error
+} bl_batch_result_t;
+
+bl_batch_t *bl_batch_new(void);
+void bl_batch_free(bl_batch_t *batch);
+
+// Read a characteristic value or a descriptor by its handle. The uuid_str
+// (can be NULL) is given to the value read.
+int bl_batch_add_read(bl_batch_t *batch, uint16_t handle, char *uuid_str);
+
+// Write by handle, the value is copied. Same types as bl_write_char.
+int bl_batch_add_write(bl_batch_t *batch, uint16_t handle, uint8_t *value,
+    size_t size, int type);
+
+int bl_batch_get_size(bl_batch_t *batch);
+
+// Send all the operations and wait for all of them. Returns one result per
+// operation in the order of the adds, NULL if the batch can't be run.
+// The results belong to the batch until the next run or bl_batch_free, a
+// value can be kept by setting it to NULL in the result.
+bl_batch_result_t *bl_batch_run(bl_batch_t *batch, GError **gerr);
+
+
+/************************** Resumable long reads ***************************/
+// A long read keeps the part of the value already read, out of the
+// connection. When the connection is lost in the middle, bl_long_read_run
+// continues with a Read Blob at the offset reached, once connected again.
+typedef struct bl_long_read bl_long_read_t;
+
+// Long read of the value of a handle. The buffer starts with expected_size
+// bytes if not 0. On resume, the first check_size bytes of the value (one
+// ATT_MTU at most) are read again: if they changed, so did the value, and
+// the read starts again from the beginning. 0 for no check.
+bl_long_read_t *bl_long_read_new(uint16_t handle, size_t expected_size,
+    size_t check_size);
+void bl_long_read_free(bl_long_read_t *long_read);
+
+// Read the value up to its end, from the offset reached by the previous
+// runs. Nothing is done if the value is complete.
+// Return BL_NO_ERROR when the whole value is read, or the error code. The
+// part read is kept.
+int bl_long_read_run(bl_long_read_t *long_read);
+
+gboolean bl_long_read_is_complete(bl_long_read_t *long_read);
+
+// Part of the value read so far, it belongs to the long read.
+const uint8_t *bl_long_read_get_data(bl_long_read_t *long_read, size_t *size);
+
+
+/***************************** Periodic reads ******************************/
+// Handles read periodically by the event loop while connected, instead of
+// a thread per handle. The reads falling due together are sent in Read
+// Multiple Variable Length requests, see bl_read_multiple, or else back to
+// back.
+//
+// bl_poll_cb_t:
+//  status:    BL_NO_ERROR or the error code of the read.
+//  value:     Value read, NULL on error. Freed after the call.
+//  missed:    Deadlines missed since the previous call: periods gone by
+//             while the previous read was still waiting for its answer, or
+//             the event loop was late.
+//  user_data: The pointer given to bl_poll_add.
+// func is called from the event loop thread. It must not call the
+// synchronous functions of bluelib.
+typedef void (*bl_poll_cb_t)(int status, bl_value_t *value, guint missed,
+    void *user_data);
+
+// Read handle every period_ms, from the connection. Return the id of the
+// periodic read, 0 on error.
+guint bl_poll_add(uint16_t handle, guint period_ms, bl_poll_cb_t func,
+    void *user_data);
+
+// Stop a periodic read. func may still be called by a read in progress.
+// Return BL_NO_ERROR, BL_REQUEST_FAIL_ERROR if id is unknown.
+int bl_poll_remove(guint id);
+
+typedef struct {
+  guint64 reads;    // Reads given to func, with or without error
+  guint64 requests; // ATT requests sent for them
+  guint64 missed;   // Deadlines missed
+} bl_poll_stats_t;
+
+int bl_get_poll_stats(bl_poll_stats_t *stats);
+
+
 /*************************** Set security level ****************************/
 #define SECURITY_LEVEL_LOW    0 // Default
 #define SECURITY_LEVEL_MEDIUM 1
@@ -282,6 +612,97 @@ int bl_change_sec_level(int level);
 int bl_change_mtu(int value);
 
 
+/**************************** Asynchronous calls ****************************
+ * Each of these functions sends its request and returns immediately. The
+ * returned id can be given to bl_cancel. If the request can't be sent 0 is
+ * returned and func is never called.
+ *
+ * bl_async_cb_t:
+ *  status:    BL_NO_ERROR or the error code of the synchronous equivalent.
+ *  result:    Same result as the synchronous equivalent, NULL on error.
+ *             It belongs to the user and must be freed with the matching
+ *             bl_*_free function.
+ *  user_data: The pointer given with the request.
+ *
+ * func is called exactly once, from the event loop thread. It must not call
+ * the synchronous functions of bluelib which would wait on this same thread.
+ */
+typedef void (*bl_async_cb_t)(int status, void *result, void *user_data);
+
+// Result: list of primary services (bl_primary_t *).
+guint bl_get_all_primary_async(char *uuid_str, bl_async_cb_t func,
+    void *user_data);
+
+// Result: list of included services (bl_included_t *).
+guint bl_get_included_async(bl_primary_t *bl_primary, bl_async_cb_t func,
+    void *user_data);
+
+// Result: list of characteristics (bl_char_t *).
+guint bl_get_all_char_async(char *uuid_str, bl_primary_t *bl_primary,
+    bl_async_cb_t func, void *user_data);
+
+// Result: list of characteristic descriptors (bl_desc_t *).
+guint bl_get_all_desc_by_char_async(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, bl_async_cb_t func,
+    void *user_data);
+
+// Result: value (bl_value_t *).
+guint bl_read_char_by_char_async(bl_char_t *bl_char, bl_async_cb_t func,
+    void *user_data);
+
+// Result: list of values (bl_value_t *).
+guint bl_read_char_all_async(char *uuid_str, bl_primary_t *bl_primary,
+    bl_async_cb_t func, void *user_data);
+
+// Result: value (bl_value_t *).
+guint bl_read_desc_by_desc_async(bl_desc_t *bl_desc, bl_async_cb_t func,
+    void *user_data);
+
+// Result: NULL. A write command completes once it has been sent.
+guint bl_write_char_by_char_async(bl_char_t *bl_char, uint8_t *value,
+    size_t size, int type, bl_async_cb_t func, void *user_data);
+
+// Result: NULL.
+guint bl_write_desc_by_desc_async(bl_desc_t *bl_desc, uint8_t *value,
+    size_t size, bl_async_cb_t func, void *user_data);
+
+// Cancel a request by its id. Its callback is called with
+// BL_CANCELLED_ERROR, possibly from the calling thread.
+int bl_cancel(guint id);
+
+
+/************************** Streaming discoveries ***************************
+ * Asynchronous discoveries which give the attributes page by page, as each
+ * response of the device is decoded, instead of the whole list at the end.
+ *
+ * bl_page_cb_t:
+ *  list:      Attributes of the page (bl_primary_t *, bl_char_t * or
+ *             bl_desc_t *). It is freed by bluelib after the call, copy
+ *             what must be kept.
+ *  user_data: The pointer given with the request.
+ *  Return FALSE to stop the discovery there.
+ *
+ * page_func is called from the event loop thread like bl_async_cb_t. func
+ * is then called once at the end, with a NULL result. The status is
+ * BL_NO_ERROR when the discovery went to the end or page_func stopped it,
+ * BL_CANCELLED_ERROR after bl_cancel.
+ */
+typedef gboolean (*bl_page_cb_t)(GSList *list, void *user_data);
+
+// All the primary services of the device.
+guint bl_get_all_primary_stream(bl_page_cb_t page_func, bl_async_cb_t func,
+    void *user_data);
+
+// All the characteristics of bl_primary, or of the device if NULL.
+guint bl_get_all_char_stream(bl_primary_t *bl_primary, bl_page_cb_t page_func,
+    bl_async_cb_t func, void *user_data);
+
+// Same descriptors as bl_get_all_desc_by_char.
+guint bl_get_all_desc_by_char_stream(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, bl_page_cb_t page_func,
+    bl_async_cb_t func, void *user_data);
+
+
 /****************************** Notifications *******************************
  * NOTE: The notification list is part of the variable "attrib" which is
  * allocated at each connection. And free at each deconnection. Even not
@@ -314,7 +735,16 @@ int bl_add_notif_by_char(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
     bl_primary_t *bl_primary, GAttribNotifyFunc func, void *user_data,
     uint8_t opcode);
 
-// Retrieve a UUID from a handle.
+// Asynchronous equivalent of bl_add_notif_by_char, see bl_async_cb_t.
+// Result: NULL.
+guint bl_add_notif_by_char_async(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GAttribNotifyFunc func,
+    void *user_data, uint8_t opcode, bl_async_cb_t cb, void *cb_user_data);
+
+// Retrieve a UUID from a handle: the value of the characteristic, or its
+// declaration or one of its descriptors already known by the cache, see
+// bl_lookup_handle. Nothing is discovered. From a notification callback,
+// only the value handle received is resolved.
 char *bl_get_notif_uuid(uint16_t handle);
 
 // Remove a notification by UUID.
@@ -333,4 +763,7 @@ void bl_notif_list_print(void);
 // acknowledge the indication.
 void bl_notif_indication_resp(void);
 
+// Functions taking a context
+#include "bluelib_ctx.h"
+
 #endif
@@ -0,0 +1,249 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef _BLUELIB_CTX_H_
+#define _BLUELIB_CTX_H_
+
+#include "bluelib.h"
+
+// Connection contexts
+//
+// A context holds one connection: its GAttrib, its options, its requests in
+// progress and its notification list. A process can drive several devices
+// by using one context per device. The connections are spread over a pool
+// of reactor threads (see bl_set_reactors), each one running its own event
+// loop. A reactor thread is started by its first connection and kept alive
+// after the last disconnection, for the next ones. A context can also be
+// driven from a main context of the application (bl_ctx_set_main_context,
+// bl_ctx_get_fd) or by the calling thread itself (bl_ctx_set_inline), no
+// reactor thread is used then.
+//
+// Each function of bluelib.h has an equivalent taking the context as first
+// argument, with the same behaviour. The functions of bluelib.h work on the
+// context created by bl_init.
+//
+// Two functions on the same context are serialised. Functions on different
+// contexts can run at the same time from different threads.
+
+/********************** Initialisation of the context **********************/
+// NOTE: Set the arguments to (NULL, NULL, NULL, 0, 0) for default values.
+// Return NULL on malloc error.
+bl_ctx_t *bl_ctx_new(const char *src, const char *dst, const char *dst_type,
+    int psm, const int sec_level);
+
+// Disconnect if needed and free the context.
+void bl_ctx_free(bl_ctx_t *ctx);
+
+conn_state_t bl_ctx_get_conn_state(bl_ctx_t *ctx);
+
+// See bl_set_main_context.
+int bl_ctx_set_main_context(bl_ctx_t *ctx, GMainContext *context);
+// See bl_get_fd and bl_dispatch.
+int bl_ctx_get_fd(bl_ctx_t *ctx, GError **gerr);
+int bl_ctx_dispatch(bl_ctx_t *ctx);
+int bl_ctx_set_inline(bl_ctx_t *ctx, int busy_poll_us);
+int bl_ctx_set_timeout(bl_ctx_t *ctx, int timeout_ms);
+int bl_ctx_get_timeout(bl_ctx_t *ctx);
+
+
+/******************** Connect/Disconnect from a device *********************/
+int bl_ctx_connect(bl_ctx_t *ctx, char *mac_dst, char *dst_type);
+int bl_ctx_disconnect(bl_ctx_t *ctx);
+int bl_ctx_set_connect_cb(bl_ctx_t *ctx, user_cb_fct_t func);
+int bl_ctx_get_connect_timings(bl_ctx_t *ctx, bl_connect_timings_t *timings);
+
+
+/*************************** GATT database cache ***************************/
+int bl_ctx_set_cache_dir(bl_ctx_t *ctx, const char *dir);
+int bl_ctx_clear_cache(bl_ctx_t *ctx);
+int bl_ctx_get_cache_stats(bl_ctx_t *ctx, bl_cache_stats_t *stats);
+int bl_ctx_set_layout_sharing(bl_ctx_t *ctx, gboolean enable,
+    const char *key_uuids);
+
+
+/***************************** Whole database ******************************/
+bl_database_t *bl_ctx_get_database(bl_ctx_t *ctx, GError **gerr);
+int bl_ctx_lookup_handle(bl_ctx_t *ctx, uint16_t handle,
+    bl_primary_t **bl_primary, bl_char_t **bl_char);
+GSList *bl_ctx_lookup_range(bl_ctx_t *ctx, uint16_t start, uint16_t end,
+    GError **gerr);
+
+
+/***************************** Primary Service *****************************/
+bl_primary_t *bl_ctx_get_primary(bl_ctx_t *ctx, char *uuid_str, GError **gerr);
+GSList *bl_ctx_get_all_primary(bl_ctx_t *ctx, char *uuid_str, GError **gerr);
+GSList *bl_ctx_get_all_primary_device(bl_ctx_t *ctx, GError **gerr);
+guint bl_ctx_get_all_primary_async(bl_ctx_t *ctx, char *uuid_str,
+    bl_async_cb_t func, void *user_data);
+
+
+/**************************** Included Services ****************************/
+GSList *bl_ctx_get_included(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    GError **gerr);
+guint bl_ctx_get_included_async(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    bl_async_cb_t func, void *user_data);
+
+
+/***************************** Characteristics *****************************/
+bl_char_t *bl_ctx_get_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+GSList *bl_ctx_get_all_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+GSList *bl_ctx_get_all_char_in_primary(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    GError **gerr);
+guint bl_ctx_get_all_char_async(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, bl_async_cb_t func, void *user_data);
+
+
+/******************************* Descriptors *******************************/
+bl_desc_t *bl_ctx_get_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, char *desc_uuid_str, GError **gerr);
+GSList *bl_ctx_get_all_desc(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+bl_desc_t *bl_ctx_get_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr);
+GSList *bl_ctx_get_all_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GError **gerr);
+GSList *bl_ctx_get_all_desc_in_primary(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    GSList *bl_char_list, GError **gerr);
+guint bl_ctx_get_all_desc_by_char_async(bl_ctx_t *ctx,
+    bl_char_t *start_bl_char, bl_char_t *end_bl_char, bl_primary_t *bl_primary,
+    bl_async_cb_t func, void *user_data);
+
+
+/********************************** Read ***********************************/
+bl_value_t *bl_ctx_read_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+GSList *bl_ctx_read_char_all(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+bl_value_t *bl_ctx_read_char_blob(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+GSList *bl_ctx_read_char_all_blob(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+bl_value_t *bl_ctx_read_char_by_char(bl_ctx_t *ctx, bl_char_t *bl_char,
+    GError **gerr);
+bl_value_t *bl_ctx_read_long(bl_ctx_t *ctx, uint16_t handle,
+    size_t expected_size, GError **gerr);
+int bl_ctx_read_stream(bl_ctx_t *ctx, uint16_t handle, bl_chunk_cb_t chunk_func,
+    void *user_data, size_t *value_size);
+int bl_ctx_read_into(bl_ctx_t *ctx, uint16_t handle, uint8_t *buf,
+    size_t size, size_t *value_size);
+GSList *bl_ctx_read_multiple(bl_ctx_t *ctx, uint16_t *handles, int n,
+    GError **gerr);
+guint bl_ctx_read_char_all_async(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, bl_async_cb_t func, void *user_data);
+guint bl_ctx_read_char_by_char_async(bl_ctx_t *ctx, bl_char_t *bl_char,
+    bl_async_cb_t func, void *user_data);
+bl_value_t *bl_ctx_read_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, char *desc_uuid_str, GError **gerr);
+GSList *bl_ctx_read_all_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+bl_value_t *bl_ctx_read_desc_by_desc(bl_ctx_t *ctx, bl_desc_t *bl_desc,
+    GError **gerr);
+bl_value_t *bl_ctx_read_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr);
+guint bl_ctx_read_desc_by_desc_async(bl_ctx_t *ctx, bl_desc_t *bl_desc,
+    bl_async_cb_t func, void *user_data);
+
+
+/********************************** Write **********************************/
+int bl_ctx_write_char(bl_ctx_t *ctx, char *uuid_str, bl_primary_t *bl_primary,
+    uint8_t *value, size_t size, int type);
+int bl_ctx_write_char_by_char(bl_ctx_t *ctx, bl_char_t *bl_char,
+    uint8_t *value, size_t size, int type);
+guint bl_ctx_write_char_by_char_async(bl_ctx_t *ctx, bl_char_t *bl_char,
+    uint8_t *value, size_t size, int type, bl_async_cb_t func, void *user_data);
+int bl_ctx_write_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, char *desc_uuid_str, uint8_t *value, size_t size);
+int bl_ctx_write_desc_by_desc(bl_ctx_t *ctx, bl_desc_t *bl_desc,
+    uint8_t *value, size_t size);
+int bl_ctx_write_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    uint8_t *value, size_t size);
+guint bl_ctx_write_desc_by_desc_async(bl_ctx_t *ctx, bl_desc_t *bl_desc,
+    uint8_t *value, size_t size, bl_async_cb_t func, void *user_data);
+
+
+/*************************** First match lookups ***************************/
+bl_primary_t *bl_ctx_find_primary(bl_ctx_t *ctx, char *uuid_str,
+    GError **gerr);
+bl_char_t *bl_ctx_find_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr);
+bl_desc_t *bl_ctx_find_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr);
+bl_desc_t *bl_ctx_get_cccd(bl_ctx_t *ctx, bl_char_t *bl_char, GError **gerr);
+
+
+/************************** Streaming discoveries **************************/
+guint bl_ctx_get_all_primary_stream(bl_ctx_t *ctx, bl_page_cb_t page_func,
+    bl_async_cb_t func, void *user_data);
+guint bl_ctx_get_all_char_stream(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    bl_page_cb_t page_func, bl_async_cb_t func, void *user_data);
+guint bl_ctx_get_all_desc_by_char_stream(bl_ctx_t *ctx,
+    bl_char_t *start_bl_char, bl_char_t *end_bl_char,
+    bl_primary_t *bl_primary, bl_page_cb_t page_func, bl_async_cb_t func,
+    void *user_data);
+
+
+/********************************* Batches *********************************/
+// The other batch functions are in bluelib.h.
+bl_batch_t *bl_ctx_batch_new(bl_ctx_t *ctx);
+
+
+/************************** Resumable long reads ***************************/
+// The other long read functions are in bluelib.h.
+int bl_ctx_long_read_run(bl_ctx_t *ctx, bl_long_read_t *long_read);
+
+
+/***************************** Periodic reads ******************************/
+guint bl_ctx_poll_add(bl_ctx_t *ctx, uint16_t handle, guint period_ms,
+    bl_poll_cb_t func, void *user_data);
+int bl_ctx_poll_remove(bl_ctx_t *ctx, guint id);
+int bl_ctx_get_poll_stats(bl_ctx_t *ctx, bl_poll_stats_t *stats);
+
+
+/********************* Cancel, security level and MTU **********************/
+int bl_ctx_cancel(bl_ctx_t *ctx, guint id);
+int bl_ctx_change_sec_level(bl_ctx_t *ctx, int level);
+int bl_ctx_change_mtu(bl_ctx_t *ctx, int value);
+
+
+/****************************** Notifications ******************************/
+int bl_ctx_add_notif(bl_ctx_t *ctx, char *uuid_str, bl_primary_t *bl_primary,
+    GAttribNotifyFunc func, void *user_data, uint8_t opcode);
+int bl_ctx_add_notif_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GAttribNotifyFunc func,
+    void *user_data, uint8_t opcode);
+guint bl_ctx_add_notif_by_char_async(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GAttribNotifyFunc func,
+    void *user_data, uint8_t opcode, bl_async_cb_t cb, void *cb_user_data);
+char *bl_ctx_get_notif_uuid(bl_ctx_t *ctx, uint16_t handle);
+int bl_ctx_remove_notif(bl_ctx_t *ctx, char *uuid_str);
+int bl_ctx_remove_notif_by_char(bl_ctx_t *ctx, bl_char_t *bl_char);
+int bl_ctx_remove_all_notif(bl_ctx_t *ctx);
+void bl_ctx_notif_list_print(bl_ctx_t *ctx);
+void bl_ctx_notif_indication_resp(bl_ctx_t *ctx);
+
+#endif
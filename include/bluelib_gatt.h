@@ -58,6 +58,32 @@ typedef struct {
   uint8_t    *data;
 } bl_value_t;
 
+// Attribute of a flat database, see bl_get_database.
+#define BL_ATTR_PRIMARY  0
+#define BL_ATTR_INCLUDED 1
+#define BL_ATTR_CHAR     2
+#define BL_ATTR_DESC     3
+
+typedef struct {
+  char        uuid_str[MAX_LEN_UUID_STR];
+  uint8_t     type;         // BL_ATTR_*
+  uint8_t     properties;   // Characteristic
+  uint16_t    handle;       // Declaration or descriptor
+  uint16_t    start_handle; // Primary or included service
+  uint16_t    end_handle;   // Primary or included service
+  uint16_t    value_handle; // Characteristic
+  int         parent;       // Index of the service of an included service or
+                            // a characteristic, of the characteristic of a
+                            // descriptor. -1 for a primary service or out of
+                            // the primary services
+} bl_attr_t;
+
+// The attributes are sorted by handle: each one comes after its parent.
+typedef struct {
+  int         n_attrs;
+  bl_attr_t   attrs[];
+} bl_database_t;
+
 
 #define MAC_SZ 17
 
@@ -90,6 +116,7 @@ void struct_free(void *bl_struct);
 #define bl_char_free(bl_char)         struct_free(bl_char)
 #define bl_desc_free(bl_desc)         struct_free(bl_desc)
 void bl_value_free(bl_value_t *bl_value);
+#define bl_database_free(bl_db)       struct_free(bl_db)
 
 // List destructors
 void list_free(GSList *list);
@@ -98,6 +125,8 @@ void list_free(GSList *list);
 #define bl_char_list_free(list)       list_free(list)
 #define bl_desc_list_free(list)       list_free(list)
 void bl_value_list_free(GSList *list);
+// List of lists of descriptors, see bl_get_all_desc_in_primary
+void bl_desc_lists_free(GSList *list);
 
 // Print Struct
 #define bl_primary_print(bl_primary)  bl_primary_fprint(NULL, bl_primary)
@@ -105,6 +134,7 @@ void bl_value_list_free(GSList *list);
 #define bl_char_print(bl_char)        bl_char_fprint(NULL, bl_char)
 #define bl_desc_print(bl_desc)        bl_desc_fprint(NULL, bl_desc)
 #define bl_value_print(bl_value)      bl_value_fprint(NULL, bl_value)
+#define bl_database_print(bl_db)      bl_database_fprint(NULL, bl_db)
 
 // Print Struct in file
 void bl_primary_fprint( FILE *f, bl_primary_t  *bl_primary);
@@ -112,6 +142,8 @@ void bl_included_fprint(FILE *f, bl_included_t *bl_included);
 void bl_char_fprint(    FILE *f, bl_char_t     *bl_char);
 void bl_desc_fprint(    FILE *f, bl_desc_t     *bl_desc);
 void bl_value_fprint(   FILE *f, bl_value_t    *bl_value);
+// Same tree as the functions above.
+void bl_database_fprint(FILE *f, bl_database_t *bl_db);
 
 // Print list
 #define bl_primary_list_print(list)   list_fprint(NULL, list, 0)
@@ -0,0 +1,107 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+// Here are only the function private to BlueLib library.
+// The rest is public and is defined in bluelib.h
+#include "bluelib.h"
+
+// Attributes of the connected device learnt by the discoveries, sorted by
+// handle and indexed by UUID. A lookup is answered when the discoveries
+// already covered its range. The descriptors are all the attributes found
+// by Find Information which are not declarations, so they include the
+// characteristic values as bl_get_all_desc_by_char does.
+// The whole database is kept on disk between the connections, see
+// bl_set_cache_dir.
+typedef struct gatt_cache gatt_cache_t;
+
+gatt_cache_t *cache_new(void);
+void cache_free(gatt_cache_t *cache);
+
+// Read the cache of the device mac in dir, NULL if there is none.
+gatt_cache_t *cache_load(const char *dir, const char *mac);
+// Only a complete cache is saved.
+int cache_save(gatt_cache_t *cache, const char *dir, const char *mac,
+    GError **gerr);
+void cache_remove(const char *dir, const char *mac);
+
+// Databases shared by the devices with the same layout, in this process and
+// in dir if given. key is the identifier of the layout, usable as a file
+// name. cache_layout_get returns a copy, NULL if the layout is unknown.
+gatt_cache_t *cache_layout_get(const char *key, const char *dir);
+// Only a complete cache is shared.
+void cache_layout_put(const char *key, gatt_cache_t *cache, const char *dir);
+void cache_layout_remove(const char *key, const char *dir);
+
+// The whole database has been discovered.
+void     cache_set_complete(gatt_cache_t *cache);
+gboolean cache_is_complete(gatt_cache_t *cache);
+// Database Hash of the device, FALSE if unknown.
+void     cache_set_hash(gatt_cache_t *cache, const uint8_t *hash);
+gboolean cache_get_hash(gatt_cache_t *cache, uint8_t *hash);
+
+// Forget the attributes between start and end, after a Service Changed.
+// The cache is not complete anymore.
+void cache_invalidate(gatt_cache_t *cache, uint16_t start, uint16_t end);
+
+// Results of the discoveries, the lists are copied.
+// All the primary services of the device.
+void cache_add_primaries(gatt_cache_t *cache, GSList *bl_primary_list);
+// All the included services or characteristics between start and end.
+void cache_add_included(gatt_cache_t *cache, uint16_t start, uint16_t end,
+    GSList *bl_included_list);
+void cache_add_chars(gatt_cache_t *cache, uint16_t start, uint16_t end,
+    GSList *bl_char_list);
+// All the descriptors of bl_char, up to the next declaration.
+void cache_add_descs(gatt_cache_t *cache, bl_char_t *bl_char,
+    GSList *bl_desc_list);
+
+// Same results as the discovery functions in list, as copies. FALSE if the
+// cache can't answer.
+gboolean cache_get_primary(gatt_cache_t *cache, char *uuid_str,
+    GSList **list);
+gboolean cache_get_included(gatt_cache_t *cache, bl_primary_t *bl_primary,
+    GSList **list);
+gboolean cache_get_char(gatt_cache_t *cache, char *uuid_str,
+    bl_primary_t *bl_primary, GSList **list);
+gboolean cache_get_desc(gatt_cache_t *cache, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GSList **list);
+
+// Value handle of the first characteristic known with this UUID, whatever
+// the discoveries made, INVALID_HANDLE if there is none.
+uint16_t cache_find_value_handle(gatt_cache_t *cache, char *uuid_str);
+
+// Service and characteristic owning handle, as copies, NULL if none. The
+// characteristics own their handles up to the next one. FALSE if the cache
+// can't answer.
+gboolean cache_lookup_handle(gatt_cache_t *cache, uint16_t handle,
+    bl_primary_t **bl_primary, bl_char_t **bl_char);
+// Copies of the characteristics owning a handle between start and end.
+gboolean cache_lookup_range(gatt_cache_t *cache, uint16_t start,
+    uint16_t end, GSList **list);
+
+// Whole database as returned by bl_get_database, NULL if the cache is not
+// complete.
+bl_database_t *cache_get_database(gatt_cache_t *cache);
+
+#endif
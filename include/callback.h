@@ -25,16 +25,121 @@
 
 #include <stdint.h>
 
+#include "bluelib.h"
+
+// Request in progress.
+// The request is given as user_data to the GAttrib, its callback fills the
+// result and wakes up the thread waiting in wait_for_cb().
+typedef struct {
+  bl_ctx_t       *ctx;          // Connection of the request
+  int             refs;
+  GMutex          mutex;
+  GCond           cond;
+  gboolean        done;
+  gboolean        cancelled;
+  guint           id;           // Id given to the user
+  guint           att_id;       // Id of the request currently on the GAttrib
+  char            uuid_str[MAX_LEN_UUID_STR]; // Given to the results
+  uint16_t        handle;       // Given to the read value
+  uint16_t        end_handle;   // End of the range for the paginated requests
+  uint16_t       *handles;      // Read Multiple: handles sent, not owned
+  int             n_handles;
+  uint8_t        *buf;          // Read into: buffer of the caller, not owned
+  size_t          buf_size;
+  size_t          value_size;   // Size of the value, even if truncated
+  bl_chunk_cb_t   chunk_func;   // Streamed long reads: given each part
+  GSList         *list;         // Results gathered on the previous pages
+  void           *ret_pointer;
+  int             ret_val;
+  char            ret_msg[1024];
+  guint8          att_status;   // ATT error of a discovery
+  gboolean        sweep;        // Find Information goes on past the
+                                // declarations, given as descriptors
+  // Asynchronous requests only
+  bl_async_cb_t   func;
+  void           *user_data;
+  GDestroyNotify  ret_free;     // Free ret_pointer if nobody takes it
+  bl_page_cb_t    page_func;    // Streaming discoveries: given each page
+} bl_req_t;
+
+bl_req_t *req_new(bl_ctx_t *ctx);
+bl_req_t *req_ref(bl_req_t *req);
+void      req_unref(bl_req_t *req);
+// Release the reference of the callback and wake up the waiting thread.
+// For an asynchronous request, the result is given to the user callback.
+void      req_complete(bl_req_t *req);
+// Release the reference of the callback when the request couldn't be sent.
+void      req_drop(bl_req_t *req);
+// Cancel an asynchronous request by the id given to the user.
+// If set, to_complete must be given to req_complete once the bluelib mutex
+// is released.
+int       req_cancel(bl_ctx_t *ctx, guint id, bl_req_t **to_complete);
+// Id of a new asynchronous request, never 0.
+guint     req_new_id(void);
+// Cancel a request left without answer, it is completed with
+// BL_NO_CALLBACK_ERROR. The connection is torn down if the request can't be
+// cancelled: all the pending requests fail with BL_DISCONNECTED_ERROR.
+void      req_expire(bl_req_t *req);
+// Tear down a connection which can't be trusted anymore, its pending
+// requests fail with BL_DISCONNECTED_ERROR.
+void      conn_abort(bl_ctx_t *ctx);
+
+// Request senders, defined in bluelib.c.
+// The bluelib mutex must be held, or the caller must be in the event loop.
+// Return the id of the request, 0 on error with gerr set.
+guint send_primary(char *uuid_str, bl_req_t *req, GError **gerr);
+guint send_included(bl_primary_t *bl_primary, bl_req_t *req, GError **gerr);
+guint send_char(char *uuid_str, bl_primary_t *bl_primary, bl_req_t *req,
+    GError **gerr);
+guint send_desc_discovery(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
+    bl_primary_t *bl_primary, bl_req_t *req, GError **gerr);
+// Descriptors between two handles, up to the next declaration.
+guint send_desc_range(uint16_t start_handle, uint16_t end_handle,
+    bl_req_t *req, GError **gerr);
+// Streaming discoveries, the pages are given to req->page_func.
+guint send_primary_stream(bl_req_t *req, GError **gerr);
+guint send_char_stream(bl_primary_t *bl_primary, bl_req_t *req,
+    GError **gerr);
+// The callback adds the handle and the uuid to the value. The buffer of a
+// long value starts with size_hint bytes.
+guint send_read_by_hnd(uint16_t handle, char *uuid_str, size_t size_hint,
+    bl_req_t *req, GError **gerr);
+// Most handles of a Read Multiple Variable Length request, as many as fit in
+// the largest ATT_MTU of 517 bytes.
+#define READ_MULTI_MAX ((517 - 1) / 2)
+// Read Multiple Variable Length of the first handles, as many as fit in the
+// MTU, READ_MULTI_MAX at most. The callback gives them to the values.
+guint send_read_multi(uint16_t *handles, int n, bl_req_t *req,
+    GError **gerr);
+guint send_write(uint16_t handle, uint8_t *value, size_t size, int type,
+    bl_req_t *req, GError **gerr);
+// Release the socket, its watches and the GAttrib of the connection.
+void disconnect_io(bl_ctx_t *ctx);
+// Take the bluelib mutex from outside of bluelib.c. Fail if not connected.
+int  bluelib_lock(bl_ctx_t *ctx);
+void bluelib_unlock(bl_ctx_t *ctx);
+
 // Event loop
-int  start_event_loop(GError **gerr);
-void stop_event_loop(void);
-int  is_event_loop_running(void);
+int  start_event_loop(bl_ctx_t *ctx, GError **gerr);
+void stop_event_loop(bl_ctx_t *ctx);
+int  is_event_loop_running(bl_ctx_t *ctx);
+// GMainContext given by the application, else the one of the reactor serving
+// the context, NULL if not connected
+GMainContext *event_loop_context(bl_ctx_t *ctx);
+// Release the pollable fd of bl_ctx_get_fd
+void free_poll_set(bl_ctx_t *ctx);
 
-// Block the main thread while waiting for the callback
-int wait_for_cb(void **ret_pointer, GError **gerr);
+// Block the main thread while waiting for the callback of the request
+int wait_for_cb(bl_req_t *req, void **ret_pointer, GError **gerr);
+// Block until done is set, under mutex and with cond signaled. The main
+// context of ctx is iterated if possible. BL_NO_CALLBACK_ERROR on timeout,
+// when the connection stays silent for the adaptive timeout.
+int wait_for_done(bl_ctx_t *ctx, GMutex *mutex, GCond *cond, gboolean *done);
+// Same as wait_for_done, once the requests setting done have been expired.
+// The connection is aborted if done is still not set after one more timeout.
+void wait_for_expired(bl_ctx_t *ctx, GMutex *mutex, GCond *cond,
+    gboolean *done);
 
-// Shared variable
-extern uint16_t end_handle_cb;
 // Callbacks
 void connect_cb(GIOChannel *io, GError *err, gpointer user_data);
 void primary_all_cb(GSList *services, guint8 status,
@@ -44,14 +149,27 @@ void primary_by_uuid_cb(GSList *ranges, guint8 status,
 void included_cb(GSList *includes, guint8 status, gpointer user_data);
 void char_by_uuid_cb(GSList *characteristics, guint8 status,
     gpointer user_data);
+void primary_stream_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data);
+void char_stream_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data);
 void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
     gpointer user_data);
 void read_by_hnd_cb(guint8 status, const guint8 *pdu, guint16 plen,
     gpointer user_data);
+void read_into_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data);
+gboolean read_chunk_cb(const guint8 *value, guint16 vlen, guint16 offset,
+    gpointer user_data);
+void read_stream_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data);
 void read_by_uuid_cb(guint8 status, const guint8 *pdu,
     guint16 plen, gpointer user_data);
+void read_multi_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data);
 void write_req_cb(guint8 status, const guint8 *pdu, guint16 plen,
     gpointer user_data);
+void write_cmd_cb(gpointer user_data);
 void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
     gpointer user_data);
 #endif
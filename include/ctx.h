@@ -0,0 +1,110 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef _CTX_H_
+#define _CTX_H_
+// Here is the content of a context, private to BlueLib library.
+// The rest is public and is defined in bluelib_ctx.h
+#include "bluelib.h"
+
+struct reactor;
+struct poll_set;
+struct gatt_cache;
+struct poller;
+
+// One connection to a device.
+struct bl_ctx {
+  // Connection, also used by callbacks
+  GAttrib       *attrib;
+  GIOChannel    *iochannel;
+  GSource       *hup_watch;
+  int            opt_mtu;
+  gboolean       no_read_multi_var; // Not supported by the device
+  conn_state_t   conn_state;
+  char          *current_mac;
+
+  // Options
+  char          *opt_src;
+  char          *opt_dst;
+  char          *opt_dst_type;
+  char          *opt_sec_level;
+  int            opt_psm;
+
+  // Avoid two functions running at the same time on this connection
+  GMutex         mutex;
+
+  // Requests sent and not yet answered. They are completed with an error if
+  // the connection is lost before their callback is called.
+  GSList        *pending_reqs;
+  GMutex         pending_mutex;
+
+  // Reactor serving the connection, set while connected. Not used if the
+  // application gives its own main context.
+  struct reactor *reactor;
+  GMainContext  *main_context;
+  // Pollable fd following main_context, see bl_get_fd
+  struct poll_set *poll_set;
+  // Time a synchronous call iterating main_context spins before blocking
+  int            busy_poll_us;
+
+  // Round trip time of the ATT transactions and timeout of the requests,
+  // with pending_mutex
+  gint64         srtt_us;
+  gint64         rttvar_us;
+  gint64         last_rx_time;
+  int            timeout_ms;   // Fixed timeout, 0 for the adaptive one
+
+  // Attributes of the connected device, see cache.h and bl_set_cache_dir
+  char          *cache_dir;
+  struct gatt_cache *cache;
+  gboolean       cache_failed; // Not built again before the next connection
+  bl_cache_stats_t cache_stats;
+  // Databases shared by the devices with the same layout, see cache.h.
+  // layout_key identifies the layout of the connected device, if known.
+  gboolean       share_layout;
+  char         **layout_key_uuids;
+  char          *layout_key;
+  // Value handle of the Service Changed characteristic, atomic. The ranges
+  // it indicates are discovered again by the event loop, see database.h.
+  gint           service_changed_handle;
+  // With changed_mutex: range indicated and not discovered yet (changed_end
+  // is 0 if there is none), discovery running, discoveries finished and not
+  // yet given to the cache
+  GMutex         changed_mutex;
+  uint16_t       changed_start;
+  uint16_t       changed_end;
+  gboolean       rediscovering;
+  GSList        *changes;
+
+  // Periodic reads, see bl_poll_add
+  struct poller *poller;
+
+  // Phases of the last connection, connect_time is the start of the socket
+  // connection
+  bl_connect_timings_t timings;
+  gint64         connect_time;
+
+  // User specific callback
+  user_cb_fct_t *connect_cb_fct;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef _DATABASE_H_
+#define _DATABASE_H_
+// Here are only the function private to BlueLib library.
+// The rest is public and is defined in bluelib.h
+#include "bluelib.h"
+#include "cache.h"
+
+// Discover the whole database of the connected device into cache, which is
+// then complete. The requests are chained by the event loop, the caller is
+// only woken up at the end. The bluelib mutex must be held.
+int database_discover(bl_ctx_t *ctx, gatt_cache_t *cache, GError **gerr);
+
+// Service Changed indicated by the device, from the event loop. The range is
+// discovered again by the event loop, the notifications registered there
+// follow their characteristic and are enabled again.
+void database_changed(bl_ctx_t *ctx, uint16_t start, uint16_t end);
+// Give the ranges discovered again to the cache, with the bluelib mutex
+// held. FALSE if there was none.
+gboolean database_apply_changes(bl_ctx_t *ctx, gatt_cache_t *cache);
+// Forget the ranges discovered again, on connection and disconnection.
+void database_drop_changes(bl_ctx_t *ctx);
+
+#endif
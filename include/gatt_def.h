@@ -26,6 +26,9 @@
 #define _GATT_DEF_H_
 
 
+/* GATT Services */
+#define GATT_SVC_GENERIC_ATTRIBUTE_STR        "1801"
+
 /* GATT Profile Attribute types */
 #define GATT_PRIM_SVC_UUID_STR                "2800"
 #define GATT_SND_SVC_UUID_STR                 "2801"
@@ -39,6 +42,7 @@
 #define GATT_CHARAC_RECONNECTION_ADDRESS_STR  "2A03"
 #define GATT_CHARAC_PERIPHERAL_PREF_CONN_STR  "2A04"
 #define GATT_CHARAC_SERVICE_CHANGED_STR       "2A05"
+#define GATT_CHARAC_DATABASE_HASH_STR         "2B2A"
 
 /* GATT Characteristic Descriptors */
 #define GATT_CHARAC_EXT_PROPER_UUID_STR       "2900"
@@ -0,0 +1,39 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef _POLLER_H_
+#define _POLLER_H_
+// Here are only the function private to BlueLib library.
+// The rest is public and is defined in bluelib.h
+#include "bluelib.h"
+
+struct poller *poller_new(void);
+// Forget the reads registered, when the context is freed.
+void poller_free(struct poller *poller);
+
+// The reads registered with bl_poll_add are scheduled by the event loop
+// while connected: on connection and disconnection, with the bluelib mutex
+// held.
+void poller_start(bl_ctx_t *ctx);
+void poller_stop(bl_ctx_t *ctx);
+
+#endif
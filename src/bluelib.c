@@ -24,10 +24,16 @@
 #include <glib.h>
 #include <errno.h>
 #include <malloc.h>
+#include <string.h>
 
 #include "bluelib.h"
 #include "callback.h"
 #include "conn_state.h"
+#include "ctx.h"
+#include "cache.h"
+#include "database.h"
+#include "gatt_def.h"
+#include "poller.h"
 
 #include "btio.h"
 #include "att.h"
@@ -38,45 +44,50 @@
 #define printf(...) printf("[BL] " __VA_ARGS__)
 
 /********************************* Context *********************************/
-// Variables also used by callbacks
-GAttrib       *attrib        = NULL;
-GIOChannel    *iochannel     = NULL;
-int            opt_mtu       = 0;
-
-static char   *opt_src       = NULL;
-static char   *opt_dst       = NULL;
-static char   *opt_dst_type  = NULL;
-static char   *opt_sec_level = NULL;
-static int     opt_psm       = 0;
-static char   *current_mac   = NULL;
-
-// Avoid two functions running at the same time
-static GMutex *bluelib_mutex = NULL;
-
-// User specific callback;
-user_cb_fct_t *connect_cb_fct = NULL;
+// Context used by the functions without ctx, set by bl_init.
+static bl_ctx_t *default_ctx = NULL;
 
 /********************************* Helpers *********************************/
-static void disconnect_io()
+// Release what is left of the connection, also after a failed connection:
+// closing the socket removes its connect watch.
+void disconnect_io(bl_ctx_t *ctx)
 {
-  if (STATE_DISCONNECTED == get_conn_state())
-    return;
+  if (ctx->hup_watch) {
+    g_source_destroy(ctx->hup_watch);
+    g_source_unref(ctx->hup_watch);
+    ctx->hup_watch = NULL;
+  }
 
-  g_attrib_unref(attrib);
-  attrib = NULL;
-  opt_mtu = 0;
+  g_attrib_unref(ctx->attrib);
+  ctx->attrib = NULL;
+  ctx->opt_mtu = 0;
 
-  g_io_channel_shutdown(iochannel, FALSE, NULL);
-  g_io_channel_unref(iochannel);
-  iochannel = NULL;
+  if (ctx->iochannel) {
+    g_io_channel_shutdown(ctx->iochannel, FALSE, NULL);
+    g_io_channel_unref(ctx->iochannel);
+    ctx->iochannel = NULL;
+  }
 
-  set_conn_state(STATE_DISCONNECTED);
+  set_conn_state(ctx, STATE_DISCONNECTED);
 }
 
 gboolean channel_watcher(GIOChannel *chan, GIOCondition cond,
     gpointer user_data)
 {
-  disconnect_io();
+  bl_ctx_t *ctx = user_data;
+
+  // Destroyed meanwhile, ctx->hup_watch may belong to a new connection
+  if (g_main_current_source() != ctx->hup_watch)
+    return FALSE;
+
+  // The watch is removed by returning FALSE
+  if (ctx->hup_watch) {
+    g_source_unref(ctx->hup_watch);
+    ctx->hup_watch = NULL;
+  }
+  // No answer will come: the requests in progress fail now, the
+  // asynchronous ones have no timeout
+  conn_abort(ctx);
   printf("Connection lost\n");
   return FALSE;
 }
@@ -85,6 +96,45 @@ GQuark bl_error_domain(void)
 {
   return g_quark_from_static_string("Bluelib error domain");
 }
+
+// Take the first attribute with this UUID out of list, NULL if none.
+static void *take_match(GSList *list, const char *uuid_str)
+{
+  bt_uuid_t uuid;
+  bt_uuid_t attr_uuid;
+
+  if (bt_string_to_uuid(&uuid, uuid_str))
+    return NULL;
+
+  for (GSList *l = list; l; l = l->next) {
+    // uuid_str comes first in all the structures
+    bl_desc_t *attr = l->data;
+
+    if (attr && !bt_string_to_uuid(&attr_uuid, attr->uuid_str) &&
+        !bt_uuid_cmp(&uuid, &attr_uuid)) {
+      l->data = NULL;
+      return attr;
+    }
+  }
+  return NULL;
+}
+
+// Page function of the lookups, user_data is the request. The first match
+// becomes its result and stops the discovery.
+static gboolean first_match_page(GSList *list, void *user_data)
+{
+  bl_req_t *req = user_data;
+
+  req->ret_pointer = take_match(list, req->uuid_str);
+  return req->ret_pointer == NULL;
+}
+
+static void first_match_req(bl_req_t *req, const char *uuid_str)
+{
+  strcpy(req->uuid_str, uuid_str);
+  req->page_func = first_match_page;
+  req->user_data = req;
+}
 #define PROPAGATE_ERROR           \
   do {                            \
     CLEAR_GERROR                  \
@@ -104,12 +154,10 @@ static inline int handle_assert(uint16_t *start_handle, uint16_t *end_handle,
   // Default range
   *start_handle = 0x0001;
   *end_handle   = 0xffff;
-  end_handle_cb = 0xffff;
 
   if (bl_primary != NULL) {
     *start_handle = bl_primary->start_handle;
     *end_handle   = bl_primary->end_handle;
-    end_handle_cb = bl_primary->end_handle;
   }
 
   if (start_handle > end_handle) {
@@ -130,42 +178,42 @@ static inline int handle_assert(uint16_t *start_handle, uint16_t *end_handle,
 }
 
 #define BLUELIB_ENTER                                   \
-  if (bluelib_mutex == NULL){                           \
+  if (ctx == NULL){                                     \
     return BL_NOT_INIT_ERROR;                           \
   }                                                     \
-g_mutex_lock(bluelib_mutex)
+g_mutex_lock(&ctx->mutex)
 
 #define BLUELIB_ENTER_GERR                              \
-  if (bluelib_mutex == NULL){                           \
+  if (ctx == NULL){                                     \
     GError *err = g_error_new(BL_ERROR_DOMAIN,          \
         BL_NOT_INIT_ERROR,                              \
         "Bluelib not initialised\n");                   \
     PROPAGATE_ERROR;                                    \
     return NULL;                                        \
   }                                                     \
-g_mutex_lock(bluelib_mutex)
+g_mutex_lock(&ctx->mutex)
 
 #define ASSERT_CONNECTED                                \
-  if (get_conn_state() != STATE_CONNECTED) {            \
+  if (ctx->conn_state != STATE_CONNECTED) {             \
     printf("Error: Not connected\n");                   \
     ret = BL_DISCONNECTED_ERROR;                        \
     goto exit;                                          \
   }                                                     \
-  if (!is_event_loop_running()) {                       \
+  if (!is_event_loop_running(ctx)) {                    \
     printf("Error: Not connected\n");                   \
     ret = BL_DISCONNECTED_ERROR;                        \
     goto exit;                                          \
   }
 
 #define ASSERT_CONNECTED_GERR                           \
-  if (get_conn_state() != STATE_CONNECTED) {            \
+  if (ctx->conn_state != STATE_CONNECTED) {             \
     GError *err = g_error_new(BL_ERROR_DOMAIN,          \
         BL_DISCONNECTED_ERROR,                          \
         "Not connected\n");                             \
     PROPAGATE_ERROR;                                    \
     goto exit;                                          \
   }                                                     \
-  if (!is_event_loop_running()) {                       \
+  if (!is_event_loop_running(ctx)) {                    \
     GError *err = g_error_new(BL_ERROR_DOMAIN,          \
         BL_DISCONNECTED_ERROR,                          \
         "Event loop not running\n");                    \
@@ -173,889 +221,3333 @@ g_mutex_lock(bluelib_mutex)
     goto exit;                                          \
   }
 
+#define NEW_REQ                                         \
+  req = req_new(ctx);                                   \
+  if (req == NULL) {                                    \
+    printf("Error: Malloc error\n");                    \
+    ret = BL_MALLOC_ERROR;                              \
+    goto exit;                                          \
+  }
+
+#define ASSERT_UUID_GERR                                \
+  if (uuid_str == NULL) {                               \
+    GError *err = g_error_new(BL_ERROR_DOMAIN,          \
+        BL_MISSING_ARGUMENT_ERROR,                      \
+        "UUID needed\n");                               \
+    PROPAGATE_ERROR;                                    \
+    goto exit;                                          \
+  }
+
+#define NEW_REQ_GERR                                    \
+  req = req_new(ctx);                                   \
+  if (req == NULL) {                                    \
+    GError *err = g_error_new(BL_ERROR_DOMAIN,          \
+        BL_MALLOC_ERROR,                                \
+        "Malloc error\n");                              \
+    PROPAGATE_ERROR;                                    \
+    goto exit;                                          \
+  }
+
 #define BLUELIB_EXIT                                    \
-  g_mutex_unlock(bluelib_mutex);                        \
+  g_mutex_unlock(&ctx->mutex);                          \
   return ret
 
+// Asynchronous calls return 0 on error and print it.
+#define BLUELIB_ENTER_ASYNC                             \
+  if (ctx == NULL){                                     \
+    printf("Error: Bluelib not initialised\n");         \
+    return 0;                                           \
+  }                                                     \
+  if (func == NULL){                                    \
+    printf("Error: Callback needed\n");                 \
+    return 0;                                           \
+  }                                                     \
+g_mutex_lock(&ctx->mutex)
 
-/***************************** Global functions ****************************/
+#define ASSERT_CONNECTED_ASYNC                          \
+  if ((ctx->conn_state != STATE_CONNECTED) ||           \
+      !is_event_loop_running(ctx)) {                    \
+    printf("Error: Not connected\n");                   \
+    goto exit;                                          \
+  }
 
-/********************** Initialisation of the context **********************/
-int bl_init(const char *src, const char *dst, const char *dst_type, int psm,
-  const int sec_level)
-{
-  opt_src = g_strdup(src);
-  opt_dst = g_strdup(dst);
-  opt_dst_type = g_strdup(dst_type);
-  opt_psm = psm;
+#define NEW_REQ_ASYNC(free_fct)                         \
+  req = req_new(ctx);                                   \
+  if (req == NULL) {                                    \
+    printf("Error: Malloc error\n");                    \
+    goto exit;                                          \
+  }                                                     \
+  req->id        = req_new_id();                        \
+  req->func      = func;                                \
+  req->user_data = user_data;                           \
+  req->ret_free  = (GDestroyNotify) (free_fct)
+
+#define ASSERT_PAGE_FUNC                                \
+  if (page_func == NULL) {                              \
+    printf("Error: Page callback needed\n");            \
+    goto exit;                                          \
+  }
 
-  if (opt_sec_level)
-    g_free(opt_sec_level);
-  if (sec_level == SECURITY_LEVEL_HIGH)
-    opt_sec_level = g_strdup("high");
-  else if (sec_level == SECURITY_LEVEL_MEDIUM)
-    opt_sec_level = g_strdup("medium");
-  else
-    opt_sec_level = g_strdup("low");
+#define BLUELIB_EXIT_ASYNC                              \
+  if (gerr) {                                           \
+    printf("Error: %s", gerr->message);                 \
+    g_error_free(gerr);                                 \
+  }                                                     \
+  req_unref(req);                                       \
+  g_mutex_unlock(&ctx->mutex);                          \
+  return ret
 
-  bluelib_mutex = malloc(sizeof(GMutex));
-  if (!bluelib_mutex)
-    return -1;
-  g_mutex_init(bluelib_mutex);
-  return BL_NO_ERROR;
-}
 
+/***************************** Request senders *****************************/
+// A sender owns the reference of the callback of the request and releases it
+// when the request can't be sent.
+// Return the id of the request on the GAttrib, 0 on error with gerr set.
+static guint send_error(bl_req_t *req, int code, const char *msg,
+    GError **gerr)
+{
+  GError *err = g_error_new(BL_ERROR_DOMAIN, code, "%s", msg);
+  PROPAGATE_ERROR;
+  req_drop(req);
+  return 0;
+}
 
-/******************** Connect/Disconnect from a device *********************/
-// Connect to a device
-int bl_connect(char *mac_dst, char *dst_type)
+guint send_primary(char *uuid_str, bl_req_t *req, GError **gerr)
 {
-  GError *gerr = NULL;
-  int ret;
+  if (uuid_str) {
+    bt_uuid_t uuid;
+    bt_string_to_uuid(&uuid, uuid_str);
+    // The callback adds the uuid to each bl_primary of the list
+    strcpy(req->uuid_str, uuid_str);
+    req->att_id = gatt_discover_primary(req->ctx->attrib, &uuid,
+        primary_by_uuid_cb, req);
+  } else
+    req->att_id = gatt_discover_primary(req->ctx->attrib, NULL, primary_all_cb,
+        req);
 
-  BLUELIB_ENTER;
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
 
-  if (get_conn_state() != STATE_DISCONNECTED) {
-    printf("Error: Already connected to a device\n");
-    ret = BL_ALREADY_CONNECTED_ERROR;
-    goto error;
+guint send_included(bl_primary_t *bl_primary, bl_req_t *req,
+    GError **gerr)
+{
+  uint16_t start_handle;
+  uint16_t end_handle;
+
+  if (handle_assert(&start_handle, &end_handle, bl_primary, gerr)) {
+    req_drop(req);
+    return 0;
   }
 
-  if (!mac_dst) {
-    printf("Error: Remote Bluetooth address required\n");
-    ret = EINVAL;
-    goto error;
+  req->att_id = gatt_find_included(req->ctx->attrib, start_handle, end_handle,
+      included_cb, req);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
+
+guint send_char(char *uuid_str, bl_primary_t *bl_primary,
+    bl_req_t *req, GError **gerr)
+{
+  uint16_t   start_handle;
+  uint16_t   end_handle;
+  bt_uuid_t  uuid;
+  bt_uuid_t *puuid = NULL;
+
+  if (handle_assert(&start_handle, &end_handle, bl_primary, gerr)) {
+    req_drop(req);
+    return 0;
   }
 
-  // Check if the address MAC is correct
-  int i;
-  for (i = 0; i < MAC_SZ; i++) {
-    if ((i%3 < 2) &&
-        (!(((mac_dst[i] >= '0') && (mac_dst[i] <= '9')) ||
-           ((mac_dst[i] >= 'a') && (mac_dst[i] <= 'f')) ||
-           ((mac_dst[i] >= 'A') && (mac_dst[i] <= 'F')))))
-      goto wrongmac;
-    else if ((i%3 == 2) && (mac_dst[i] != ':'))
-      goto wrongmac;
+  if (uuid_str) {
+    bt_string_to_uuid(&uuid, uuid_str);
+    puuid = &uuid;
   }
-  if (mac_dst[MAC_SZ] != '\0')
-    goto wrongmac;
 
-  g_free(opt_dst);
-  opt_dst = g_strdup(mac_dst);
+  req->att_id = gatt_discover_char(req->ctx->attrib, start_handle, end_handle,
+      puuid, char_by_uuid_cb, req);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
 
-  g_free(opt_dst_type);
-  if (dst_type)
-    opt_dst_type = g_strdup(dst_type);
-  else
-    opt_dst_type = g_strdup("public");
+guint send_desc_discovery(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
+    bl_primary_t *bl_primary, bl_req_t *req, GError **gerr)
+{
+  uint16_t start_handle;
+  uint16_t end_handle;
 
-  printf("Attempting to connect to %s\n", opt_dst);
-  set_conn_state(STATE_CONNECTING);
-  iochannel = gatt_connect(opt_src, opt_dst, opt_dst_type, opt_sec_level,
-                           opt_psm, opt_mtu, connect_cb, &gerr);
+  if (!start_bl_char)
+    return send_error(req, BL_MISSING_ARGUMENT_ERROR,
+        "Start characteristic needed\n", gerr);
+  start_handle = start_bl_char->handle + 1;
 
-  if (gerr) {
-    printf("Error <%d %s>\n", gerr->code, gerr->message);
-    set_conn_state(STATE_DISCONNECTED);
-    ret = gerr->code;
-    g_error_free(gerr);
-    goto error;
-  }
+  if (end_bl_char) {
+    end_handle = end_bl_char->handle - 1;
+  } else
+    end_handle = 0xffff;
 
-  if (!iochannel) {
-    printf("Error: iochannel NULL\n");
-    set_conn_state(STATE_DISCONNECTED);
-    ret = BL_SEND_REQUEST_ERROR;
-    goto error;
+  if (bl_primary) {
+    if (end_handle > bl_primary->end_handle)
+      end_handle = bl_primary->end_handle;
   }
 
-  g_io_add_watch(iochannel, G_IO_HUP, channel_watcher, NULL);
+  if (start_handle > end_handle)
+    return send_error(req, BL_HANDLE_ORDER_ERROR,
+        "The handle of end_bl_char before the one of start_bl_char\n", gerr);
 
-  if (start_event_loop(&gerr)) {
-    printf("Error: fail to start event loop\n");
-    set_conn_state(STATE_DISCONNECTED);
-    goto error;
-  }
+  return send_desc_range(start_handle, end_handle, req, gerr);
+}
 
-  ret = wait_for_cb(NULL, NULL);
-  if (ret) {
-    printf("Error: CallBack error\n");
-    set_conn_state(STATE_DISCONNECTED);
-    stop_event_loop();
-    goto error;
-  }
+guint send_desc_range(uint16_t start_handle, uint16_t end_handle,
+    bl_req_t *req, GError **gerr)
+{
+  // The callback asks for the next descriptors up to end_handle
+  req->end_handle = end_handle;
+  req->att_id = gatt_discover_char_desc(req->ctx->attrib, start_handle,
+      end_handle, char_desc_cb, req);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
 
-  current_mac = mac_dst;
-  ret = BL_NO_ERROR;
-  g_mutex_unlock(bluelib_mutex);
-  if (connect_cb_fct)
-    return connect_cb_fct();
-  return ret;
+guint send_primary_stream(bl_req_t *req, GError **gerr)
+{
+  size_t     buflen;
+  uint8_t   *buf = g_attrib_get_buffer(req->ctx->attrib, &buflen);
+  bt_uuid_t  prim;
+  guint16    plen;
+
+  bt_uuid16_create(&prim, GATT_PRIM_SVC_UUID);
+  plen = enc_read_by_grp_req(0x0001, 0xffff, &prim, buf, buflen);
+  req->att_id = g_attrib_send(req->ctx->attrib, 0, buf, plen,
+      primary_stream_cb, req, NULL);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
 
-wrongmac:
-  printf("Error: Address MAC invalid\n");
-  ret = EINVAL;
-error:
-  BLUELIB_EXIT;
+guint send_char_stream(bl_primary_t *bl_primary, bl_req_t *req,
+    GError **gerr)
+{
+  uint16_t   start_handle;
+  size_t     buflen;
+  uint8_t   *buf;
+  bt_uuid_t  charac;
+  guint16    plen;
+
+  if (handle_assert(&start_handle, &req->end_handle, bl_primary, gerr)) {
+    req_drop(req);
+    return 0;
+  }
+
+  // The callback asks for the next characteristics up to end_handle
+  buf = g_attrib_get_buffer(req->ctx->attrib, &buflen);
+  bt_uuid16_create(&charac, GATT_CHARAC_UUID);
+  plen = enc_read_by_type_req(start_handle, req->end_handle, &charac, buf,
+      buflen);
+  req->att_id = g_attrib_send(req->ctx->attrib, 0, buf, plen, char_stream_cb,
+      req, NULL);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
 }
 
-// Disconnect from the device, delete the nofication list.
-int bl_disconnect(void)
+guint send_read_by_hnd(uint16_t handle, char *uuid_str,
+    size_t size_hint, bl_req_t *req, GError **gerr)
 {
-  int ret = BL_NO_ERROR;
-  BLUELIB_ENTER;
+  if (handle == INVALID_HANDLE)
+    return send_error(req, EINVAL, "Invalid handle\n", gerr);
+
+  req->handle = handle;
+  if (uuid_str)
+    strcpy(req->uuid_str, uuid_str);
+
+  req->att_id = gatt_read_char_sized(req->ctx->attrib, handle,
+      MIN(size_hint, G_MAXUINT16), read_by_hnd_cb, req);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
 
-  if (get_conn_state() != STATE_DISCONNECTED)
-    disconnect_io();
-  printf("Disconnected\n");
-  if (is_event_loop_running())
-    stop_event_loop();
-  BLUELIB_EXIT;
+// The parts of the value are given to req->chunk_func as they arrive.
+static guint send_read_stream(uint16_t handle, bl_req_t *req, GError **gerr)
+{
+  if (handle == INVALID_HANDLE)
+    return send_error(req, EINVAL, "Invalid handle\n", gerr);
+
+  req->att_id = gatt_read_char_stream(req->ctx->attrib, handle, read_chunk_cb,
+      read_stream_cb, req);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
 }
 
-// Set a function to call each time you succeed to connect
-// If the connection go well, the return value of bl_connect will be the one
-// of user_cb_fct_t.
-int bl_set_connect_cb(user_cb_fct_t func)
+// Read, or Read Blob past the start, of the part of the value at offset. The
+// callback copies it straight from the response PDU into req->buf, truncated
+// to req->buf_size.
+static guint send_read_blob(uint16_t handle, uint16_t offset, bl_req_t *req,
+    GError **gerr)
 {
-  connect_cb_fct = func;
-  return BL_NO_ERROR;
+  size_t   buflen;
+  uint8_t *buf = g_attrib_get_buffer(req->ctx->attrib, &buflen);
+  guint16  plen;
+
+  if (handle == INVALID_HANDLE)
+    return send_error(req, EINVAL, "Invalid handle\n", gerr);
+
+  if (offset)
+    plen = enc_read_blob_req(handle, offset, buf, buflen);
+  else
+    plen = enc_read_req(handle, buf, buflen);
+  req->att_id = g_attrib_send(req->ctx->attrib, 0, buf, plen, read_into_cb,
+      req, NULL);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
 }
 
+guint send_read_multi(uint16_t *handles, int n, bl_req_t *req,
+    GError **gerr)
+{
+  size_t   buflen;
+  uint8_t *buf  = g_attrib_get_buffer(req->ctx->attrib, &buflen);
+  guint16  plen = enc_read_multi_var_req(handles, MIN(n, READ_MULTI_MAX),
+      buf, buflen);
+
+  if (plen == 0)
+    return send_error(req, EINVAL, "Two handles needed\n", gerr);
+
+  req->handles   = handles;
+  req->n_handles = (plen - 1) / 2;
+  req->att_id = g_attrib_send(req->ctx->attrib, 0, buf, plen, read_multi_cb,
+      req, NULL);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
 
-/************************* Primary Service Discovery ***********************/
-// Get all the primary service associated of an UUID.
-// Return a list of primary services (bl_primary_t *).
-GSList *bl_get_all_primary(char *uuid_str, GError **gerr)
+static guint send_read_by_uuid(char *uuid_str, bl_primary_t *bl_primary,
+    bl_req_t *req, GError **gerr)
 {
-  GSList *ret = NULL;
+  uint16_t  start_handle;
+  uint16_t  end_handle;
+  bt_uuid_t uuid;
 
-  CLEAR_GERROR;
-  BLUELIB_ENTER_GERR;
-  ASSERT_CONNECTED_GERR;
+  if (uuid_str == NULL)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "UUID needed\n", gerr);
 
-  if (uuid_str) {
-    bt_uuid_t uuid;
-    bt_string_to_uuid(&uuid, uuid_str);
-    if (!gatt_discover_primary(attrib, &uuid, primary_by_uuid_cb, NULL)) {
-      GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "Unable to send request\n");
-      PROPAGATE_ERROR;
-      goto exit;
-    }
-  } else if (!gatt_discover_primary(attrib, NULL, primary_all_cb, NULL)) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "Unable to send request\n");
-    PROPAGATE_ERROR;
-    goto exit;
+  if (handle_assert(&start_handle, &end_handle, bl_primary, gerr)) {
+    req_drop(req);
+    return 0;
   }
 
-  if (wait_for_cb((void **) &ret, gerr))
-    goto exit;
-  if ((ret != NULL) && (uuid_str)) {
-    // Add uuid to each bl_primary of the list
-    for (GSList *l = ret; l; l = l->next)
-      strcpy(((bl_primary_t *)(l->data))->uuid_str, uuid_str);
-  }
-exit:
-  BLUELIB_EXIT;
+  bt_string_to_uuid(&uuid, uuid_str);
+  // The callback adds the uuid to each of the values, and asks for the next
+  // ones up to end_handle
+  strcpy(req->uuid_str, uuid_str);
+  req->end_handle = end_handle;
+
+  req->att_id = gatt_read_char_by_uuid(req->ctx->attrib, start_handle,
+      end_handle, &uuid, read_by_uuid_cb, req);
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
 }
 
-// Get a specific primary service.
-// Return the primary service associated to this UUID, if unique.
-bl_primary_t *bl_get_primary(char *uuid_str, GError **gerr)
+guint send_write(uint16_t handle, uint8_t *value, size_t size, int type,
+    bl_req_t *req, GError **gerr)
 {
-  CLEAR_GERROR;
-  bl_primary_t *bl_primary      = NULL;
-  GSList       *bl_primary_list = bl_get_all_primary(uuid_str, gerr);
+  if (handle == INVALID_HANDLE)
+    return send_error(req, EINVAL, "Invalid handle\n", gerr);
 
-  if (*gerr || !bl_primary_list)
-    return NULL;
+  if ((size == 0) || (value == NULL))
+    return send_error(req, EINVAL, "Invalid value\n", gerr);
 
-  if (bl_primary_list->next) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_UNICITY_ERROR,
-        "Primary not unique\n");
-    PROPAGATE_ERROR;
-    bl_primary_list_free(bl_primary_list);
-    return NULL;
+  if (type)
+    req->att_id = gatt_write_char(req->ctx->attrib, handle, value, size,
+        write_req_cb, req);
+  else
+    req->att_id = gatt_write_cmd(req->ctx->attrib, handle, value, size,
+        write_cmd_cb, req);
+
+  if (!req->att_id)
+    return send_error(req, BL_SEND_REQUEST_ERROR, "Unable to send request\n",
+        gerr);
+  return req->att_id;
+}
+
+int bluelib_lock(bl_ctx_t *ctx)
+{
+  if (ctx == NULL)
+    return BL_NOT_INIT_ERROR;
+
+  g_mutex_lock(&ctx->mutex);
+  if ((ctx->conn_state != STATE_CONNECTED) || !is_event_loop_running(ctx)) {
+    g_mutex_unlock(&ctx->mutex);
+    return BL_DISCONNECTED_ERROR;
   }
+  return BL_NO_ERROR;
+}
 
-  if (bl_primary_list->data)
-    bl_primary = bl_primary_cpy(bl_primary_list->data);
-  bl_primary_list_free(bl_primary_list);
-  return bl_primary;
+void bluelib_unlock(bl_ctx_t *ctx)
+{
+  g_mutex_unlock(&ctx->mutex);
 }
 
-// Get all the primary services of a device.
-// Return a list of primary services (bl_primary_t *).
-GSList *bl_get_all_primary_device(GError **gerr)
+
+/***************************** Global functions ****************************/
+
+/********************** Initialisation of the context **********************/
+static void set_options(bl_ctx_t *ctx, const char *src, const char *dst,
+    const char *dst_type, int psm, const int sec_level)
 {
-  return bl_get_all_primary(NULL, gerr);
+  g_free(ctx->opt_src);
+  g_free(ctx->opt_dst);
+  g_free(ctx->opt_dst_type);
+  ctx->opt_src = g_strdup(src);
+  ctx->opt_dst = g_strdup(dst);
+  ctx->opt_dst_type = g_strdup(dst_type);
+  ctx->opt_psm = psm;
+
+  if (ctx->opt_sec_level)
+    g_free(ctx->opt_sec_level);
+  if (sec_level == SECURITY_LEVEL_HIGH)
+    ctx->opt_sec_level = g_strdup("high");
+  else if (sec_level == SECURITY_LEVEL_MEDIUM)
+    ctx->opt_sec_level = g_strdup("medium");
+  else
+    ctx->opt_sec_level = g_strdup("low");
 }
 
+// Create a context for one connection.
+bl_ctx_t *bl_ctx_new(const char *src, const char *dst, const char *dst_type,
+    int psm, const int sec_level)
+{
+  bl_ctx_t *ctx = g_try_new0(bl_ctx_t, 1);
 
-/************************** Get Included Services **************************/
-// Get all the included service of a primary service.
-// Returns a list of included services (bl_included_t *).
-GSList *bl_get_included(bl_primary_t *bl_primary, GError **gerr)
+  if (ctx == NULL)
+    return NULL;
+
+  ctx->conn_state = STATE_DISCONNECTED;
+  g_mutex_init(&ctx->mutex);
+  g_mutex_init(&ctx->pending_mutex);
+  g_mutex_init(&ctx->changed_mutex);
+  ctx->poller = poller_new();
+  set_options(ctx, src, dst, dst_type, psm, sec_level);
+  return ctx;
+}
+
+// Disconnect and free a context.
+void bl_ctx_free(bl_ctx_t *ctx)
 {
-  GSList *ret = NULL;
+  if (ctx == NULL)
+    return;
 
-  CLEAR_GERROR;
-  BLUELIB_ENTER_GERR;
-  ASSERT_CONNECTED_GERR;
+  bl_ctx_disconnect(ctx);
+  if (ctx == default_ctx)
+    default_ctx = NULL;
+
+  g_free(ctx->opt_src);
+  g_free(ctx->opt_dst);
+  g_free(ctx->opt_dst_type);
+  g_free(ctx->opt_sec_level);
+  g_free(ctx->current_mac);
+  g_free(ctx->cache_dir);
+  g_free(ctx->layout_key);
+  g_strfreev(ctx->layout_key_uuids);
+  poller_free(ctx->poller);
+  free_poll_set(ctx);
+  if (ctx->main_context)
+    g_main_context_unref(ctx->main_context);
+  g_mutex_clear(&ctx->mutex);
+  g_mutex_clear(&ctx->pending_mutex);
+  g_mutex_clear(&ctx->changed_mutex);
+  g_free(ctx);
+}
 
-  // Initialisation to default range.
-  uint16_t start_handle = 0x0001;
-  uint16_t end_handle   = 0xffff;
+int bl_ctx_set_main_context(bl_ctx_t *ctx, GMainContext *context)
+{
+  int ret = BL_NO_ERROR;
+  BLUELIB_ENTER;
 
-  if (handle_assert(&start_handle, &end_handle, bl_primary, gerr))
+  if (ctx->conn_state != STATE_DISCONNECTED) {
+    printf("Error: Already connected to a device\n");
+    ret = BL_ALREADY_CONNECTED_ERROR;
     goto exit;
-
-  if (!gatt_find_included(attrib, start_handle, end_handle, included_cb,
-        NULL)) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "Unable to send request\n");
-    PROPAGATE_ERROR;
+  }
+  if (ctx->poll_set) {
+    printf("Error: Main context polled from bl_get_fd\n");
+    ret = EBUSY;
     goto exit;
   }
+  if (context)
+    g_main_context_ref(context);
+  if (ctx->main_context)
+    g_main_context_unref(ctx->main_context);
+  ctx->main_context = context;
 
-  wait_for_cb((void **) &ret, gerr);
 exit:
   BLUELIB_EXIT;
 }
 
-
-/*************************** Get characteristics ***************************/
-// Get all characteristics associated to an UUID on a primary service.
-// Returns a list of characteristics (bl_char_t *) associated to the UUID
-GSList *bl_get_all_char(char *uuid_str, bl_primary_t *bl_primary,
-    GError **gerr)
+int bl_ctx_set_inline(bl_ctx_t *ctx, int busy_poll_us)
 {
-  GSList *ret = NULL;
+  GMainContext *context = (busy_poll_us >= 0) ? g_main_context_new() : NULL;
+  int           ret     = bl_ctx_set_main_context(ctx, context);
+
+  if (context)
+    g_main_context_unref(context);
+  if (ret == BL_NO_ERROR) {
+    g_mutex_lock(&ctx->mutex);
+    ctx->busy_poll_us = MAX(busy_poll_us, 0);
+    g_mutex_unlock(&ctx->mutex);
+  }
+  return ret;
+}
 
-  CLEAR_GERROR;
-  BLUELIB_ENTER_GERR;
-  ASSERT_CONNECTED_GERR;
+int bl_init(const char *src, const char *dst, const char *dst_type, int psm,
+  const int sec_level)
+{
+  if (default_ctx) {
+    g_mutex_lock(&default_ctx->mutex);
+    set_options(default_ctx, src, dst, dst_type, psm, sec_level);
+    g_mutex_unlock(&default_ctx->mutex);
+    return BL_NO_ERROR;
+  }
 
-  // Intialisation to default range.
-  uint16_t start_handle;
-  uint16_t end_handle;
+  default_ctx = bl_ctx_new(src, dst, dst_type, psm, sec_level);
+  if (!default_ctx)
+    return -1;
+  return BL_NO_ERROR;
+}
 
-  if (handle_assert(&start_handle, &end_handle, bl_primary, gerr))
-    goto exit;
+bl_ctx_t *bl_get_default_ctx(void)
+{
+  return default_ctx;
+}
 
-  bt_uuid_t *puuid = NULL;
 
-  if (uuid_str) {
-    bt_uuid_t uuid;
-    bt_string_to_uuid(&uuid, uuid_str);
-    puuid = &uuid;
+/************************* GATT database cache *****************************/
+// The requests below are made with the bluelib mutex held, by functions
+// already connected.
+
+// Count the lookups answered by the cache.
+static gboolean cache_hit(bl_ctx_t *ctx, gboolean hit)
+{
+  if (hit)
+    ctx->cache_stats.hits++;
+  else
+    ctx->cache_stats.misses++;
+  return hit;
+}
+
+// Synchronous request sent by the expression send, using req. Its result is
+// put in list and gerr is set on error.
+#define CACHE_REQUEST(send, list)                       \
+  do {                                                  \
+    bl_req_t *req = req_new(ctx);                       \
+    if (req == NULL) {                                  \
+      ret = BL_MALLOC_ERROR;                            \
+      goto exit;                                        \
+    }                                                   \
+    if (send)                                           \
+      wait_for_cb(req, (void **) &(list), &gerr);       \
+    req_unref(req);                                     \
+  } while (0)
+
+// Read the Database Hash characteristic, BL_NO_ERROR if the device has one.
+static int read_db_hash(bl_ctx_t *ctx, uint8_t *hash)
+{
+  GError *gerr = NULL;
+  GSList *list = NULL;
+  int     ret  = BL_REQUEST_FAIL_ERROR;
+
+  CACHE_REQUEST(send_read_by_uuid(GATT_CHARAC_DATABASE_HASH_STR, NULL, req,
+        &gerr), list);
+  if (gerr) {
+    ret = gerr->code;
+    g_error_free(gerr);
+  } else if (list && (((bl_value_t *) list->data)->data_size == 16)) {
+    memcpy(hash, ((bl_value_t *) list->data)->data, 16);
+    ret = BL_NO_ERROR;
   }
+exit:
+  bl_value_list_free(list);
+  return ret;
+}
 
-  if (!gatt_discover_char(attrib, start_handle, end_handle, puuid,
-        char_by_uuid_cb, NULL)) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "Unable to send request\n");
-    PROPAGATE_ERROR;
-    goto exit;
+// Identifier of the layout of the connected device, from its Database Hash
+// or else from the values of the key characteristics. The values read are
+// returned to check their handles against the layout.
+static int read_layout_key(bl_ctx_t *ctx, char **key, GSList **bl_value_list)
+{
+  GSList  *values = NULL;
+  GSList  *list   = NULL;
+  GError  *gerr   = NULL;
+  GString *text;
+  gboolean hashed;
+  int      ret    = BL_REQUEST_FAIL_ERROR;
+
+  CACHE_REQUEST(send_read_by_uuid(GATT_CHARAC_DATABASE_HASH_STR, NULL, req,
+        &gerr), list);
+  if (!gerr && list && (((bl_value_t *) list->data)->data_size == 16))
+    values = list;
+  else
+    bl_value_list_free(list);
+  list   = NULL;
+  hashed = (values != NULL);
+  g_clear_error(&gerr);
+
+  for (int i = 0; !hashed && ctx->layout_key_uuids &&
+      ctx->layout_key_uuids[i]; i++) {
+    CACHE_REQUEST(send_read_by_uuid(ctx->layout_key_uuids[i], NULL, req,
+          &gerr), list);
+    if (gerr || (list == NULL))
+      goto exit;
+    // Only the first characteristic with this UUID
+    bl_value_list_free(list->next);
+    list->next = NULL;
+    values     = g_slist_concat(values, list);
+    list       = NULL;
   }
+  if (values == NULL)
+    goto exit;
 
-  wait_for_cb((void **) &ret, gerr);
+  text = g_string_new(NULL);
+  for (GSList *l = values; l; l = l->next) {
+    bl_value_t *bl_value = l->data;
+
+    g_string_append_printf(text, "%s=", bl_value->uuid_str);
+    for (size_t i = 0; i < bl_value->data_size; i++)
+      g_string_append_printf(text, "%02x", bl_value->data[i]);
+    g_string_append_c(text, ';');
+  }
+  // Usable as a file name
+  *key = g_compute_checksum_for_string(G_CHECKSUM_SHA256, text->str,
+      text->len);
+  g_string_free(text, TRUE);
+  *bl_value_list = values;
+  values         = NULL;
+  ret            = BL_NO_ERROR;
 exit:
-  BLUELIB_EXIT;
+  g_clear_error(&gerr);
+  bl_value_list_free(list);
+  bl_value_list_free(values);
+  return ret;
 }
 
-// Get a specific characteristic associated to an UUID on a primary service.
-// Returns the characteristic associated to this uuid, if unique.
-bl_char_t *bl_get_char(char *uuid_str, bl_primary_t *bl_primary,
-    GError **gerr)
+// Learn the handle of the Service Changed characteristic, watched by the
+// event loop. The one found on connection is kept if the cache doesn't have
+// it yet.
+static void watch_service_changed(bl_ctx_t *ctx)
 {
-  CLEAR_GERROR;
-  bl_char_t *bl_char      = NULL;
-  GSList    *bl_char_list = bl_get_all_char(uuid_str, bl_primary, gerr);
+  uint16_t handle = cache_find_value_handle(ctx->cache,
+      GATT_CHARAC_SERVICE_CHANGED_STR);
 
-  if ((!bl_char_list) || (*gerr)) {
-    return NULL;
-  }
+  if (handle != INVALID_HANDLE)
+    g_atomic_int_set(&ctx->service_changed_handle, handle);
+}
 
-  if (bl_char_list->next != NULL) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_UNICITY_ERROR,
-        "Characteristic not unique\n");
-    PROPAGATE_ERROR;
-    bl_char_list_free(bl_char_list);
-    return NULL;
-  }
-  if (bl_char_list->data);
-    bl_char = bl_char_cpy(bl_char_list->data);
-  bl_char_list_free(bl_char_list);
-  return bl_char;
+// Enabling of the Service Changed indications, run by the event loop: each
+// step is sent by the callback of the previous one, bl_connect doesn't wait.
+typedef struct {
+  bl_ctx_t     *ctx;
+  bl_primary_t *bl_primary;   // GATT service
+  bl_char_t    *bl_char;      // Service Changed
+  uint16_t      cccd_handle;
+} sc_enable_t;
+
+static void sc_enable_next(sc_enable_t *sc);
+
+static void sc_enable_end(sc_enable_t *sc, int status)
+{
+  if (status)
+    printf("Service Changed not enabled: %d\n", status);
+  bl_primary_free(sc->bl_primary);
+  bl_char_free(sc->bl_char);
+  g_free(sc);
 }
 
-// Get all characteristics on a primary service.
-// Returns a list of characteristics (bl_char_t *).
-GSList *bl_get_all_char_in_primary(bl_primary_t *bl_primary, GError **gerr)
+static void sc_primary_cb(int status, void *result, void *user_data)
 {
-  CLEAR_GERROR;
-  return bl_get_all_char(NULL, bl_primary, gerr);
+  sc_enable_t *sc = user_data;
+
+  if (status == BL_NO_ERROR) {
+    sc->bl_primary = take_match(result, GATT_SVC_GENERIC_ATTRIBUTE_STR);
+    if (sc->bl_primary == NULL)
+      status = BL_REQUEST_FAIL_ERROR;
+  }
+  bl_primary_list_free(result);
+  if (status)
+    sc_enable_end(sc, status);
+  else
+    sc_enable_next(sc);
 }
 
+static void sc_char_cb(int status, void *result, void *user_data)
+{
+  sc_enable_t *sc = user_data;
 
-/****************************** Get Descriptors ****************************/
-// Get all the descriptors of a specified characteristic on a primary
-// service.
-// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
-// to search, but the result is the same with or without.
-// Returns a list of characteristic descriptor (bl_desc_t *).
-GSList *bl_get_all_desc_by_char(bl_char_t *start_bl_char,
-    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GError **gerr)
+  if (status == BL_NO_ERROR) {
+    sc->bl_char = take_match(result, GATT_CHARAC_SERVICE_CHANGED_STR);
+    if (sc->bl_char == NULL)
+      status = BL_REQUEST_FAIL_ERROR;
+    else
+      g_atomic_int_set(&sc->ctx->service_changed_handle,
+          sc->bl_char->value_handle);
+  }
+  bl_char_list_free(result);
+  if (status)
+    sc_enable_end(sc, status);
+  else
+    sc_enable_next(sc);
+}
+
+static void sc_desc_cb(int status, void *result, void *user_data)
 {
-  GSList   *ret = NULL;
-  uint16_t  start_handle;
-  uint16_t  end_handle;
+  sc_enable_t *sc   = user_data;
+  bl_desc_t   *cccd = NULL;
 
-  CLEAR_GERROR;
-  BLUELIB_ENTER_GERR;
-  ASSERT_CONNECTED_GERR;
+  if (status == BL_NO_ERROR) {
+    cccd = take_match(result, GATT_CLIENT_CHARAC_CFG_UUID_STR);
+    if (cccd == NULL)
+      status = BL_REQUEST_FAIL_ERROR;
+    else
+      sc->cccd_handle = cccd->handle;
+  }
+  bl_desc_free(cccd);
+  bl_desc_list_free(result);
+  if (status)
+    sc_enable_end(sc, status);
+  else
+    sc_enable_next(sc);
+}
+
+static void sc_written_cb(int status, void *result, void *user_data)
+{
+  sc_enable_end(user_data, status);
+}
 
-  if (start_bl_char) {
-    start_handle = start_bl_char->handle + 1;
+// Send the request for the first thing still unknown, the write of the
+// configuration at last. With the bluelib mutex, or from the event loop.
+static void sc_enable_next(sc_enable_t *sc)
+{
+  bl_ctx_t *ctx  = sc->ctx;
+  GError   *gerr = NULL;
+  bl_req_t *req;
+  uint8_t   value[2];
+  guint     sent;
+  int       status;
+
+  if ((ctx->conn_state != STATE_CONNECTED) || (ctx->attrib == NULL)) {
+    sc_enable_end(sc, BL_DISCONNECTED_ERROR);
+    return;
+  }
+  req = req_new(ctx);
+  if (req == NULL) {
+    sc_enable_end(sc, BL_MALLOC_ERROR);
+    return;
+  }
+  req->user_data = sc;
+  req->ret_free  = (GDestroyNotify) list_free;
+
+  if (sc->bl_primary == NULL) {
+    // Find By Type Value
+    req->func = sc_primary_cb;
+    sent = send_primary(GATT_SVC_GENERIC_ATTRIBUTE_STR, req, &gerr);
+  } else if (sc->bl_char == NULL) {
+    // Read By Type over the GATT service
+    req->func = sc_char_cb;
+    sent = send_char(GATT_CHARAC_SERVICE_CHANGED_STR, sc->bl_primary, req,
+        &gerr);
+  } else if (sc->cccd_handle == INVALID_HANDLE) {
+    req->func = sc_desc_cb;
+    sent = send_desc_range(sc->bl_char->value_handle + 1,
+        sc->bl_primary->end_handle, req, &gerr);
   } else {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
-        "Start characteristic needed\n");
-    PROPAGATE_ERROR;
-    goto exit;
+    req->func     = sc_written_cb;
+    req->ret_free = NULL;
+    att_put_u16(GATT_CLIENT_CHARAC_CFG_IND_BIT, value);
+    sent = send_write(sc->cccd_handle, value, sizeof(value), WRITE_REQ, req,
+        &gerr);
   }
+  req_unref(req);
+  if (sent)
+    return;
 
-  if (end_bl_char) {
-    end_handle = end_bl_char->handle - 1;
-  } else
-    end_handle = 0xffff;
+  status = gerr->code;
+  g_error_free(gerr);
+  sc_enable_end(sc, status);
+}
 
-  if (bl_primary) {
-    if (end_handle > bl_primary->end_handle)
-      end_handle = bl_primary->end_handle;
+// Enable the Service Changed indications: the changes of the database are
+// followed without the user subscribing. What the cache knows is not asked
+// again, the CCCD is still written as a client not bonded loses it on each
+// connection. A device the cache knows without Service Changed costs no
+// request. The rest is sent by the event loop, bl_connect doesn't wait.
+static void enable_service_changed(bl_ctx_t *ctx)
+{
+  sc_enable_t *sc   = g_new0(sc_enable_t, 1);
+  GSList      *list = NULL;
+  bl_desc_t   *cccd;
+
+  sc->ctx = ctx;
+  if (cache_get_primary(ctx->cache, GATT_SVC_GENERIC_ATTRIBUTE_STR, &list)) {
+    sc->bl_primary = take_match(list, GATT_SVC_GENERIC_ATTRIBUTE_STR);
+    bl_primary_list_free(list);
+    list = NULL;
+    if (sc->bl_primary == NULL)
+      goto absent;
   }
-
-  if (start_handle > end_handle) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_HANDLE_ORDER_ERROR,
-        "The handle of end_bl_char before the one of start_bl_char\n");
-    PROPAGATE_ERROR;
-    goto exit;
+  if (sc->bl_primary && cache_get_char(ctx->cache,
+        GATT_CHARAC_SERVICE_CHANGED_STR, sc->bl_primary, &list)) {
+    sc->bl_char = take_match(list, GATT_CHARAC_SERVICE_CHANGED_STR);
+    bl_char_list_free(list);
+    list = NULL;
+    if (sc->bl_char == NULL)
+      goto absent;
+    g_atomic_int_set(&ctx->service_changed_handle,
+        sc->bl_char->value_handle);
   }
-  if (!gatt_discover_char_desc(attrib, start_handle, end_handle,
-        char_desc_cb, NULL)) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "Unable to send request\n");
-    PROPAGATE_ERROR;
-    goto exit;
+  if (sc->bl_char && cache_get_desc(ctx->cache, sc->bl_char, NULL,
+        sc->bl_primary, &list)) {
+    cccd = take_match(list, GATT_CLIENT_CHARAC_CFG_UUID_STR);
+    bl_desc_list_free(list);
+    if (cccd == NULL)
+      goto absent;
+    sc->cccd_handle = cccd->handle;
+    bl_desc_free(cccd);
   }
-  wait_for_cb((void **) &ret, gerr);
-exit:
-  BLUELIB_EXIT;
+  sc_enable_next(sc);
+  return;
+
+absent:
+  sc_enable_end(sc, BL_NO_ERROR);
 }
 
-// Get all the descriptors of the unique characteristic associated to the
-// UUID on a primary service.
-// Returns a list of characteristic descriptor (bl_desc_t *).
-GSList *bl_get_all_desc(char *uuid_str, bl_primary_t *bl_primary,
-    GError **gerr)
+// Database of the devices with the same layout as the connected one. The
+// handles of the characteristics read for the identifier must match.
+static gatt_cache_t *find_layout(bl_ctx_t *ctx)
 {
-  bl_char_t *bl_char = bl_get_char(uuid_str, bl_primary, gerr);
+  GSList       *bl_value_list = NULL;
+  gatt_cache_t *cache         = NULL;
 
-  if ((!bl_char) || (*gerr))
+  if (read_layout_key(ctx, &ctx->layout_key, &bl_value_list))
     return NULL;
 
-  GSList *ret = bl_get_all_desc_by_char(bl_char, NULL, bl_primary, gerr);
-  bl_char_free(bl_char);
-  return ret;
+  cache = cache_layout_get(ctx->layout_key, ctx->cache_dir);
+  for (GSList *l = bl_value_list; cache && l; l = l->next) {
+    bl_value_t *bl_value = l->data;
+
+    if (cache_find_value_handle(cache, bl_value->uuid_str) !=
+        bl_value->handle) {
+      printf("Layout of %s doesn't match\n", ctx->current_mac);
+      cache_free(cache);
+      cache = NULL;
+    }
+  }
+  if (cache)
+    printf("Database of %s shared with its layout\n", ctx->current_mac);
+  bl_value_list_free(bl_value_list);
+  return cache;
 }
 
-// BlueZ returns UUID with letter in lowcase.
-static void lowcase_str(char *dst, char *src)
+// Discover the whole database of the device, it replaces the cache and is
+// saved if the caches are kept on disk.
+static int build_cache(bl_ctx_t *ctx, GError **gerr)
 {
-  for (int i = 0; ;i++) {
+  gatt_cache_t *cache = cache_new();
+  GError       *err   = NULL;
+  GSList       *list  = NULL;
+  uint8_t       hash[16];
+  int           ret;
+
+  printf("Discovering the database of %s\n", ctx->current_mac);
+  ret = database_discover(ctx, cache, gerr);
+  if (ret) {
+    cache_free(cache);
+    return ret;
+  }
 
-    if (('A' <= src[i]) && (src[i] <= 'F'))
-      dst[i] = src[i] + 0x20;
-    else
-      dst[i] = src[i];
-  if (!src[i])
-      break;
+  cache_free(ctx->cache);
+  ctx->cache = cache;
+  watch_service_changed(ctx);
+  if (ctx->share_layout && (ctx->layout_key ||
+        !read_layout_key(ctx, &ctx->layout_key, &list))) {
+    bl_value_list_free(list);
+    cache_layout_put(ctx->layout_key, cache, ctx->cache_dir);
+  }
+  if (ctx->cache_dir == NULL)
+    return BL_NO_ERROR;
+
+  cache_set_hash(cache, read_db_hash(ctx, hash) ? NULL : hash);
+  // Still used for this connection if it can't be saved
+  if (cache_save(cache, ctx->cache_dir, ctx->current_mac, &err)) {
+    printf("Error: Cache not saved: %s", err ? err->message : "\n");
+    g_clear_error(&err);
   }
+  return BL_NO_ERROR;
 }
 
-// Find a specific descriptor by UUID, on a list of bl_desc_t *.
-static bl_desc_t *find_desc(GSList *bl_desc_list, char *desc_uuid_str)
+// Load the cache of the device just connected. It is only kept if the
+// Database Hash of the device didn't change, or if it has no hash.
+// Otherwise the cache starts empty.
+static void load_cache(bl_ctx_t *ctx)
 {
-  // The uuid generated by the callback are in lowcase
-  // Translate upcase letters in lowcase
-  bl_desc_t *bl_desc = NULL;
+  uint8_t hash[16];
+  uint8_t cached_hash[16];
+
+  cache_free(ctx->cache);
+  ctx->cache        = NULL;
+  ctx->cache_failed = FALSE;
+  g_atomic_int_set(&ctx->service_changed_handle, INVALID_HANDLE);
+  database_drop_changes(ctx);
+
+  if (ctx->cache_dir)
+    ctx->cache = cache_load(ctx->cache_dir, ctx->current_mac);
+  if (ctx->cache && cache_get_hash(ctx->cache, cached_hash) &&
+      (read_db_hash(ctx, hash) || memcmp(hash, cached_hash, 16))) {
+    printf("Database of %s changed\n", ctx->current_mac);
+    cache_free(ctx->cache);
+    ctx->cache = NULL;
+    cache_remove(ctx->cache_dir, ctx->current_mac);
+  }
 
-  char desc_uuid_tmp[MAX_LEN_UUID_STR];
-  lowcase_str(desc_uuid_tmp, desc_uuid_str);
+  g_free(ctx->layout_key);
+  ctx->layout_key = NULL;
+  if ((ctx->cache == NULL) && ctx->share_layout)
+    ctx->cache = find_layout(ctx);
+  if (ctx->cache == NULL)
+    ctx->cache = cache_new();
+  watch_service_changed(ctx);
+}
 
-  for (GSList *l = bl_desc_list; l; l = l->next) {
-    if (l->data) {
+// Before a lookup: the ranges discovered again after a Service Changed go to
+// the cache, and the whole database is discovered if it is kept on disk.
+static void cache_prepare(bl_ctx_t *ctx)
+{
+  if (database_apply_changes(ctx, ctx->cache)) {
+    uint8_t  hash[16];
+    GError  *err = NULL;
+
+    printf("Service changed, cache updated\n");
+    ctx->cache_failed = FALSE;
+    // Not the layout identified on connection anymore
+    g_free(ctx->layout_key);
+    ctx->layout_key = NULL;
+    watch_service_changed(ctx);
+    if (ctx->cache_dir && cache_is_complete(ctx->cache)) {
+      cache_set_hash(ctx->cache, read_db_hash(ctx, hash) ? NULL : hash);
+      if (cache_save(ctx->cache, ctx->cache_dir, ctx->current_mac, &err)) {
+        printf("Error: Cache not saved: %s", err ? err->message : "\n");
+        g_clear_error(&err);
+      }
+    } else if (ctx->cache_dir) {
+      cache_remove(ctx->cache_dir, ctx->current_mac);
+    }
+  }
 
-      if (!strcmp(((bl_desc_t *)(l->data))->uuid_str, desc_uuid_str))
-        bl_desc = bl_desc_cpy(l->data);
-    } else {
-      printf("Error: NO DATA\n");
+  if (ctx->cache_dir && !ctx->cache_failed &&
+      !cache_is_complete(ctx->cache)) {
+    GError *gerr = NULL;
+
+    if (build_cache(ctx, &gerr)) {
+      printf("Error: Cache not built: %s", gerr->message);
+      g_error_free(gerr);
+      // Not tried again before the next connection
+      ctx->cache_failed = TRUE;
     }
   }
-  bl_char_list_free(bl_desc_list);
-  return bl_desc;
 }
 
-// Search a specific descriptor of the specified characteristic.
-// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
-// to search, but the result is the same with or without.
-// Returns the characteristic descriptor if found, else NULL.
-bl_desc_t *bl_get_desc_by_char(bl_char_t *start_bl_char,
-    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
-    GError **gerr)
+int bl_ctx_set_cache_dir(bl_ctx_t *ctx, const char *dir)
 {
-  *gerr = NULL;
-  GSList *bl_desc_list = bl_get_all_desc_by_char(start_bl_char,
-      end_bl_char, bl_primary, gerr);
+  int ret = BL_NO_ERROR;
+  BLUELIB_ENTER;
 
-  if ((!bl_desc_list) || (*gerr))
-    return NULL;
+  g_free(ctx->cache_dir);
+  ctx->cache_dir    = g_strdup(dir);
+  ctx->cache_failed = FALSE;
+  BLUELIB_EXIT;
+}
 
-  return find_desc(bl_desc_list, desc_uuid_str);
+int bl_ctx_clear_cache(bl_ctx_t *ctx)
+{
+  int ret = BL_NO_ERROR;
+  BLUELIB_ENTER;
+
+  if (ctx->cache) {
+    cache_free(ctx->cache);
+    ctx->cache = cache_new();
+  }
+  ctx->cache_failed = FALSE;
+  if (ctx->cache_dir && ctx->current_mac)
+    cache_remove(ctx->cache_dir, ctx->current_mac);
+  if (ctx->layout_key)
+    cache_layout_remove(ctx->layout_key, ctx->cache_dir);
+  BLUELIB_EXIT;
 }
 
-// Search a specific descriptor of the unique characteristic associated to
-// the UUID on a primary service.
-// Returns the characteristic descriptor if found, else NULL.
-bl_desc_t *bl_get_desc(char *char_uuid_str, bl_primary_t *bl_primary,
-    char *desc_uuid_str, GError **gerr)
+int bl_ctx_set_layout_sharing(bl_ctx_t *ctx, gboolean enable,
+    const char *key_uuids)
 {
-  *gerr = NULL;
-  GSList *bl_desc_list = bl_get_all_desc(char_uuid_str, bl_primary,
-      gerr);
+  int ret = BL_NO_ERROR;
+  BLUELIB_ENTER;
 
-  if ((!bl_desc_list) || *gerr)
-    return NULL;
+  g_strfreev(ctx->layout_key_uuids);
+  ctx->layout_key_uuids = key_uuids ? g_strsplit(key_uuids, ",", 0) : NULL;
+  ctx->share_layout     = enable;
+  BLUELIB_EXIT;
+}
 
-  return find_desc(bl_desc_list, desc_uuid_str);
+int bl_ctx_get_cache_stats(bl_ctx_t *ctx, bl_cache_stats_t *stats)
+{
+  int ret = BL_NO_ERROR;
+  BLUELIB_ENTER;
+
+  if (stats)
+    *stats = ctx->cache_stats;
+  else
+    ret = EINVAL;
+  BLUELIB_EXIT;
 }
 
 
-/************************* Read characteristic value ***********************/
-// Read by handle.
-static bl_value_t *read_by_hnd(uint16_t handle, GError **gerr)
+/***************************** Whole database ******************************/
+bl_database_t *bl_ctx_get_database(bl_ctx_t *ctx, GError **gerr)
 {
-  bl_value_t *ret = NULL;
-  *gerr = NULL;
+  bl_database_t *ret = NULL;
 
   BLUELIB_ENTER_GERR;
   ASSERT_CONNECTED_GERR;
 
-  if (handle == INVALID_HANDLE) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, EINVAL,
-        "Invalid handle\n");
-    PROPAGATE_ERROR;
+  cache_prepare(ctx);
+  if (!cache_hit(ctx, cache_is_complete(ctx->cache)) &&
+      build_cache(ctx, gerr))
     goto exit;
-  }
 
-  if (!gatt_read_char(attrib, handle, read_by_hnd_cb, attrib)) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "Unable to send request\n");
+  ret = cache_get_database(ctx->cache);
+  if (ret == NULL) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,
+        "Malloc error\n");
     PROPAGATE_ERROR;
-    goto exit;
   }
-
-  wait_for_cb((void **) &ret, gerr);
-
-  // Add handle to the value
-  if (ret)
-    ret->handle = handle;
 exit:
   BLUELIB_EXIT;
 }
 
-// Read all the characteristics value associated to this UUID.
-// Return a list of values (bl_value_t *).
-GSList *bl_read_char_all(char *uuid_str, bl_primary_t *bl_primary, GError **gerr)
+// The whole database is discovered when the cache can't answer.
+int bl_ctx_lookup_handle(bl_ctx_t *ctx, uint16_t handle,
+    bl_primary_t **bl_primary, bl_char_t **bl_char)
 {
-  GSList *ret = NULL;
+  GError *gerr = NULL;
+  int     ret  = BL_NO_ERROR;
 
-  BLUELIB_ENTER_GERR;
-  ASSERT_CONNECTED_GERR;
+  BLUELIB_ENTER;
+  ASSERT_CONNECTED;
 
-  if (uuid_str == NULL) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "UUID needed\n");
-    PROPAGATE_ERROR;
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_lookup_handle(ctx->cache, handle, bl_primary,
+          bl_char)))
+    goto exit;
+  ret = build_cache(ctx, &gerr);
+  if (ret) {
+    printf("Error: %s", gerr->message);
+    g_error_free(gerr);
     goto exit;
   }
+  cache_lookup_handle(ctx->cache, handle, bl_primary, bl_char);
+exit:
+  BLUELIB_EXIT;
+}
+
+GSList *bl_ctx_lookup_range(bl_ctx_t *ctx, uint16_t start, uint16_t end,
+    GError **gerr)
+{
+  GSList *ret = NULL;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+
+  cache_prepare(ctx);
+  if (!cache_hit(ctx, cache_lookup_range(ctx->cache, start, end, &ret)) &&
+      !build_cache(ctx, gerr))
+    cache_lookup_range(ctx->cache, start, end, &ret);
+exit:
+  BLUELIB_EXIT;
+}
+
+
+/******************** Connect/Disconnect from a device *********************/
+// Connect to a device
+int bl_ctx_connect(bl_ctx_t *ctx, char *mac_dst, char *dst_type)
+{
+  GError   *gerr  = NULL;
+  bl_req_t *req   = NULL;
+  gint64    start = g_get_monotonic_time();
+  int       ret;
+
+  BLUELIB_ENTER;
+
+  if (ctx->conn_state != STATE_DISCONNECTED) {
+    printf("Error: Already connected to a device\n");
+    ret = BL_ALREADY_CONNECTED_ERROR;
+    goto error;
+  }
+
+  if (!mac_dst) {
+    printf("Error: Remote Bluetooth address required\n");
+    ret = EINVAL;
+    goto error;
+  }
+
+  // Check if the address MAC is correct
+  int i;
+  for (i = 0; i < MAC_SZ; i++) {
+    if ((i%3 < 2) &&
+        (!(((mac_dst[i] >= '0') && (mac_dst[i] <= '9')) ||
+           ((mac_dst[i] >= 'a') && (mac_dst[i] <= 'f')) ||
+           ((mac_dst[i] >= 'A') && (mac_dst[i] <= 'F')))))
+      goto wrongmac;
+    else if ((i%3 == 2) && (mac_dst[i] != ':'))
+      goto wrongmac;
+  }
+  if (mac_dst[MAC_SZ] != '\0')
+    goto wrongmac;
+
+  g_free(ctx->opt_dst);
+  ctx->opt_dst = g_strdup(mac_dst);
+
+  g_free(ctx->opt_dst_type);
+  if (dst_type)
+    ctx->opt_dst_type = g_strdup(dst_type);
+  else
+    ctx->opt_dst_type = g_strdup("public");
+
+  req = req_new(ctx);
+  if (req == NULL) {
+    printf("Error: Malloc error\n");
+    ret = BL_MALLOC_ERROR;
+    goto error;
+  }
+
+  printf("Attempting to connect to %s\n", ctx->opt_dst);
+  set_conn_state(ctx, STATE_CONNECTING);
+  ctx->timings = (bl_connect_timings_t) { 0 };
+  ctx->no_read_multi_var = FALSE;
+  // The round trip time depends on the parameters of each connection: the
+  // connection itself is given the longest timeout, not the one of the
+  // previous link
+  g_mutex_lock(&ctx->pending_mutex);
+  ctx->srtt_us      = 0;
+  ctx->rttvar_us    = 0;
+  ctx->last_rx_time = 0;
+  g_mutex_unlock(&ctx->pending_mutex);
+
+  // The reactor is chosen first, the socket is watched by its context
+  if (start_event_loop(ctx, &gerr)) {
+    printf("Error: fail to start event loop\n");
+    ret = gerr->code;
+    g_error_free(gerr);
+    set_conn_state(ctx, STATE_DISCONNECTED);
+    req_drop(req);
+    goto error;
+  }
+  ctx->connect_time = g_get_monotonic_time();
+  ctx->timings.loop_ready_us = ctx->connect_time - start;
+
+  ctx->iochannel = gatt_connect(ctx->opt_src, ctx->opt_dst, ctx->opt_dst_type,
+      ctx->opt_sec_level, ctx->opt_psm, ctx->opt_mtu, event_loop_context(ctx),
+      connect_cb, req, &gerr);
+
+  if (gerr) {
+    printf("Error <%d %s>\n", gerr->code, gerr->message);
+    set_conn_state(ctx, STATE_DISCONNECTED);
+    ret = gerr->code;
+    g_error_free(gerr);
+    req_drop(req);
+    goto error;
+  }
+
+  if (!ctx->iochannel) {
+    printf("Error: iochannel NULL\n");
+    set_conn_state(ctx, STATE_DISCONNECTED);
+    ret = BL_SEND_REQUEST_ERROR;
+    req_drop(req);
+    goto error;
+  }
+
+  ctx->hup_watch = g_io_create_watch(ctx->iochannel, G_IO_HUP);
+  g_source_set_callback(ctx->hup_watch, (GSourceFunc) channel_watcher, ctx,
+      NULL);
+  g_source_attach(ctx->hup_watch, event_loop_context(ctx));
+
+  ret = wait_for_cb(req, NULL, NULL);
+  if (ret) {
+    printf("Error: CallBack error\n");
+    // The watches would stay on the reactor, which keeps running
+    disconnect_io(ctx);
+    stop_event_loop(ctx);
+    goto error;
+  }
+  ctx->timings.total_us     = g_get_monotonic_time() - start;
+  ctx->timings.att_ready_us = ctx->timings.total_us -
+    ctx->timings.loop_ready_us - ctx->timings.socket_connect_us;
+
+  g_free(ctx->current_mac);
+  ctx->current_mac = g_strdup(mac_dst);
+  load_cache(ctx);
+  enable_service_changed(ctx);
+  poller_start(ctx);
+  ret = BL_NO_ERROR;
+  req_unref(req);
+  g_mutex_unlock(&ctx->mutex);
+  if (ctx->connect_cb_fct)
+    return ctx->connect_cb_fct();
+  return ret;
+
+wrongmac:
+  printf("Error: Address MAC invalid\n");
+  ret = EINVAL;
+error:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Disconnect from the device, delete the nofication list.
+int bl_ctx_disconnect(bl_ctx_t *ctx)
+{
+  int ret = BL_NO_ERROR;
+  BLUELIB_ENTER;
+
+  disconnect_io(ctx);
+  cache_free(ctx->cache);
+  ctx->cache = NULL;
+  printf("Disconnected\n");
+  poller_stop(ctx);
+  stop_event_loop(ctx);
+  database_drop_changes(ctx);
+  BLUELIB_EXIT;
+}
+
+// Set a function to call each time you succeed to connect
+// If the connection go well, the return value of bl_connect will be the one
+// of user_cb_fct_t.
+int bl_ctx_set_connect_cb(bl_ctx_t *ctx, user_cb_fct_t func)
+{
+  ctx->connect_cb_fct = func;
+  return BL_NO_ERROR;
+}
+
+int bl_ctx_get_connect_timings(bl_ctx_t *ctx, bl_connect_timings_t *timings)
+{
+  if (!ctx)
+    return BL_NOT_INIT_ERROR;
+  if (!timings)
+    return EINVAL;
+  *timings = ctx->timings;
+  return BL_NO_ERROR;
+}
+
+
+/************************* Primary Service Discovery ***********************/
+// Get all the primary service associated of an UUID.
+// Return a list of primary services (bl_primary_t *).
+GSList *bl_ctx_get_all_primary(bl_ctx_t *ctx, char *uuid_str, GError **gerr)
+{
+  GSList   *ret  = NULL;
+  GSList   *list = NULL;
+  bl_req_t *req  = NULL;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_get_primary(ctx->cache, uuid_str, &ret)))
+    goto exit;
+  NEW_REQ_GERR;
+
+  // All the services are discovered for the cache, then filtered
+  if (send_primary(NULL, req, gerr))
+    wait_for_cb(req, (void **) &list, gerr);
+  if (*gerr == NULL) {
+    cache_add_primaries(ctx->cache, list);
+    cache_get_primary(ctx->cache, uuid_str, &ret);
+  }
+  bl_primary_list_free(list);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Asynchronous equivalent of bl_get_all_primary.
+guint bl_ctx_get_all_primary_async(bl_ctx_t *ctx, char *uuid_str,
+    bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  NEW_REQ_ASYNC(list_free);
+
+  if (send_primary(uuid_str, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+// Get a specific primary service.
+// Return the primary service associated to this UUID, if unique.
+bl_primary_t *bl_ctx_get_primary(bl_ctx_t *ctx, char *uuid_str, GError **gerr)
+{
+  CLEAR_GERROR;
+  bl_primary_t *bl_primary      = NULL;
+  GSList       *bl_primary_list = bl_ctx_get_all_primary(ctx, uuid_str, gerr);
+
+  if (*gerr || !bl_primary_list)
+    return NULL;
+
+  if (bl_primary_list->next) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_UNICITY_ERROR,
+        "Primary not unique\n");
+    PROPAGATE_ERROR;
+    bl_primary_list_free(bl_primary_list);
+    return NULL;
+  }
+
+  if (bl_primary_list->data)
+    bl_primary = bl_primary_cpy(bl_primary_list->data);
+  bl_primary_list_free(bl_primary_list);
+  return bl_primary;
+}
+
+// Get all the primary services of a device.
+// Return a list of primary services (bl_primary_t *).
+GSList *bl_ctx_get_all_primary_device(bl_ctx_t *ctx, GError **gerr)
+{
+  return bl_ctx_get_all_primary(ctx, NULL, gerr);
+}
+
+
+/************************** Get Included Services **************************/
+// Get all the included service of a primary service.
+// Returns a list of included services (bl_included_t *).
+GSList *bl_ctx_get_included(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  GSList   *ret = NULL;
+  bl_req_t *req = NULL;
+  uint16_t  start_handle;
+  uint16_t  end_handle;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_get_included(ctx->cache, bl_primary, &ret)))
+    goto exit;
+  NEW_REQ_GERR;
+
+  if (send_included(bl_primary, req, gerr))
+    wait_for_cb(req, (void **) &ret, gerr);
+  if ((*gerr == NULL) &&
+      !handle_assert(&start_handle, &end_handle, bl_primary, gerr))
+    cache_add_included(ctx->cache, start_handle, end_handle, ret);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Asynchronous equivalent of bl_get_included.
+guint bl_ctx_get_included_async(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  NEW_REQ_ASYNC(list_free);
+
+  if (send_included(bl_primary, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+/*************************** Get characteristics ***************************/
+// Get all characteristics associated to an UUID on a primary service.
+// Returns a list of characteristics (bl_char_t *) associated to the UUID
+GSList *bl_ctx_get_all_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  GSList   *ret  = NULL;
+  GSList   *list = NULL;
+  bl_req_t *req  = NULL;
+  uint16_t  start_handle;
+  uint16_t  end_handle;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_get_char(ctx->cache, uuid_str, bl_primary, &ret)))
+    goto exit;
+  NEW_REQ_GERR;
+
+  // All the characteristics of the range are discovered for the cache, the
+  // UUID is only filtered locally by gatt_discover_char anyway.
+  if (send_char(NULL, bl_primary, req, gerr))
+    wait_for_cb(req, (void **) &list, gerr);
+  if ((*gerr == NULL) || (req->att_status == ATT_ECODE_ATTR_NOT_FOUND)) {
+    CLEAR_GERROR;
+    handle_assert(&start_handle, &end_handle, bl_primary, gerr);
+    cache_add_chars(ctx->cache, start_handle, end_handle, list);
+    cache_get_char(ctx->cache, uuid_str, bl_primary, &ret);
+    watch_service_changed(ctx);
+  }
+  bl_char_list_free(list);
+exit:
+  // Same error as the discovery when nothing is found
+  if ((ret == NULL) && (*gerr == NULL)) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_REQUEST_FAIL_ERROR,
+        "Characteristic by UUID callback: Failure: %s\n",
+        att_ecode2str(ATT_ECODE_ATTR_NOT_FOUND));
+    PROPAGATE_ERROR;
+  }
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Asynchronous equivalent of bl_get_all_char.
+guint bl_ctx_get_all_char_async(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  NEW_REQ_ASYNC(list_free);
+
+  if (send_char(uuid_str, bl_primary, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+// Get a specific characteristic associated to an UUID on a primary service.
+// Returns the characteristic associated to this uuid, if unique.
+bl_char_t *bl_ctx_get_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  CLEAR_GERROR;
+  bl_char_t *bl_char      = NULL;
+  GSList    *bl_char_list = bl_ctx_get_all_char(ctx, uuid_str, bl_primary,
+      gerr);
+
+  if ((!bl_char_list) || (*gerr)) {
+    return NULL;
+  }
+
+  if (bl_char_list->next != NULL) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_UNICITY_ERROR,
+        "Characteristic not unique\n");
+    PROPAGATE_ERROR;
+    bl_char_list_free(bl_char_list);
+    return NULL;
+  }
+  if (bl_char_list->data);
+    bl_char = bl_char_cpy(bl_char_list->data);
+  bl_char_list_free(bl_char_list);
+  return bl_char;
+}
+
+// Get all characteristics on a primary service.
+// Returns a list of characteristics (bl_char_t *).
+GSList *bl_ctx_get_all_char_in_primary(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  CLEAR_GERROR;
+  return bl_ctx_get_all_char(ctx, NULL, bl_primary, gerr);
+}
+
+
+/****************************** Get Descriptors ****************************/
+// Get all the descriptors of a specified characteristic on a primary
+// service.
+// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
+// to search, but the result is the same with or without.
+// Returns a list of characteristic descriptor (bl_desc_t *).
+GSList *bl_ctx_get_all_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GError **gerr)
+{
+  GSList   *ret  = NULL;
+  GSList   *list = NULL;
+  bl_req_t *req  = NULL;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_get_desc(ctx->cache, start_bl_char, end_bl_char,
+          bl_primary, &ret)))
+    goto exit;
+  NEW_REQ_GERR;
+
+  // All the descriptors of the characteristic are discovered for the cache,
+  // then limited to end_bl_char
+  if (send_desc_discovery(start_bl_char, NULL, bl_primary, req, gerr))
+    wait_for_cb(req, (void **) &list, gerr);
+  if (*gerr == NULL) {
+    cache_add_descs(ctx->cache, start_bl_char, list);
+    if (!cache_get_desc(ctx->cache, start_bl_char, end_bl_char, bl_primary,
+          &ret)) {
+      GError *err = g_error_new(BL_ERROR_DOMAIN, BL_HANDLE_ORDER_ERROR,
+          "The handle of end_bl_char before the one of start_bl_char\n");
+      PROPAGATE_ERROR;
+    }
+  }
+  bl_desc_list_free(list);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+static gboolean is_declaration(bl_desc_t *bl_desc)
+{
+  return !strcmp(bl_desc->uuid_str, GATT_PRIM_SVC_UUID_STR) ||
+    !strcmp(bl_desc->uuid_str, GATT_SND_SVC_UUID_STR) ||
+    !strcmp(bl_desc->uuid_str, GATT_INCLUDE_UUID_STR) ||
+    !strcmp(bl_desc->uuid_str, GATT_CHARAC_UUID_STR);
+}
+
+// Descriptors of bl_char among the attributes of a Find Information sweep,
+// from its declaration up to the next one, as copies.
+static GSList *sweep_descs(GSList *attrs, bl_char_t *bl_char)
+{
+  GSList *list = NULL;
+  GSList *l    = attrs;
+
+  while (l && (((bl_desc_t *) l->data)->handle <= bl_char->handle))
+    l = l->next;
+  for (; l && !is_declaration(l->data); l = l->next)
+    list = g_slist_prepend(list, bl_desc_cpy(l->data));
+  return g_slist_reverse(list);
+}
+
+// Get the descriptors of all the characteristics of a primary service with
+// one Find Information sweep over the service.
+GSList *bl_ctx_get_all_desc_in_primary(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    GSList *bl_char_list, GError **gerr)
+{
+  GSList   *ret   = NULL;
+  GSList   *attrs = NULL;
+  bl_req_t *req   = NULL;
+  gboolean  hit   = TRUE;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  if (bl_primary == NULL) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+        "Primary service needed\n");
+    PROPAGATE_ERROR;
+    goto exit;
+  }
+
+  cache_prepare(ctx);
+  for (GSList *l = bl_char_list; l && hit; l = l->next) {
+    GSList *list = NULL;
+    hit = cache_get_desc(ctx->cache, l->data, NULL, bl_primary, &list);
+    ret = g_slist_prepend(ret, list);
+  }
+  if (cache_hit(ctx, hit))
+    goto exit;
+  bl_desc_lists_free(ret);
+  ret = NULL;
+
+  // Nothing after the declaration of the service
+  if (bl_primary->start_handle < bl_primary->end_handle) {
+    NEW_REQ_GERR;
+    req->sweep = TRUE;
+    if (send_desc_range(bl_primary->start_handle + 1, bl_primary->end_handle,
+          req, gerr))
+      wait_for_cb(req, (void **) &attrs, gerr);
+    if (*gerr)
+      goto exit;
+  }
+
+  for (GSList *l = bl_char_list; l; l = l->next) {
+    GSList *list = sweep_descs(attrs, l->data);
+    cache_add_descs(ctx->cache, l->data, list);
+    ret = g_slist_prepend(ret, list);
+  }
+  bl_desc_list_free(attrs);
+exit:
+  ret = g_slist_reverse(ret);
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Asynchronous equivalent of bl_get_all_desc_by_char.
+guint bl_ctx_get_all_desc_by_char_async(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, bl_async_cb_t func,
+    void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  NEW_REQ_ASYNC(list_free);
+
+  if (send_desc_discovery(start_bl_char, end_bl_char, bl_primary, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+// Get all the descriptors of the unique characteristic associated to the
+// UUID on a primary service.
+// Returns a list of characteristic descriptor (bl_desc_t *).
+GSList *bl_ctx_get_all_desc(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  bl_char_t *bl_char = bl_ctx_get_char(ctx, uuid_str, bl_primary, gerr);
+
+  if ((!bl_char) || (*gerr))
+    return NULL;
+
+  GSList *ret = bl_ctx_get_all_desc_by_char(ctx, bl_char, NULL, bl_primary,
+      gerr);
+  bl_char_free(bl_char);
+  return ret;
+}
+
+// BlueZ returns UUID with letter in lowcase.
+static void lowcase_str(char *dst, char *src)
+{
+  for (int i = 0; ;i++) {
+
+    if (('A' <= src[i]) && (src[i] <= 'F'))
+      dst[i] = src[i] + 0x20;
+    else
+      dst[i] = src[i];
+  if (!src[i])
+      break;
+  }
+}
+
+// Find a specific descriptor by UUID, on a list of bl_desc_t *.
+static bl_desc_t *find_desc(GSList *bl_desc_list, char *desc_uuid_str)
+{
+  // The uuid generated by the callback are in lowcase
+  // Translate upcase letters in lowcase
+  bl_desc_t *bl_desc = NULL;
+
+  char desc_uuid_tmp[MAX_LEN_UUID_STR];
+  lowcase_str(desc_uuid_tmp, desc_uuid_str);
+
+  for (GSList *l = bl_desc_list; l; l = l->next) {
+    if (l->data) {
+
+      if (!strcmp(((bl_desc_t *)(l->data))->uuid_str, desc_uuid_str))
+        bl_desc = bl_desc_cpy(l->data);
+    } else {
+      printf("Error: NO DATA\n");
+    }
+  }
+  bl_char_list_free(bl_desc_list);
+  return bl_desc;
+}
+
+// Search a specific descriptor of the specified characteristic.
+// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
+// to search, but the result is the same with or without.
+// Returns the characteristic descriptor if found, else NULL.
+bl_desc_t *bl_ctx_get_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr)
+{
+  *gerr = NULL;
+  GSList *bl_desc_list = bl_ctx_get_all_desc_by_char(ctx, start_bl_char,
+      end_bl_char, bl_primary, gerr);
+
+  if ((!bl_desc_list) || (*gerr))
+    return NULL;
+
+  return find_desc(bl_desc_list, desc_uuid_str);
+}
+
+// Search a specific descriptor of the unique characteristic associated to
+// the UUID on a primary service.
+// Returns the characteristic descriptor if found, else NULL.
+bl_desc_t *bl_ctx_get_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, char *desc_uuid_str, GError **gerr)
+{
+  *gerr = NULL;
+  GSList *bl_desc_list = bl_ctx_get_all_desc(ctx, char_uuid_str, bl_primary,
+      gerr);
+
+  if ((!bl_desc_list) || *gerr)
+    return NULL;
+
+  return find_desc(bl_desc_list, desc_uuid_str);
+}
+
+
+/*************************** First match lookups ***************************/
+// First primary service of the UUID, by Find By Type Value.
+bl_primary_t *bl_ctx_find_primary(bl_ctx_t *ctx, char *uuid_str,
+    GError **gerr)
+{
+  bl_primary_t *ret  = NULL;
+  GSList       *list = NULL;
+  bl_req_t     *req  = NULL;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  ASSERT_UUID_GERR;
+  cache_prepare(ctx);
+  if (!cache_hit(ctx, cache_get_primary(ctx->cache, uuid_str, &list))) {
+    NEW_REQ_GERR;
+    // Find By Type Value, only the services with this UUID are returned
+    if (send_primary(uuid_str, req, gerr))
+      wait_for_cb(req, (void **) &list, gerr);
+  }
+  if (*gerr == NULL)
+    ret = take_match(list, uuid_str);
+  bl_primary_list_free(list);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// First characteristic of the UUID, the Read By Type pages stop there.
+bl_char_t *bl_ctx_find_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  bl_char_t *ret  = NULL;
+  GSList    *list = NULL;
+  bl_req_t  *req  = NULL;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  ASSERT_UUID_GERR;
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_get_char(ctx->cache, uuid_str, bl_primary,
+          &list))) {
+    ret = take_match(list, uuid_str);
+    bl_char_list_free(list);
+    goto exit;
+  }
+  NEW_REQ_GERR;
+
+  first_match_req(req, uuid_str);
+  if (send_char_stream(bl_primary, req, gerr))
+    wait_for_cb(req, (void **) &ret, gerr);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// First descriptor of the UUID of a characteristic.
+bl_desc_t *bl_ctx_find_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr)
+{
+  bl_desc_t *ret      = NULL;
+  GSList    *list     = NULL;
+  bl_req_t  *req      = NULL;
+  char      *uuid_str = desc_uuid_str;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  ASSERT_UUID_GERR;
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_get_desc(ctx->cache, start_bl_char, end_bl_char,
+          bl_primary, &list))) {
+    ret = take_match(list, uuid_str);
+    bl_desc_list_free(list);
+    goto exit;
+  }
+  NEW_REQ_GERR;
+
+  first_match_req(req, uuid_str);
+  if (send_desc_discovery(start_bl_char, end_bl_char, bl_primary, req, gerr))
+    wait_for_cb(req, (void **) &ret, gerr);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Client Characteristic Configuration descriptor of bl_char, the discovery
+// ends at the next declaration anyway.
+bl_desc_t *bl_ctx_get_cccd(bl_ctx_t *ctx, bl_char_t *bl_char, GError **gerr)
+{
+  bl_desc_t *ret  = NULL;
+  GSList    *list = NULL;
+  bl_req_t  *req  = NULL;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  if (bl_char == NULL) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+        "Characteristic needed\n");
+    PROPAGATE_ERROR;
+    goto exit;
+  }
+  cache_prepare(ctx);
+  if (cache_hit(ctx, cache_get_desc(ctx->cache, bl_char, NULL, NULL,
+          &list))) {
+    ret = take_match(list, GATT_CLIENT_CHARAC_CFG_UUID_STR);
+    bl_desc_list_free(list);
+    goto exit;
+  }
+  if (bl_char->value_handle == 0xffff)
+    goto exit;
+  NEW_REQ_GERR;
+
+  // From the value, up to the next declaration
+  first_match_req(req, GATT_CLIENT_CHARAC_CFG_UUID_STR);
+  if (send_desc_range(bl_char->value_handle + 1, 0xffff, req, gerr))
+    wait_for_cb(req, (void **) &ret, gerr);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+
+/************************** Streaming discoveries **************************/
+guint bl_ctx_get_all_primary_stream(bl_ctx_t *ctx, bl_page_cb_t page_func,
+    bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  ASSERT_PAGE_FUNC;
+  NEW_REQ_ASYNC(NULL);
+  req->page_func = page_func;
+
+  if (send_primary_stream(req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+guint bl_ctx_get_all_char_stream(bl_ctx_t *ctx, bl_primary_t *bl_primary,
+    bl_page_cb_t page_func, bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  ASSERT_PAGE_FUNC;
+  NEW_REQ_ASYNC(NULL);
+  req->page_func = page_func;
+
+  if (send_char_stream(bl_primary, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+guint bl_ctx_get_all_desc_by_char_stream(bl_ctx_t *ctx,
+    bl_char_t *start_bl_char, bl_char_t *end_bl_char,
+    bl_primary_t *bl_primary, bl_page_cb_t page_func, bl_async_cb_t func,
+    void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  ASSERT_PAGE_FUNC;
+  NEW_REQ_ASYNC(NULL);
+  req->page_func = page_func;
+
+  if (send_desc_discovery(start_bl_char, end_bl_char, bl_primary, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+
+/********************************* Batches *********************************/
+// One operation of a batch, user data of its request.
+typedef struct {
+  bl_batch_t *batch;
+  int         index;
+  uint16_t    handle;
+  char       *uuid_str;
+  uint8_t    *value;     // NULL for a read
+  size_t      size;
+  int         type;
+  bl_req_t   *req;       // While running
+} batch_op_t;
+
+struct bl_batch {
+  bl_ctx_t          *ctx;
+  GPtrArray         *ops;
+  bl_batch_result_t *results;
+
+  // Completion of the whole batch
+  GMutex             mutex;
+  GCond              cond;
+  int                remaining;
+  gboolean           done;
+};
+
+static void batch_op_free(gpointer data)
+{
+  batch_op_t *op = data;
+
+  g_free(op->uuid_str);
+  g_free(op->value);
+  g_free(op);
+}
+
+static void batch_results_free(bl_batch_t *batch)
+{
+  if (batch->results == NULL)
+    return;
+
+  for (guint i = 0; i < batch->ops->len; i++) {
+    if (batch->results[i].value)
+      bl_value_free(batch->results[i].value);
+  }
+  g_free(batch->results);
+  batch->results = NULL;
+}
+
+static int batch_add(bl_batch_t *batch, uint16_t handle, char *uuid_str,
+    uint8_t *value, size_t size, int type)
+{
+  batch_op_t *op;
+
+  if ((batch == NULL) || (handle == INVALID_HANDLE))
+    return EINVAL;
+
+  op = g_new0(batch_op_t, 1);
+  op->batch    = batch;
+  op->index    = batch->ops->len;
+  op->handle   = handle;
+  op->uuid_str = g_strdup(uuid_str);
+  if (value) {
+    op->value = g_memdup(value, size);
+    op->size  = size;
+    op->type  = type;
+  }
+  g_ptr_array_add(batch->ops, op);
+  return BL_NO_ERROR;
+}
+
+// Called once for each operation: by the event loop, or by bl_batch_run if
+// the operation can't be sent.
+static void batch_op_done(int status, void *result, void *user_data)
+{
+  batch_op_t *op    = user_data;
+  bl_batch_t *batch = op->batch;
+
+  batch->results[op->index].status = status;
+  batch->results[op->index].value  = result;
+
+  g_mutex_lock(&batch->mutex);
+  if (--batch->remaining == 0) {
+    batch->done = TRUE;
+    g_cond_broadcast(&batch->cond);
+  }
+  g_mutex_unlock(&batch->mutex);
+}
+
+bl_batch_t *bl_ctx_batch_new(bl_ctx_t *ctx)
+{
+  bl_batch_t *batch;
+
+  if (ctx == NULL)
+    return NULL;
+
+  batch = g_new0(bl_batch_t, 1);
+  batch->ctx = ctx;
+  batch->ops = g_ptr_array_new_with_free_func(batch_op_free);
+  g_mutex_init(&batch->mutex);
+  g_cond_init(&batch->cond);
+  return batch;
+}
+
+void bl_batch_free(bl_batch_t *batch)
+{
+  if (batch == NULL)
+    return;
+
+  batch_results_free(batch);
+  g_ptr_array_free(batch->ops, TRUE);
+  g_mutex_clear(&batch->mutex);
+  g_cond_clear(&batch->cond);
+  g_free(batch);
+}
+
+int bl_batch_add_read(bl_batch_t *batch, uint16_t handle, char *uuid_str)
+{
+  return batch_add(batch, handle, uuid_str, NULL, 0, 0);
+}
+
+int bl_batch_add_write(bl_batch_t *batch, uint16_t handle, uint8_t *value,
+    size_t size, int type)
+{
+  if ((size == 0) || (value == NULL))
+    return EINVAL;
+  return batch_add(batch, handle, NULL, value, size, type);
+}
+
+int bl_batch_get_size(bl_batch_t *batch)
+{
+  return batch ? (int) batch->ops->len : 0;
+}
+
+// All the requests are queued on the GAttrib before waiting, under one lock.
+bl_batch_result_t *bl_batch_run(bl_batch_t *batch, GError **gerr)
+{
+  bl_batch_result_t *ret = NULL;
+  bl_ctx_t          *ctx = batch ? batch->ctx : NULL;
+  bl_req_t          *req = NULL;
+
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+
+  batch_results_free(batch);
+  batch->results   = g_new0(bl_batch_result_t, MAX(batch->ops->len, 1));
+  batch->remaining = batch->ops->len;
+  batch->done      = (batch->ops->len == 0);
+
+  for (guint i = 0; i < batch->ops->len; i++) {
+    batch_op_t *op       = g_ptr_array_index(batch->ops, i);
+    GError     *send_err = NULL;
+    guint       sent;
+
+    req = req_new(ctx);
+    if (req == NULL) {
+      batch_op_done(BL_MALLOC_ERROR, NULL, op);
+      continue;
+    }
+    req->id        = req_new_id();
+    req->func      = batch_op_done;
+    req->user_data = op;
+    req->ret_free  = op->value ? NULL : (GDestroyNotify) bl_value_free;
+
+    if (op->value)
+      sent = send_write(op->handle, op->value, op->size, op->type, req,
+          &send_err);
+    else
+      sent = send_read_by_hnd(op->handle, op->uuid_str, 0, req, &send_err);
+    if (sent) {
+      // Kept to expire it on timeout
+      op->req = req;
+    } else {
+      batch_op_done(send_err->code, NULL, op);
+      g_error_free(send_err);
+      req_unref(req);
+    }
+  }
+
+  if (wait_for_done(ctx, &batch->mutex, &batch->cond, &batch->done)) {
+    // The operations left fail with BL_NO_CALLBACK_ERROR
+    for (guint i = 0; i < batch->ops->len; i++) {
+      batch_op_t *op = g_ptr_array_index(batch->ops, i);
+      if (op->req)
+        req_expire(op->req);
+    }
+    wait_for_expired(ctx, &batch->mutex, &batch->cond, &batch->done);
+  }
+  for (guint i = 0; i < batch->ops->len; i++) {
+    batch_op_t *op = g_ptr_array_index(batch->ops, i);
+    req_unref(op->req);
+    op->req = NULL;
+  }
+  ret = batch->results;
+exit:
+  BLUELIB_EXIT;
+}
+
+// Run a batch made of one read for each characteristic or descriptor of
+// list, and replace each of them by its value. Returns the list of values,
+// or NULL with gerr set by the first error, the list is then freed.
+static GSList *read_list_by_batch(bl_batch_t *batch, GSList *list,
+    GError **gerr)
+{
+  bl_batch_result_t *results = bl_batch_run(batch, gerr);
+  int                i       = 0;
+
+  for (GSList *l = list; l && l->data; l = l->next, i++) {
+    struct_free(l->data);
+    l->data = NULL;
+    if (results == NULL)
+      continue;
+
+    if (results[i].status && !*gerr) {
+      GError *err = g_error_new(BL_ERROR_DOMAIN, results[i].status,
+          "Read error\n");
+      PROPAGATE_ERROR;
+    }
+    l->data = results[i].value;
+    results[i].value = NULL;
+  }
+  if (*gerr) {
+    bl_value_list_free(list);
+    return NULL;
+  }
+  return list;
+}
+
+
+/*************************** Resumable long reads **************************/
+// The part of the value read so far is kept by the long read, out of the
+// connection.
+struct bl_long_read {
+  uint16_t  handle;
+  uint8_t  *data;
+  size_t    size;
+  size_t    alloc;
+  size_t    check_size;  // First bytes compared on resume
+  gboolean  complete;
+};
+
+bl_long_read_t *bl_long_read_new(uint16_t handle, size_t expected_size,
+    size_t check_size)
+{
+  bl_long_read_t *long_read;
+
+  if (handle == INVALID_HANDLE)
+    return NULL;
+
+  long_read = g_new0(bl_long_read_t, 1);
+  long_read->handle     = handle;
+  long_read->check_size = check_size;
+  if (expected_size) {
+    long_read->data  = g_try_malloc(expected_size);
+    long_read->alloc = long_read->data ? expected_size : 0;
+  }
+  return long_read;
+}
+
+void bl_long_read_free(bl_long_read_t *long_read)
+{
+  if (long_read == NULL)
+    return;
+
+  g_free(long_read->data);
+  g_free(long_read);
+}
+
+const uint8_t *bl_long_read_get_data(bl_long_read_t *long_read, size_t *size)
+{
+  if (size)
+    *size = long_read->size;
+  return long_read->data;
+}
+
+gboolean bl_long_read_is_complete(bl_long_read_t *long_read)
+{
+  return long_read->complete;
+}
+
+// One Read or Read Blob of the long read into buf of size bytes. The size
+// of the part read is returned in value_size.
+static int long_read_part(bl_ctx_t *ctx, bl_long_read_t *long_read,
+    uint16_t offset, uint8_t *buf, size_t size, size_t *value_size)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  int       ret;
+
+  NEW_REQ;
+  req->buf      = buf;
+  req->buf_size = size;
+  if (send_read_blob(long_read->handle, offset, req, &gerr)) {
+    ret = wait_for_cb(req, NULL, NULL);
+    // The end of a value of a multiple of the part size
+    if (ret && offset && ((req->att_status == ATT_ECODE_ATTR_NOT_LONG) ||
+          (req->att_status == ATT_ECODE_INVALID_OFFSET))) {
+      req->value_size = 0;
+      ret = BL_NO_ERROR;
+    }
+    *value_size = MIN(req->value_size, size);
+  } else {
+    printf("Error: %s", gerr->message);
+    ret = gerr->code;
+    g_error_free(gerr);
+  }
+exit:
+  req_unref(req);
+  return ret;
+}
+
+// Check that the first bytes of the value didn't change since the part read
+// before, else the long read starts again.
+static int long_read_check(bl_ctx_t *ctx, bl_long_read_t *long_read,
+    size_t mtu)
+{
+  size_t  n = MIN(MIN(long_read->check_size, long_read->size), mtu - 1);
+  uint8_t first[MAX(n, 1)];
+  size_t  size = 0;
+  int     ret;
+
+  if (n == 0)
+    return BL_NO_ERROR;
+
+  ret = long_read_part(ctx, long_read, 0, first, n, &size);
+  if (ret == BL_NO_ERROR &&
+      ((size < n) || memcmp(first, long_read->data, n)))
+    long_read->size = 0;
+  return ret;
+}
+
+int bl_ctx_long_read_run(bl_ctx_t *ctx, bl_long_read_t *long_read)
+{
+  size_t mtu;
+  int    ret = BL_NO_ERROR;
+
+  if (long_read == NULL)
+    return BL_MISSING_ARGUMENT_ERROR;
+  BLUELIB_ENTER;
+  if (long_read->complete)
+    goto exit;
+  ASSERT_CONNECTED;
+
+  g_attrib_get_buffer(ctx->attrib, &mtu);
+  ret = long_read_check(ctx, long_read, mtu);
+  while ((ret == BL_NO_ERROR) && !long_read->complete) {
+    size_t part = 0;
+
+    // Room for a whole part, the buffer grows geometrically
+    if (long_read->alloc - long_read->size < mtu - 1) {
+      size_t   alloc = MAX(long_read->alloc * 2, long_read->size + mtu - 1);
+      uint8_t *data  = g_try_realloc(long_read->data, alloc);
+
+      if (data == NULL) {
+        ret = BL_MALLOC_ERROR;
+        break;
+      }
+      long_read->data  = data;
+      long_read->alloc = alloc;
+    }
+
+    ret = long_read_part(ctx, long_read, long_read->size,
+        long_read->data + long_read->size, mtu - 1, &part);
+    if (ret)
+      break;
+    long_read->size += part;
+    // A short part ends the value, as the limit of the Read Blob offset
+    long_read->complete = (part < mtu - 1) ||
+      (long_read->size + mtu - 1 > G_MAXUINT16);
+  }
+exit:
+  BLUELIB_EXIT;
+}
+
+
+/************************* Read characteristic value ***********************/
+// Read by handle.
+static bl_value_t *read_by_hnd(bl_ctx_t *ctx, uint16_t handle, char *uuid_str,
+    GError **gerr)
+{
+  bl_value_t *ret = NULL;
+  bl_req_t   *req = NULL;
+  *gerr = NULL;
+
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  NEW_REQ_GERR;
+
+  if (send_read_by_hnd(handle, uuid_str, 0, req, gerr))
+    wait_for_cb(req, (void **) &ret, gerr);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Asynchronous read by handle.
+static guint read_by_hnd_async(bl_ctx_t *ctx, uint16_t handle, char *uuid_str,
+    bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  NEW_REQ_ASYNC(bl_value_free);
+
+  if (send_read_by_hnd(handle, uuid_str, 0, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+// Read all the characteristics value associated to this UUID.
+// Return a list of values (bl_value_t *).
+GSList *bl_ctx_read_char_all(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  GSList   *ret = NULL;
+  bl_req_t *req = NULL;
+
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  NEW_REQ_GERR;
+
+  if (send_read_by_uuid(uuid_str, bl_primary, req, gerr))
+    wait_for_cb(req, (void **) &ret, gerr);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Asynchronous equivalent of bl_read_char_all.
+guint bl_ctx_read_char_all_async(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  NEW_REQ_ASYNC(bl_value_list_free);
+
+  if (send_read_by_uuid(uuid_str, bl_primary, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+// Read a characteristic value by UUID on a primary service.
+bl_value_t *bl_ctx_read_char(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  CLEAR_GERROR;
+  bl_value_t *ret           = NULL;
+  GSList     *bl_value_list = bl_ctx_read_char_all(ctx, uuid_str,
+      bl_primary, gerr);
+
+  if (*gerr || (!bl_value_list) || (!bl_value_list->data))
+    return NULL;
+
+  if (bl_value_list->next) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_UNICITY_ERROR,
+        "Characteristic not unique\n");
+    PROPAGATE_ERROR;
+    bl_value_list_free(bl_value_list);
+    return NULL;
+  }
+
+  if (bl_value_list->data)
+    ret = bl_value_cpy(bl_value_list->data);
+  bl_value_list_free(bl_value_list);
+  return ret;
+}
+
+// Equivalent to bl_read_char but supplying the blob reading.
+bl_value_t *bl_ctx_read_char_blob(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  bl_char_t *bl_char = bl_ctx_get_char(ctx, uuid_str, bl_primary, gerr);
+
+  if (*gerr || !bl_char)
+    return NULL;
+
+  bl_value_t *ret = bl_ctx_read_char_by_char(ctx, bl_char, gerr);
+  bl_char_free(bl_char);
+  return ret;
+}
+
+// Equivalent to bl_read_char_all but supplying the blob reading.
+// Return a list of values (bl_value_t *).
+GSList *bl_ctx_read_char_all_blob(bl_ctx_t *ctx, char *uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  GSList     *list = bl_ctx_get_all_char(ctx, uuid_str, bl_primary, gerr);
+  bl_batch_t *batch;
+
+  if (*gerr || !list)
+    return NULL;
+
+  batch = bl_ctx_batch_new(ctx);
+  for (GSList *l = list; l && l->data; l = l->next) {
+    bl_char_t *bl_char = l->data;
+    bl_batch_add_read(batch, bl_char->value_handle, bl_char->uuid_str);
+  }
+  list = read_list_by_batch(batch, list, gerr);
+  bl_batch_free(batch);
+  return list;
+}
+
+// Read a characteristic value of a characteristic.
+bl_value_t *bl_ctx_read_char_by_char(bl_ctx_t *ctx, bl_char_t *bl_char,
+    GError **gerr)
+{
+  return read_by_hnd(ctx, bl_char->value_handle, bl_char->uuid_str, gerr);
+}
+
+// Asynchronous equivalent of bl_read_char_by_char.
+guint bl_ctx_read_char_by_char_async(bl_ctx_t *ctx, bl_char_t *bl_char,
+    bl_async_cb_t func, void *user_data)
+{
+  return read_by_hnd_async(ctx, bl_char->value_handle, bl_char->uuid_str, func,
+      user_data);
+}
+
+// Read the value of a handle into buf, see bl_read_into.
+int bl_ctx_read_into(bl_ctx_t *ctx, uint16_t handle, uint8_t *buf,
+    size_t size, size_t *value_size)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  int       ret;
+
+  BLUELIB_ENTER;
+  ASSERT_CONNECTED;
+  if ((buf == NULL) && size) {
+    printf("Error: Buffer needed\n");
+    ret = BL_MISSING_ARGUMENT_ERROR;
+    goto exit;
+  }
+  NEW_REQ;
+  req->buf      = buf;
+  req->buf_size = size;
+
+  // A plain Read: the value is not gathered in a buffer of gatt.c
+  if (send_read_blob(handle, 0, req, &gerr)) {
+    ret = wait_for_cb(req, NULL, NULL);
+    if ((ret == BL_NO_ERROR) && value_size)
+      *value_size = req->value_size;
+  } else {
+    printf("Error: %s", gerr->message);
+    ret = gerr->code;
+    g_error_free(gerr);
+  }
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Read a long value in a buffer of expected_size, see bl_read_long.
+bl_value_t *bl_ctx_read_long(bl_ctx_t *ctx, uint16_t handle,
+    size_t expected_size, GError **gerr)
+{
+  bl_value_t *ret = NULL;
+  bl_req_t   *req = NULL;
+
+  CLEAR_GERROR;
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+  NEW_REQ_GERR;
+
+  if (send_read_by_hnd(handle, NULL, expected_size, req, gerr))
+    wait_for_cb(req, (void **) &ret, gerr);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Read a value part by part, see bl_read_stream.
+int bl_ctx_read_stream(bl_ctx_t *ctx, uint16_t handle, bl_chunk_cb_t chunk_func,
+    void *user_data, size_t *value_size)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  int       ret;
+
+  BLUELIB_ENTER;
+  ASSERT_CONNECTED;
+  if (chunk_func == NULL) {
+    printf("Error: Chunk callback needed\n");
+    ret = BL_MISSING_ARGUMENT_ERROR;
+    goto exit;
+  }
+  NEW_REQ;
+
+  req->chunk_func = chunk_func;
+  req->user_data  = user_data;
+  if (send_read_stream(handle, req, &gerr)) {
+    ret = wait_for_cb(req, NULL, NULL);
+    if ((ret == BL_NO_ERROR) && value_size)
+      *value_size = req->value_size;
+  } else {
+    printf("Error: %s", gerr->message);
+    ret = gerr->code;
+    g_error_free(gerr);
+  }
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Read Multiple Variable Length requests until all the handles are read, each
+// with as many handles as the MTU allows. done is the number of values read,
+// it stops early on an ATT error: the device doesn't support the request, or
+// one of the handles can't be read. The rest is left to plain reads.
+static GSList *read_multi(bl_ctx_t *ctx, uint16_t *handles, int n, int *done,
+    GError **gerr)
+{
+  GSList   *ret = NULL;
+  bl_req_t *req = NULL;
+
+  BLUELIB_ENTER_GERR;
+  ASSERT_CONNECTED_GERR;
+
+  // A single handle is a plain read
+  while (!ctx->no_read_multi_var && (*done < n - 1)) {
+    GSList *list = NULL;
+
+    req_unref(req);
+    NEW_REQ_GERR;
+    if (!send_read_multi(handles + *done, n - *done, req, gerr))
+      break;
+    if (wait_for_cb(req, (void **) &list, gerr)) {
+      if (req->att_status) {
+        if (req->att_status == ATT_ECODE_REQ_NOT_SUPP)
+          ctx->no_read_multi_var = TRUE;
+        CLEAR_GERROR;
+      }
+      break;
+    }
+    *done += g_slist_length(list);
+    ret = g_slist_concat(ret, list);
+  }
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Read the handles by a batch, gerr is set by the first error.
+static GSList *read_handles_by_batch(bl_ctx_t *ctx, uint16_t *handles, int n,
+    GError **gerr)
+{
+  GSList            *ret   = NULL;
+  bl_batch_t        *batch = bl_ctx_batch_new(ctx);
+  bl_batch_result_t *results;
+
+  for (int i = 0; i < n; i++)
+    bl_batch_add_read(batch, handles[i], NULL);
+  results = bl_batch_run(batch, gerr);
+  for (int i = 0; results && (i < n) && !*gerr; i++) {
+    if (results[i].status) {
+      GError *err = g_error_new(BL_ERROR_DOMAIN, results[i].status,
+          "Read error\n");
+      PROPAGATE_ERROR;
+      break;
+    }
+    ret = g_slist_prepend(ret, results[i].value);
+    results[i].value = NULL;
+  }
+  bl_batch_free(batch);
+  return g_slist_reverse(ret);
+}
+
+// Read the values of several handles, see bl_read_multiple.
+GSList *bl_ctx_read_multiple(bl_ctx_t *ctx, uint16_t *handles, int n,
+    GError **gerr)
+{
+  GSList *ret  = NULL;
+  int     done = 0;
+
+  CLEAR_GERROR;
+  if ((handles == NULL) || (n <= 0)) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MISSING_ARGUMENT_ERROR,
+        "Handles needed\n");
+    PROPAGATE_ERROR;
+    return NULL;
+  }
+
+  ret = read_multi(ctx, handles, n, &done, gerr);
+  // Left to plain reads without support of the device, or after an ATT
+  // error, to find the handle which can't be read
+  if ((*gerr == NULL) && (done < n))
+    ret = g_slist_concat(ret, read_handles_by_batch(ctx, handles + done,
+          n - done, gerr));
+  if (*gerr) {
+    bl_value_list_free(ret);
+    return NULL;
+  }
+  return ret;
+}
+
+/******************************* Read descriptor ***************************/
+// Read a descriptor of a characteristic by UUID on a primary service.
+bl_value_t *bl_ctx_read_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, char *desc_uuid_str, GError **gerr)
+{
+  bl_desc_t *bl_desc = bl_ctx_get_desc(ctx, char_uuid_str, bl_primary,
+      desc_uuid_str, gerr);
+
+  if (*gerr || !bl_desc)
+    return NULL;
+
+  bl_value_t *ret = read_by_hnd(ctx, bl_desc->handle, NULL, gerr);
+  bl_desc_free(bl_desc);
+  return ret;
+}
+
+// Read all the descriptors of a characteristic by UUID on a primary service.
+// Return a list of values (bl_value_t *).
+GSList *bl_ctx_read_all_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, GError **gerr)
+{
+  GSList     *list = bl_ctx_get_all_desc(ctx, char_uuid_str, bl_primary,
+      gerr);
+  bl_batch_t *batch;
+
+  if (*gerr || !list)
+    return NULL;
+
+  batch = bl_ctx_batch_new(ctx);
+  for (GSList *l = list; l && l->data; l = l->next) {
+    bl_desc_t *bl_desc = l->data;
+    bl_batch_add_read(batch, bl_desc->handle, NULL);
+  }
+  list = read_list_by_batch(batch, list, gerr);
+  bl_batch_free(batch);
+  return list;
+}
+
+// Read descriptor by descriptor.
+bl_value_t *bl_ctx_read_desc_by_desc(bl_ctx_t *ctx, bl_desc_t *bl_desc,
+    GError **gerr)
+{
+  return read_by_hnd(ctx, bl_desc->handle, NULL, gerr);
+}
+
+// Asynchronous equivalent of bl_read_desc_by_desc.
+guint bl_ctx_read_desc_by_desc_async(bl_ctx_t *ctx, bl_desc_t *bl_desc,
+    bl_async_cb_t func, void *user_data)
+{
+  return read_by_hnd_async(ctx, bl_desc->handle, NULL, func, user_data);
+}
+
+// Read descriptor by characteristic.
+// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
+// to search, but the result is the same with or without.
+bl_value_t *bl_ctx_read_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr)
+{
+  bl_desc_t *bl_desc = bl_ctx_get_desc_by_char(ctx, start_bl_char, end_bl_char,
+      bl_primary, desc_uuid_str, gerr);
+
+  if (*gerr || !bl_desc)
+    return NULL;
+
+  bl_value_t *ret = bl_ctx_read_desc_by_desc(ctx, bl_desc, gerr);
+  bl_desc_free(bl_desc);
+  return ret;
+}
+
+
+/************************ Write characteristic value ***********************/
+// Write a characteristic by handle.
+static int write_by_hnd(bl_ctx_t *ctx, uint16_t handle, uint8_t *value,
+    size_t size, int type)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  int       ret;
+
+  BLUELIB_ENTER;
+  ASSERT_CONNECTED;
+  NEW_REQ;
+
+  if (send_write(handle, value, size, type, req, &gerr)) {
+    ret = wait_for_cb(req, NULL, NULL);
+  } else {
+    printf("Error: %s", gerr->message);
+    ret = gerr->code;
+    g_error_free(gerr);
+  }
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+// Asynchronous write by handle.
+static guint write_by_hnd_async(bl_ctx_t *ctx, uint16_t handle, uint8_t *value,
+    size_t size, int type, bl_async_cb_t func, void *user_data)
+{
+  GError   *gerr = NULL;
+  bl_req_t *req  = NULL;
+  guint     ret  = 0;
+
+  BLUELIB_ENTER_ASYNC;
+  ASSERT_CONNECTED_ASYNC;
+  NEW_REQ_ASYNC(NULL);
+
+  if (send_write(handle, value, size, type, req, &gerr))
+    ret = req->id;
+exit:
+  BLUELIB_EXIT_ASYNC;
+}
+
+// Write a characteristic value by UUID on a primary service
+int bl_ctx_write_char(bl_ctx_t *ctx, char *uuid_str, bl_primary_t *bl_primary,
+    uint8_t *value, size_t size, int type)
+{
+  int ret;
+  GError *gerr = NULL;
+  bl_char_t *bl_char= bl_ctx_get_char(ctx, uuid_str, bl_primary, &gerr);
+
+  if (gerr) {
+    printf("Error: %s\n", gerr->message);
+    ret = gerr->code;
+    g_error_free(gerr);
+    goto exit;
+  }
+
+  if (!bl_char) {
+    printf("Error: No characteristic found\n");
+    return EINVAL;
+  }
+
+  ret = write_by_hnd(ctx, bl_char->value_handle, value, size, type);
+exit:
+  if (bl_char)
+    bl_char_free(bl_char);
+  return ret;
+}
+
+// Write a characteristic value by characteristic.
+int bl_ctx_write_char_by_char(bl_ctx_t *ctx, bl_char_t *bl_char, uint8_t *value,
+    size_t size, int type)
+{
+  return write_by_hnd(ctx, bl_char->value_handle, value, size, type);
+}
+
+// Asynchronous equivalent of bl_write_char_by_char.
+guint bl_ctx_write_char_by_char_async(bl_ctx_t *ctx, bl_char_t *bl_char,
+    uint8_t *value, size_t size, int type, bl_async_cb_t func, void *user_data)
+{
+  return write_by_hnd_async(ctx, bl_char->value_handle, value, size, type, func,
+      user_data);
+}
+
+
+/**************************** Write descriptor *****************************/
+// Write a descriptor of a characteristic by UUID on a primary service.
+int bl_ctx_write_desc(bl_ctx_t *ctx, char *char_uuid_str,
+    bl_primary_t *bl_primary, char *desc_uuid_str, uint8_t *value, size_t size)
+{
+  int ret;
+  GError *gerr = NULL;
+  bl_desc_t *bl_desc = bl_ctx_get_desc(ctx, char_uuid_str, bl_primary,
+      desc_uuid_str, &gerr);
+
+  if (gerr) {
+    printf("Error: %s\n", gerr->message);
+    ret = gerr->code;
+    g_error_free(gerr);
+    goto exit;
+  }
+
+  if (!bl_desc) {
+    printf("Error: No descriptor found\n");
+    return EINVAL;
+  }
+
+  ret = write_by_hnd(ctx, bl_desc->handle, value, size, WRITE_REQ);
+exit:
+  if (bl_desc)
+    bl_desc_free(bl_desc);
+  return ret;
+}
+
+// Write descriptor by bl_desc_t.
+int bl_ctx_write_desc_by_desc(bl_ctx_t *ctx, bl_desc_t *bl_desc, uint8_t *value,
+    size_t size)
+{
+  return write_by_hnd(ctx, bl_desc->handle, value, size, WRITE_REQ);
+}
+
+// Asynchronous equivalent of bl_write_desc_by_desc.
+guint bl_ctx_write_desc_by_desc_async(bl_ctx_t *ctx, bl_desc_t *bl_desc,
+    uint8_t *value, size_t size, bl_async_cb_t func, void *user_data)
+{
+  return write_by_hnd_async(ctx, bl_desc->handle, value, size, WRITE_REQ, func,
+      user_data);
+}
+
+// Write a descriptor on a characteristic.
+// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
+// to search, but the result is the same with or without.
+int bl_ctx_write_desc_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    uint8_t *value, size_t size)
+{
+  GError *gerr;
+  bl_desc_t *bl_desc = bl_ctx_get_desc_by_char(ctx, start_bl_char, end_bl_char,
+      bl_primary, desc_uuid_str, &gerr);
+  if (gerr || !bl_desc)
+    return EINVAL;
+  int ret = bl_ctx_write_desc_by_desc(ctx, bl_desc, value, size);
+  bl_desc_free(bl_desc);
+  return ret;
+}
+
+
+/***************************** Cancel a request ****************************/
+int bl_ctx_cancel(bl_ctx_t *ctx, guint id)
+{
+  bl_req_t *to_complete = NULL;
+  int       ret;
+
+  BLUELIB_ENTER;
+  ASSERT_CONNECTED;
+
+  ret = req_cancel(ctx, id, &to_complete);
+exit:
+  g_mutex_unlock(&ctx->mutex);
+  // The user callback may call bluelib again
+  if (to_complete)
+    req_complete(to_complete);
+  return ret;
+}
+
+
+/*************************** Set security level ****************************/
+// Default: low
+int bl_ctx_change_sec_level(bl_ctx_t *ctx, int level)
+{
+  GError *gerr = NULL;
+  BtIOSecLevel sec_level;
+  int ret;
+
+  BLUELIB_ENTER;
+  ASSERT_CONNECTED;
+
+  if (ctx->opt_sec_level)
+    g_free(ctx->opt_sec_level);
+  if (level == SECURITY_LEVEL_HIGH) {
+    sec_level = BT_IO_SEC_HIGH;
+    ctx->opt_sec_level = g_strdup("high");
+  }  else if (level == SECURITY_LEVEL_MEDIUM) {
+    sec_level = BT_IO_SEC_MEDIUM;
+    ctx->opt_sec_level = g_strdup("medium");
+  }  else {
+    sec_level = BT_IO_SEC_LOW;
+    ctx->opt_sec_level = g_strdup("low");
+  }
+
+  if (ctx->opt_psm) {
+    printf("Change will take effect on reconnection\n");
+    ret = BL_RECONNECTION_NEEDED_ERROR;
+    goto exit;
+  }
+
+  bt_io_set(ctx->iochannel, &gerr, BT_IO_OPT_SEC_LEVEL, sec_level,
+      BT_IO_OPT_INVALID);
+
+  if (gerr) {
+    printf("Error: %s\n", gerr->message);
+    g_error_free(gerr);
+    return gerr->code;
+  }
+  ret = BL_NO_ERROR;
+exit:
+  BLUELIB_EXIT;
+}
+
+
+/************************* Change MTU for GATT/ATT *************************/
+int bl_ctx_change_mtu(bl_ctx_t *ctx, int value)
+{
+  bl_req_t *req = NULL;
+  int       ret;
+
+  BLUELIB_ENTER;
+  ASSERT_CONNECTED;
+
+  if (ctx->opt_psm) {
+    printf("Error: Operation is only available for LE transport.\n");
+    ret = BL_LE_ONLY_ERROR;
+  goto exit;
+  }
 
-  // Initialisation to default range.
-  uint16_t start_handle;
-  uint16_t end_handle;
-
-  if (handle_assert(&start_handle, &end_handle, bl_primary, gerr))
+  if (ctx->opt_mtu) {
+    printf("Error: MTU exchange can only occur once per connection.\n");
+    ret = BL_MTU_ALREADY_EXCHANGED_ERROR;
+    goto exit;
+  }
+
+  errno = 0;
+  ctx->opt_mtu = value;
+  if (errno != 0 || ctx->opt_mtu < ATT_DEFAULT_LE_MTU) {
+    printf("Error: Invalid value. Minimum MTU size is %d\n",
+        ATT_DEFAULT_LE_MTU);
+    ret = EINVAL;
+    goto exit;
+  }
+  NEW_REQ;
+  if (!gatt_exchange_mtu(ctx->attrib, ctx->opt_mtu, exchange_mtu_cb, req)) {
+    printf("Error: Unable to send request\n");
+    ret = BL_SEND_REQUEST_ERROR;
+    req_complete(req);
     goto exit;
+  }
+
+  ret = wait_for_cb(req, NULL, NULL);
+exit:
+  req_unref(req);
+  BLUELIB_EXIT;
+}
+
+
+/***************************** Default context *****************************/
+// The functions without ctx work on the context set by bl_init.
+conn_state_t get_conn_state(void)
+{
+  return bl_ctx_get_conn_state(default_ctx);
+}
+
+int bl_connect(char *mac_dst, char *dst_type)
+{
+  return bl_ctx_connect(default_ctx, mac_dst, dst_type);
+}
+
+int bl_disconnect(void)
+{
+  return bl_ctx_disconnect(default_ctx);
+}
+
+int bl_set_connect_cb(user_cb_fct_t func)
+{
+  return bl_ctx_set_connect_cb(default_ctx, func);
+}
+
+int bl_set_main_context(GMainContext *context)
+{
+  return bl_ctx_set_main_context(default_ctx, context);
+}
+
+int bl_set_inline(int busy_poll_us)
+{
+  return bl_ctx_set_inline(default_ctx, busy_poll_us);
+}
+
+bl_batch_t *bl_batch_new(void)
+{
+  return bl_ctx_batch_new(default_ctx);
+}
+
+int bl_long_read_run(bl_long_read_t *long_read)
+{
+  return bl_ctx_long_read_run(default_ctx, long_read);
+}
+
+guint bl_poll_add(uint16_t handle, guint period_ms, bl_poll_cb_t func,
+    void *user_data)
+{
+  return bl_ctx_poll_add(default_ctx, handle, period_ms, func, user_data);
+}
+
+int bl_poll_remove(guint id)
+{
+  return bl_ctx_poll_remove(default_ctx, id);
+}
+
+int bl_get_poll_stats(bl_poll_stats_t *stats)
+{
+  return bl_ctx_get_poll_stats(default_ctx, stats);
+}
+
+int bl_set_timeout(int timeout_ms)
+{
+  return bl_ctx_set_timeout(default_ctx, timeout_ms);
+}
+
+int bl_get_timeout(void)
+{
+  return bl_ctx_get_timeout(default_ctx);
+}
+
+int bl_get_fd(GError **gerr)
+{
+  return bl_ctx_get_fd(default_ctx, gerr);
+}
+
+int bl_dispatch(void)
+{
+  return bl_ctx_dispatch(default_ctx);
+}
+
+int bl_set_cache_dir(const char *dir)
+{
+  return bl_ctx_set_cache_dir(default_ctx, dir);
+}
+
+int bl_clear_cache(void)
+{
+  return bl_ctx_clear_cache(default_ctx);
+}
+
+int bl_get_cache_stats(bl_cache_stats_t *stats)
+{
+  return bl_ctx_get_cache_stats(default_ctx, stats);
+}
+
+int bl_set_layout_sharing(gboolean enable, const char *key_uuids)
+{
+  return bl_ctx_set_layout_sharing(default_ctx, enable, key_uuids);
+}
+
+bl_database_t *bl_get_database(GError **gerr)
+{
+  return bl_ctx_get_database(default_ctx, gerr);
+}
+
+int bl_lookup_handle(uint16_t handle, bl_primary_t **bl_primary,
+    bl_char_t **bl_char)
+{
+  return bl_ctx_lookup_handle(default_ctx, handle, bl_primary, bl_char);
+}
+
+GSList *bl_lookup_range(uint16_t start, uint16_t end, GError **gerr)
+{
+  return bl_ctx_lookup_range(default_ctx, start, end, gerr);
+}
+
+int bl_get_connect_timings(bl_connect_timings_t *timings)
+{
+  return bl_ctx_get_connect_timings(default_ctx, timings);
+}
+
+GSList *bl_get_all_primary(char *uuid_str, GError **gerr)
+{
+  return bl_ctx_get_all_primary(default_ctx, uuid_str, gerr);
+}
+
+guint bl_get_all_primary_async(char *uuid_str, bl_async_cb_t func,
+    void *user_data)
+{
+  return bl_ctx_get_all_primary_async(default_ctx, uuid_str, func, user_data);
+}
+
+bl_primary_t *bl_get_primary(char *uuid_str, GError **gerr)
+{
+  return bl_ctx_get_primary(default_ctx, uuid_str, gerr);
+}
+
+GSList *bl_get_all_primary_device(GError **gerr)
+{
+  return bl_ctx_get_all_primary_device(default_ctx, gerr);
+}
+
+GSList *bl_get_included(bl_primary_t *bl_primary, GError **gerr)
+{
+  return bl_ctx_get_included(default_ctx, bl_primary, gerr);
+}
+
+guint bl_get_included_async(bl_primary_t *bl_primary, bl_async_cb_t func,
+    void *user_data)
+{
+  return bl_ctx_get_included_async(default_ctx, bl_primary, func, user_data);
+}
+
+GSList *bl_get_all_char(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  return bl_ctx_get_all_char(default_ctx, uuid_str, bl_primary, gerr);
+}
+
+guint bl_get_all_char_async(char *uuid_str, bl_primary_t *bl_primary,
+    bl_async_cb_t func, void *user_data)
+{
+  return bl_ctx_get_all_char_async(default_ctx, uuid_str, bl_primary, func,
+      user_data);
+}
+
+bl_char_t *bl_get_char(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  return bl_ctx_get_char(default_ctx, uuid_str, bl_primary, gerr);
+}
+
+GSList *bl_get_all_char_in_primary(bl_primary_t *bl_primary, GError **gerr)
+{
+  return bl_ctx_get_all_char_in_primary(default_ctx, bl_primary, gerr);
+}
+
+GSList *bl_get_all_desc_by_char(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GError **gerr)
+{
+  return bl_ctx_get_all_desc_by_char(default_ctx, start_bl_char, end_bl_char,
+      bl_primary, gerr);
+}
+
+GSList *bl_get_all_desc_in_primary(bl_primary_t *bl_primary,
+    GSList *bl_char_list, GError **gerr)
+{
+  return bl_ctx_get_all_desc_in_primary(default_ctx, bl_primary, bl_char_list,
+      gerr);
+}
+
+guint bl_get_all_desc_by_char_async(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, bl_async_cb_t func,
+    void *user_data)
+{
+  return bl_ctx_get_all_desc_by_char_async(default_ctx, start_bl_char,
+      end_bl_char, bl_primary, func, user_data);
+}
+
+bl_primary_t *bl_find_primary(char *uuid_str, GError **gerr)
+{
+  return bl_ctx_find_primary(default_ctx, uuid_str, gerr);
+}
+
+bl_char_t *bl_find_char(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  return bl_ctx_find_char(default_ctx, uuid_str, bl_primary, gerr);
+}
+
+bl_desc_t *bl_find_desc_by_char(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr)
+{
+  return bl_ctx_find_desc_by_char(default_ctx, start_bl_char, end_bl_char,
+      bl_primary, desc_uuid_str, gerr);
+}
+
+bl_desc_t *bl_get_cccd(bl_char_t *bl_char, GError **gerr)
+{
+  return bl_ctx_get_cccd(default_ctx, bl_char, gerr);
+}
+
+guint bl_get_all_primary_stream(bl_page_cb_t page_func, bl_async_cb_t func,
+    void *user_data)
+{
+  return bl_ctx_get_all_primary_stream(default_ctx, page_func, func,
+      user_data);
+}
 
-  bt_uuid_t uuid;
-  bt_string_to_uuid(&uuid, uuid_str);
+guint bl_get_all_char_stream(bl_primary_t *bl_primary, bl_page_cb_t page_func,
+    bl_async_cb_t func, void *user_data)
+{
+  return bl_ctx_get_all_char_stream(default_ctx, bl_primary, page_func, func,
+      user_data);
+}
 
-  if (!gatt_read_char_by_uuid(attrib, start_handle, end_handle, &uuid,
-                              read_by_uuid_cb, NULL)) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_SEND_REQUEST_ERROR,
-        "Unable to send request\n");
-    PROPAGATE_ERROR;
-    goto exit;
-  }
+guint bl_get_all_desc_by_char_stream(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, bl_page_cb_t page_func,
+    bl_async_cb_t func, void *user_data)
+{
+  return bl_ctx_get_all_desc_by_char_stream(default_ctx, start_bl_char,
+      end_bl_char, bl_primary, page_func, func, user_data);
+}
 
-  wait_for_cb((void **) &ret, gerr);
+GSList *bl_get_all_desc(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  return bl_ctx_get_all_desc(default_ctx, uuid_str, bl_primary, gerr);
+}
 
-  if (ret) {
-    // Add the value of the UUID to each of the values
-    for (GSList *l = ret; l; l = l->next) {
-      strcpy(((bl_value_t *)(l->data))->uuid_str, uuid_str);
-    }
-  }
-exit:
-  BLUELIB_EXIT;
+bl_desc_t *bl_get_desc_by_char(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
+    GError **gerr)
+{
+  return bl_ctx_get_desc_by_char(default_ctx, start_bl_char, end_bl_char,
+      bl_primary, desc_uuid_str, gerr);
 }
 
-// Read a characteristic value by UUID on a primary service.
-bl_value_t *bl_read_char(char *uuid_str, bl_primary_t *bl_primary, GError **gerr)
+bl_desc_t *bl_get_desc(char *char_uuid_str, bl_primary_t *bl_primary,
+    char *desc_uuid_str, GError **gerr)
 {
-  CLEAR_GERROR;
-  bl_value_t *ret           = NULL;
-  GSList     *bl_value_list = bl_read_char_all(uuid_str, bl_primary, gerr);
+  return bl_ctx_get_desc(default_ctx, char_uuid_str, bl_primary, desc_uuid_str,
+      gerr);
+}
 
-  if (*gerr || (!bl_value_list) || (!bl_value_list->data))
-    return NULL;
+GSList *bl_read_char_all(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  return bl_ctx_read_char_all(default_ctx, uuid_str, bl_primary, gerr);
+}
 
-  if (bl_value_list->next) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_UNICITY_ERROR,
-        "Characteristic not unique\n");
-    PROPAGATE_ERROR;
-    bl_value_list_free(bl_value_list);
-    return NULL;
-  }
+guint bl_read_char_all_async(char *uuid_str, bl_primary_t *bl_primary,
+    bl_async_cb_t func, void *user_data)
+{
+  return bl_ctx_read_char_all_async(default_ctx, uuid_str, bl_primary, func,
+      user_data);
+}
 
-  if (bl_value_list->data)
-    ret = bl_value_cpy(bl_value_list->data);
-  bl_value_list_free(bl_value_list);
-  return ret;
+bl_value_t *bl_read_char(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  return bl_ctx_read_char(default_ctx, uuid_str, bl_primary, gerr);
 }
 
-// Equivalent to bl_read_char but supplying the blob reading.
 bl_value_t *bl_read_char_blob(char *uuid_str, bl_primary_t *bl_primary,
     GError **gerr)
 {
-  bl_char_t *bl_char = bl_get_char(uuid_str, bl_primary, gerr);
+  return bl_ctx_read_char_blob(default_ctx, uuid_str, bl_primary, gerr);
+}
 
-  if (*gerr || !bl_char)
-    return NULL;
+bl_value_t *bl_read_long(uint16_t handle, size_t expected_size, GError **gerr)
+{
+  return bl_ctx_read_long(default_ctx, handle, expected_size, gerr);
+}
 
-  bl_value_t *ret = bl_read_char_by_char(bl_char, gerr);
-  bl_char_free(bl_char);
-  return ret;
+int bl_read_stream(uint16_t handle, bl_chunk_cb_t chunk_func, void *user_data,
+    size_t *value_size)
+{
+  return bl_ctx_read_stream(default_ctx, handle, chunk_func, user_data,
+      value_size);
 }
 
-// Equivalent to bl_read_char_all but supplying the blob reading.
-// Return a list of values (bl_value_t *).
-GSList *bl_read_char_all_blob(char *uuid_str, bl_primary_t *bl_primary,
-    GError **gerr)
+int bl_read_into(uint16_t handle, uint8_t *buf, size_t size,
+    size_t *value_size)
 {
-  GSList *list = bl_get_all_char(uuid_str, bl_primary, gerr);
+  return bl_ctx_read_into(default_ctx, handle, buf, size, value_size);
+}
 
-  if (*gerr || !list)
-    return NULL;
+GSList *bl_read_multiple(uint16_t *handles, int n, GError **gerr)
+{
+  return bl_ctx_read_multiple(default_ctx, handles, n, gerr);
+}
 
-  for (GSList *l = list; l && l->data; l = l->next) {
-    bl_value_t *bl_value = bl_read_char_by_char(l->data, gerr);
-    bl_char_free(l->data);
-    l->data = bl_value;
-  }
-  return list;
+GSList *bl_read_char_all_blob(char *uuid_str, bl_primary_t *bl_primary,
+    GError **gerr)
+{
+  return bl_ctx_read_char_all_blob(default_ctx, uuid_str, bl_primary, gerr);
 }
 
-// Read a characteristic value of a characteristic.
 bl_value_t *bl_read_char_by_char(bl_char_t *bl_char, GError **gerr)
 {
-  bl_value_t *bl_value = read_by_hnd(bl_char->value_handle, gerr);
-
-  if (!bl_value)
-    return NULL;
-
-  // Add UUID to value
-  strcpy(bl_value->uuid_str, bl_char->uuid_str);
+  return bl_ctx_read_char_by_char(default_ctx, bl_char, gerr);
+}
 
-  return bl_value;
+guint bl_read_char_by_char_async(bl_char_t *bl_char, bl_async_cb_t func,
+    void *user_data)
+{
+  return bl_ctx_read_char_by_char_async(default_ctx, bl_char, func, user_data);
 }
 
-/******************************* Read descriptor ***************************/
-// Read a descriptor of a characteristic by UUID on a primary service.
 bl_value_t *bl_read_desc(char *char_uuid_str, bl_primary_t *bl_primary,
     char *desc_uuid_str, GError **gerr)
 {
-  bl_desc_t *bl_desc = bl_get_desc(char_uuid_str, bl_primary,
+  return bl_ctx_read_desc(default_ctx, char_uuid_str, bl_primary,
       desc_uuid_str, gerr);
-
-  if (*gerr || !bl_desc)
-    return NULL;
-
-  bl_value_t *ret = read_by_hnd(bl_desc->handle, gerr);
-  bl_desc_free(bl_desc);
-  return ret;
 }
 
-// Read all the descriptors of a characteristic by UUID on a primary service.
-// Return a list of values (bl_value_t *).
 GSList *bl_read_all_desc(char *char_uuid_str, bl_primary_t *bl_primary,
     GError **gerr)
 {
-  GSList *list = bl_get_all_desc(char_uuid_str, bl_primary, gerr);
-
-  if (*gerr || !list)
-    return NULL;
-
-  for (GSList *l = list; l && l->data; l = l->next) {
-    bl_value_t *bl_value = bl_read_desc_by_desc(l->data, gerr);
-    bl_desc_free(l->data);
-    l->data = bl_value;
-  }
-  return list;
+  return bl_ctx_read_all_desc(default_ctx, char_uuid_str, bl_primary, gerr);
 }
 
-// Read descriptor by descriptor.
 bl_value_t *bl_read_desc_by_desc(bl_desc_t *bl_desc, GError **gerr)
 {
-  return read_by_hnd(bl_desc->handle, gerr);
+  return bl_ctx_read_desc_by_desc(default_ctx, bl_desc, gerr);
+}
+
+guint bl_read_desc_by_desc_async(bl_desc_t *bl_desc, bl_async_cb_t func,
+    void *user_data)
+{
+  return bl_ctx_read_desc_by_desc_async(default_ctx, bl_desc, func, user_data);
 }
 
-// Read descriptor by characteristic.
-// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
-// to search, but the result is the same with or without.
 bl_value_t *bl_read_desc_by_char(bl_char_t *start_bl_char,
     bl_char_t *end_bl_char, bl_primary_t *bl_primary, char *desc_uuid_str,
     GError **gerr)
 {
-  bl_desc_t *bl_desc = bl_get_desc_by_char(start_bl_char, end_bl_char,
+  return bl_ctx_read_desc_by_char(default_ctx, start_bl_char, end_bl_char,
       bl_primary, desc_uuid_str, gerr);
-
-  if (*gerr || !bl_desc)
-    return NULL;
-
-  bl_value_t *ret = bl_read_desc_by_desc(bl_desc, gerr);
-  bl_desc_free(bl_desc);
-  return ret;
-}
-
-
-/************************ Write characteristic value ***********************/
-// Write a characteristic by handle.
-static int write_by_hnd(uint16_t handle, uint8_t *value, size_t size, int type)
-{
-  int ret;
-
-  BLUELIB_ENTER;
-  ASSERT_CONNECTED;
-
-  if (handle == INVALID_HANDLE) {
-    printf("Error: Invalid handle\n");
-    ret = EINVAL;
-    goto exit;
-  }
-
-  if ((size == 0) || (value == NULL)) {
-    printf("Error: Invalid value\n");
-    ret = EINVAL;
-    goto exit;
-  }
-
-  if (type) {
-    if (!gatt_write_char(attrib, handle, value, size, write_req_cb,
-                         NULL)) {
-      printf("Error: Unable to send request\n");
-      ret = BL_SEND_REQUEST_ERROR;
-      goto exit;
-    }
-    ret = wait_for_cb(NULL, NULL);
-  } else {
-    if (!gatt_write_cmd(attrib, handle, value, size, NULL, NULL)) {
-      printf("Error: Unable to send write cmd\n");
-      ret = BL_SEND_REQUEST_ERROR;
-      goto exit;
-    }
-    ret = BL_NO_ERROR;
-  }
-
-exit:
-  BLUELIB_EXIT;
 }
 
-// Write a characteristic value by UUID on a primary service
 int bl_write_char(char *uuid_str, bl_primary_t *bl_primary, uint8_t
     *value, size_t size, int type)
 {
-  int ret;
-  GError *gerr = NULL;
-  bl_char_t *bl_char= bl_get_char(uuid_str, bl_primary, &gerr);
-
-  if (gerr) {
-    printf("Error: %s\n", gerr->message);
-    ret = gerr->code;
-    g_error_free(gerr);
-    goto exit;
-  }
-
-  if (!bl_char) {
-    printf("Error: No characteristic found\n");
-    return EINVAL;
-  }
-
-  ret = write_by_hnd(bl_char->value_handle, value, size, type);
-exit:
-  if (bl_char)
-    bl_char_free(bl_char);
-  return ret;
+  return bl_ctx_write_char(default_ctx, uuid_str, bl_primary, value, size,
+      type);
 }
 
-// Write a characteristic value by characteristic.
 int bl_write_char_by_char(bl_char_t *bl_char, uint8_t *value, size_t size,
     int type)
 {
-  return write_by_hnd(bl_char->value_handle, value, size, type);
+  return bl_ctx_write_char_by_char(default_ctx, bl_char, value, size, type);
 }
 
+guint bl_write_char_by_char_async(bl_char_t *bl_char, uint8_t *value,
+    size_t size, int type, bl_async_cb_t func, void *user_data)
+{
+  return bl_ctx_write_char_by_char_async(default_ctx, bl_char, value, size,
+      type, func, user_data);
+}
 
-/**************************** Write descriptor *****************************/
-// Write a descriptor of a characteristic by UUID on a primary service.
 int bl_write_desc(char *char_uuid_str, bl_primary_t *bl_primary,
     char *desc_uuid_str, uint8_t *value, size_t size)
 {
-  int ret;
-  GError *gerr = NULL;
-  bl_desc_t *bl_desc = bl_get_desc(char_uuid_str, bl_primary, desc_uuid_str, &gerr);
-
-  if (gerr) {
-    printf("Error: %s\n", gerr->message);
-    ret = gerr->code;
-    g_error_free(gerr);
-    goto exit;
-  }
-
-  if (!bl_desc) {
-    printf("Error: No descriptor found\n");
-    return EINVAL;
-  }
-
-  ret = write_by_hnd(bl_desc->handle, value, size, WRITE_REQ);
-exit:
-  if (bl_desc)
-    bl_desc_free(bl_desc);
-  return ret;
+  return bl_ctx_write_desc(default_ctx, char_uuid_str, bl_primary,
+      desc_uuid_str, value, size);
 }
 
-// Write descriptor by bl_desc_t.
 int bl_write_desc_by_desc(bl_desc_t *bl_desc, uint8_t *value, size_t size)
 {
-  return write_by_hnd(bl_desc->handle, value, size, WRITE_REQ);
+  return bl_ctx_write_desc_by_desc(default_ctx, bl_desc, value, size);
+}
+
+guint bl_write_desc_by_desc_async(bl_desc_t *bl_desc, uint8_t *value,
+    size_t size, bl_async_cb_t func, void *user_data)
+{
+  return bl_ctx_write_desc_by_desc_async(default_ctx, bl_desc, value, size,
+      func, user_data);
 }
 
-// Write a descriptor on a characteristic.
-// Setting end_bl_char avoid uneeded packet by specifying the end of the zone
-// to search, but the result is the same with or without.
 int bl_write_desc_by_char(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
     bl_primary_t *bl_primary, char *desc_uuid_str, uint8_t *value,
     size_t size)
 {
-  GError *gerr;
-  bl_desc_t *bl_desc = bl_get_desc_by_char(start_bl_char, end_bl_char,
-      bl_primary, desc_uuid_str, &gerr);
-  if (gerr || !bl_desc)
-    return EINVAL;
-  int ret = bl_write_desc_by_desc(bl_desc, value, size);
-  bl_desc_free(bl_desc);
-  return ret;
+  return bl_ctx_write_desc_by_char(default_ctx, start_bl_char, end_bl_char,
+      bl_primary, desc_uuid_str, value, size);
 }
 
+int bl_cancel(guint id)
+{
+  return bl_ctx_cancel(default_ctx, id);
+}
 
-/*************************** Set security level ****************************/
-// Default: low
 int bl_change_sec_level(int level)
 {
-  GError *gerr = NULL;
-  BtIOSecLevel sec_level;
-  int ret;
-
-  BLUELIB_ENTER;
-  ASSERT_CONNECTED;
-
-  if (opt_sec_level)
-    g_free(opt_sec_level);
-  if (level == SECURITY_LEVEL_HIGH) {
-    sec_level = BT_IO_SEC_HIGH;
-    opt_sec_level = g_strdup("high");
-  }  else if (level == SECURITY_LEVEL_MEDIUM) {
-    sec_level = BT_IO_SEC_MEDIUM;
-    opt_sec_level = g_strdup("medium");
-  }  else {
-    sec_level = BT_IO_SEC_LOW;
-    opt_sec_level = g_strdup("low");
-  }
-
-  if (opt_psm) {
-    printf("Change will take effect on reconnection\n");
-    ret = BL_RECONNECTION_NEEDED_ERROR;
-    goto exit;
-  }
-
-  bt_io_set(iochannel, &gerr, BT_IO_OPT_SEC_LEVEL, sec_level,
-      BT_IO_OPT_INVALID);
-
-  if (gerr) {
-    printf("Error: %s\n", gerr->message);
-    g_error_free(gerr);
-    return gerr->code;
-  }
-  ret = BL_NO_ERROR;
-exit:
-  BLUELIB_EXIT;
+  return bl_ctx_change_sec_level(default_ctx, level);
 }
 
-
-/************************* Change MTU for GATT/ATT *************************/
 int bl_change_mtu(int value)
 {
-  int ret;
-
-  BLUELIB_ENTER;
-  ASSERT_CONNECTED;
-
-  if (opt_psm) {
-    printf("Error: Operation is only available for LE transport.\n");
-    ret = BL_LE_ONLY_ERROR;
-  goto exit;
-  }
-
-  if (opt_mtu) {
-    printf("Error: MTU exchange can only occur once per connection.\n");
-    ret = BL_MTU_ALREADY_EXCHANGED_ERROR;
-    goto exit;
-  }
-
-  errno = 0;
-  opt_mtu = value;
-  if (errno != 0 || opt_mtu < ATT_DEFAULT_LE_MTU) {
-    printf("Error: Invalid value. Minimum MTU size is %d\n",
-        ATT_DEFAULT_LE_MTU);
-    ret = EINVAL;
-    goto exit;
-  }
-  gatt_exchange_mtu(attrib, opt_mtu, exchange_mtu_cb, NULL);
-
-  ret = wait_for_cb(NULL, NULL);
-exit:
-  BLUELIB_EXIT;
+  return bl_ctx_change_mtu(default_ctx, value);
 }
@@ -210,6 +210,16 @@ void bl_value_list_free(GSList *list)
   g_slist_free_full(list, value_free_func);
 }
 
+static void desc_list_free_func(gpointer data)
+{
+  list_free(data);
+}
+
+void bl_desc_lists_free(GSList *list)
+{
+  g_slist_free_full(list, desc_list_free_func);
+}
+
 /*
  * Print function
  */
@@ -299,6 +309,50 @@ void bl_value_fprint(FILE *f, bl_value_t *bl_value)
 }
 
 
+void bl_database_fprint(FILE *f, bl_database_t *bl_db)
+{
+  if (!bl_db) {
+    printf("ERROR: No data\n");
+    return;
+  }
+  for (int i = 0; i < bl_db->n_attrs; i++) {
+    bl_attr_t *attr = &bl_db->attrs[i];
+
+    switch (attr->type) {
+      case BL_ATTR_PRIMARY: {
+        bl_primary_t bl_primary = { .start_handle = attr->start_handle,
+          .end_handle = attr->end_handle };
+        strcpy(bl_primary.uuid_str, attr->uuid_str);
+        bl_primary_fprint(f, &bl_primary);
+        break;
+      }
+      case BL_ATTR_INCLUDED: {
+        bl_included_t bl_included = { .handle = attr->handle,
+          .start_handle = attr->start_handle,
+          .end_handle = attr->end_handle };
+        strcpy(bl_included.uuid_str, attr->uuid_str);
+        bl_included_fprint(f, &bl_included);
+        break;
+      }
+      case BL_ATTR_CHAR: {
+        bl_char_t bl_char = { .handle = attr->handle,
+          .properties = attr->properties,
+          .value_handle = attr->value_handle };
+        strcpy(bl_char.uuid_str, attr->uuid_str);
+        bl_char_fprint(f, &bl_char);
+        break;
+      }
+      default: {
+        bl_desc_t bl_desc = { .handle = attr->handle };
+        strcpy(bl_desc.uuid_str, attr->uuid_str);
+        bl_desc_fprint(f, &bl_desc);
+        break;
+      }
+    }
+  }
+}
+
+
 void list_fprint(FILE *f, GSList *list, int type)
 {
   if (list == NULL) {
@@ -0,0 +1,1035 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uuid.h"
+
+#include "bluelib.h"
+#include "cache.h"
+#include "gatt_def.h"
+
+#define printf(...) printf("[CACHE] " __VA_ARGS__)
+
+// File of a device:
+// [Database]
+// Hash=<Database Hash in hexadecimal, if the device has one>
+// [Attributes]
+// <handle>=2800:<end handle>:<uuid>                    Primary service
+// <handle>=2802:<start handle>:<end handle>:<uuid>     Included service
+// <handle>=2803:<properties>:<value handle>:<uuid>     Characteristic
+// <handle>=<uuid>                                      Other attributes
+#define GROUP_DATABASE   "Database"
+#define GROUP_ATTRIBUTES "Attributes"
+// Databases shared by the devices of the same layout, one file per layout
+// named after its identifier
+#define LAYOUTS_DIR      "layouts"
+
+typedef enum {
+  ATTR_PRIMARY,
+  ATTR_INCLUDED,
+  ATTR_CHAR,
+  ATTR_DESC,
+} attr_type_t;
+
+// One attribute, data is its bl_primary_t, bl_included_t, bl_char_t or
+// bl_desc_t.
+typedef struct {
+  attr_type_t  type;
+  uint16_t     handle;
+  uint16_t     desc_end; // Characteristics: last handle of the descriptors,
+                         // 0 if they were not discovered
+  char         uuid[MAX_LEN_UUID_STR]; // On 128 bits, key of the index
+  void        *data;
+} attr_t;
+
+// Handles owned by a service, and by one of its characteristics if chr is
+// set. The characteristic owns its handles up to the next one.
+typedef struct {
+  uint16_t  start;
+  uint16_t  end;
+  attr_t   *primary;
+  attr_t   *chr;
+  gboolean  known;  // The characteristics of the service were discovered
+} owner_t;
+
+struct gatt_cache {
+  GPtrArray  *attrs;           // attr_t *, sorted by handle
+  GHashTable *by_uuid;         // UUID on 128 bits -> GPtrArray of attr_t *
+  GArray     *owners;          // owner_t, disjoint intervals sorted by start
+  gboolean    owners_dirty;    // Rebuilt before the next lookup
+
+  // Ranges covered by the discoveries
+  gboolean    primaries_known;
+  GArray     *included_ranges; // struct att_range
+  GArray     *char_ranges;
+  gboolean    complete;
+
+  gboolean    has_hash;
+  uint8_t     hash[16];        // Database Hash of the device, if has_hash
+};
+
+/********************************* Helpers *********************************/
+static char *cache_path(const char *dir, const char *mac)
+{
+  char *name = g_ascii_strup(mac, -1);
+  char *path = g_build_filename(dir, name, NULL);
+
+  g_free(name);
+  return path;
+}
+
+// The UUIDs are indexed on 128 bits, "2a00" and
+// "00002a00-0000-1000-8000-00805f9b34fb" have the same key.
+static int uuid_key(const char *uuid_str, char *key)
+{
+  bt_uuid_t uuid;
+  bt_uuid_t uuid128;
+
+  if ((uuid_str == NULL) || bt_string_to_uuid(&uuid, uuid_str))
+    return -1;
+  bt_uuid_to_uuid128(&uuid, &uuid128);
+  bt_uuid_to_string(&uuid128, key, MAX_LEN_UUID_STR);
+  return 0;
+}
+
+static void handle_range(bl_primary_t *bl_primary, uint16_t *start,
+    uint16_t *end)
+{
+  *start = bl_primary ? bl_primary->start_handle : 0x0001;
+  *end   = bl_primary ? bl_primary->end_handle   : 0xffff;
+}
+
+// Add a range to a set of ranges, merged with the ones it overlaps or
+// touches.
+static void range_add(GArray *ranges, uint16_t start, uint16_t end)
+{
+  struct att_range range;
+  guint            i = 0;
+
+  while (i < ranges->len) {
+    struct att_range *r = &g_array_index(ranges, struct att_range, i);
+
+    if ((r->end + 1 >= start) && (r->start <= end + 1)) {
+      start = MIN(start, r->start);
+      end   = MAX(end, r->end);
+      g_array_remove_index(ranges, i);
+    } else
+      i++;
+  }
+  range.start = start;
+  range.end   = end;
+  g_array_append_val(ranges, range);
+}
+
+// Remove a range from a set of ranges, the ones it overlaps are cut.
+static void range_remove(GArray *ranges, uint16_t start, uint16_t end)
+{
+  guint i = 0;
+
+  while (i < ranges->len) {
+    struct att_range r = g_array_index(ranges, struct att_range, i);
+
+    if ((r.end < start) || (r.start > end)) {
+      i++;
+      continue;
+    }
+    g_array_remove_index(ranges, i);
+    if (r.start < start) {
+      struct att_range low = { .start = r.start, .end = start - 1 };
+      g_array_append_val(ranges, low);
+    }
+    if (r.end > end) {
+      struct att_range high = { .start = end + 1, .end = r.end };
+      g_array_append_val(ranges, high);
+    }
+  }
+}
+
+static gboolean range_covered(GArray *ranges, uint16_t start, uint16_t end)
+{
+  for (guint i = 0; i < ranges->len; i++) {
+    struct att_range *r = &g_array_index(ranges, struct att_range, i);
+    if ((r->start <= start) && (end <= r->end))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+
+/******************************** Attributes *******************************/
+static attr_t *attr_new(attr_type_t type, uint16_t handle, char *uuid_str,
+    void *data)
+{
+  attr_t *attr = g_new0(attr_t, 1);
+
+  attr->type   = type;
+  attr->handle = handle;
+  attr->data   = data;
+  if (uuid_key(uuid_str, attr->uuid))
+    strcpy(attr->uuid, uuid_str ? uuid_str : "");
+  return attr;
+}
+
+static void attr_free(gpointer data)
+{
+  attr_t *attr = data;
+
+  struct_free(attr->data);
+  g_free(attr);
+}
+
+static void *attr_copy(attr_t *attr)
+{
+  switch (attr->type) {
+    case ATTR_PRIMARY:
+      return bl_primary_cpy(attr->data);
+    case ATTR_INCLUDED:
+      return bl_included_cpy(attr->data);
+    case ATTR_CHAR:
+      return bl_char_cpy(attr->data);
+    default:
+      return bl_desc_cpy(attr->data);
+  }
+}
+
+static gint attr_cmp(gconstpointer a, gconstpointer b)
+{
+  return (*(attr_t **) a)->handle - (*(attr_t **) b)->handle;
+}
+
+static attr_t *attr_at(gatt_cache_t *cache, guint i)
+{
+  return g_ptr_array_index(cache->attrs, i);
+}
+
+// Index of the first attribute at or after handle.
+static guint attr_lower_bound(gatt_cache_t *cache, uint16_t handle)
+{
+  guint low  = 0;
+  guint high = cache->attrs->len;
+
+  while (low < high) {
+    guint mid = (low + high) / 2;
+    if (attr_at(cache, mid)->handle < handle)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static attr_t *attr_get(gatt_cache_t *cache, uint16_t handle)
+{
+  guint i = attr_lower_bound(cache, handle);
+
+  if ((i < cache->attrs->len) && (attr_at(cache, i)->handle == handle))
+    return attr_at(cache, i);
+  return NULL;
+}
+
+// Insert an attribute, in place of the one with the same handle.
+static void attr_insert(gatt_cache_t *cache, attr_t *attr)
+{
+  guint      i = attr_lower_bound(cache, attr->handle);
+  GPtrArray *index;
+
+  if ((i < cache->attrs->len) && (attr_at(cache, i)->handle == attr->handle)) {
+    attr_t *old = attr_at(cache, i);
+
+    // The descriptors of a characteristic found again are still known
+    if ((old->type == attr->type) && !strcmp(old->uuid, attr->uuid))
+      attr->desc_end = old->desc_end;
+    index = g_hash_table_lookup(cache->by_uuid, old->uuid);
+    g_ptr_array_remove(index, old);
+    attr_free(g_ptr_array_remove_index(cache->attrs, i));
+  }
+  g_ptr_array_insert(cache->attrs, i, attr);
+  cache->owners_dirty = TRUE;
+
+  index = g_hash_table_lookup(cache->by_uuid, attr->uuid);
+  if (index == NULL) {
+    index = g_ptr_array_new();
+    g_hash_table_insert(cache->by_uuid, g_strdup(attr->uuid), index);
+  }
+  g_ptr_array_add(index, attr);
+}
+
+// Copies of the attributes of a type between start and end, found with the
+// index if uuid_str is given.
+static GSList *attr_collect(gatt_cache_t *cache, attr_type_t type,
+    char *uuid_str, uint16_t start, uint16_t end)
+{
+  GPtrArray *found = g_ptr_array_new();
+  GSList    *list  = NULL;
+  char       key[MAX_LEN_UUID_STR];
+
+  if (uuid_str) {
+    GPtrArray *index = NULL;
+
+    if (!uuid_key(uuid_str, key))
+      index = g_hash_table_lookup(cache->by_uuid, key);
+    for (guint i = 0; index && (i < index->len); i++) {
+      attr_t *attr = g_ptr_array_index(index, i);
+      if ((attr->type == type) && (attr->handle >= start) &&
+          (attr->handle <= end))
+        g_ptr_array_add(found, attr);
+    }
+    g_ptr_array_sort(found, attr_cmp);
+  } else {
+    for (guint i = attr_lower_bound(cache, start); i < cache->attrs->len;
+        i++) {
+      attr_t *attr = attr_at(cache, i);
+      if (attr->handle > end)
+        break;
+      if (attr->type == type)
+        g_ptr_array_add(found, attr);
+    }
+  }
+
+  for (guint i = found->len; i > 0; i--)
+    list = g_slist_prepend(list, attr_copy(g_ptr_array_index(found, i - 1)));
+  g_ptr_array_free(found, TRUE);
+  return list;
+}
+
+
+/********************************** Owners *********************************/
+// Cut the services into the intervals owned by their characteristics, in
+// one pass over the attributes.
+static void owners_update(gatt_cache_t *cache)
+{
+  if (!cache->owners_dirty)
+    return;
+
+  g_array_set_size(cache->owners, 0);
+  for (guint i = 0; i < cache->attrs->len; i++) {
+    attr_t  *attr = attr_at(cache, i);
+    owner_t *last = NULL;
+    owner_t  owner;
+
+    if (cache->owners->len)
+      last = &g_array_index(cache->owners, owner_t, cache->owners->len - 1);
+
+    if (attr->type == ATTR_PRIMARY) {
+      bl_primary_t *bl_primary = attr->data;
+
+      owner.start   = bl_primary->start_handle;
+      owner.end     = bl_primary->end_handle;
+      owner.primary = attr;
+      owner.chr     = NULL;
+      owner.known   = range_covered(cache->char_ranges, owner.start,
+          owner.end);
+      g_array_append_val(cache->owners, owner);
+    } else if ((attr->type == ATTR_CHAR) && last && last->known &&
+        (attr->handle > last->start) && (attr->handle <= last->end)) {
+      owner       = *last;
+      owner.start = attr->handle;
+      owner.chr   = attr;
+      last->end   = attr->handle - 1;
+      g_array_append_val(cache->owners, owner);
+    }
+  }
+  cache->owners_dirty = FALSE;
+}
+
+// Number of intervals starting at or before handle, the one owning it is
+// the last of them.
+static guint owners_upper_bound(gatt_cache_t *cache, uint16_t handle)
+{
+  guint low  = 0;
+  guint high = cache->owners->len;
+
+  while (low < high) {
+    guint mid = (low + high) / 2;
+    if (g_array_index(cache->owners, owner_t, mid).start <= handle)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+
+/******************************** Life cycle *******************************/
+gatt_cache_t *cache_new(void)
+{
+  gatt_cache_t *cache = g_new0(gatt_cache_t, 1);
+
+  cache->attrs           = g_ptr_array_new_with_free_func(attr_free);
+  cache->by_uuid         = g_hash_table_new_full(g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_ptr_array_unref);
+  cache->included_ranges = g_array_new(FALSE, FALSE, sizeof(struct att_range));
+  cache->char_ranges     = g_array_new(FALSE, FALSE, sizeof(struct att_range));
+  cache->owners          = g_array_new(FALSE, FALSE, sizeof(owner_t));
+  return cache;
+}
+
+void cache_free(gatt_cache_t *cache)
+{
+  if (cache == NULL)
+    return;
+  g_hash_table_destroy(cache->by_uuid);
+  g_ptr_array_free(cache->attrs, TRUE);
+  g_array_free(cache->included_ranges, TRUE);
+  g_array_free(cache->char_ranges, TRUE);
+  g_array_free(cache->owners, TRUE);
+  g_free(cache);
+}
+
+static gatt_cache_t *cache_copy(gatt_cache_t *cache)
+{
+  gatt_cache_t *copy = cache_new();
+
+  for (guint i = 0; i < cache->attrs->len; i++) {
+    attr_t *attr = attr_at(cache, i);
+    attr_t *new;
+
+    // uuid_str comes first in all the structures
+    new = attr_new(attr->type, attr->handle,
+        ((bl_desc_t *) attr->data)->uuid_str, attr_copy(attr));
+    new->desc_end = attr->desc_end;
+    attr_insert(copy, new);
+  }
+  g_array_append_vals(copy->included_ranges, cache->included_ranges->data,
+      cache->included_ranges->len);
+  g_array_append_vals(copy->char_ranges, cache->char_ranges->data,
+      cache->char_ranges->len);
+  copy->primaries_known = cache->primaries_known;
+  copy->complete        = cache->complete;
+  copy->has_hash        = cache->has_hash;
+  memcpy(copy->hash, cache->hash, sizeof(cache->hash));
+  return copy;
+}
+
+void cache_set_complete(gatt_cache_t *cache)
+{
+  uint16_t primary_end = 0xffff;
+
+  cache->primaries_known = TRUE;
+  range_add(cache->included_ranges, 0x0001, 0xffff);
+  range_add(cache->char_ranges, 0x0001, 0xffff);
+
+  // The descriptors of a characteristic go up to the next declaration
+  for (guint i = 0; i < cache->attrs->len; i++) {
+    attr_t *attr = attr_at(cache, i);
+
+    if (attr->type == ATTR_PRIMARY)
+      primary_end = ((bl_primary_t *) attr->data)->end_handle;
+    if ((attr->type != ATTR_CHAR) || attr->desc_end)
+      continue;
+
+    attr->desc_end = attr->handle;
+    for (guint j = i + 1; j < cache->attrs->len; j++) {
+      attr_t *desc = attr_at(cache, j);
+      if ((desc->type != ATTR_DESC) || (desc->handle > primary_end))
+        break;
+      attr->desc_end = desc->handle;
+    }
+  }
+  cache->complete     = TRUE;
+  cache->owners_dirty = TRUE;
+}
+
+gboolean cache_is_complete(gatt_cache_t *cache)
+{
+  return cache->complete;
+}
+
+void cache_set_hash(gatt_cache_t *cache, const uint8_t *hash)
+{
+  cache->has_hash = (hash != NULL);
+  if (hash)
+    memcpy(cache->hash, hash, sizeof(cache->hash));
+}
+
+gboolean cache_get_hash(gatt_cache_t *cache, uint8_t *hash)
+{
+  if (cache->has_hash)
+    memcpy(hash, cache->hash, sizeof(cache->hash));
+  return cache->has_hash;
+}
+
+
+/********************************* Storage *********************************/
+// Hexadecimal field of the file, up to max. The whole field must be parsed.
+static gboolean load_hex(const char *str, unsigned long max,
+    unsigned long *value)
+{
+  char *end;
+
+  if (!g_ascii_isxdigit(*str))
+    return FALSE;
+  *value = strtoul(str, &end, 16);
+  return (*end == '\0') && (*value <= max);
+}
+
+// The UUID fields are copied to the uuid_str of the structures: an edited
+// or corrupted file must not overflow them. Only an included service may
+// have no UUID (128 bits UUIDs are not in its declaration).
+static gboolean load_uuid(const char *uuid_str, gboolean optional)
+{
+  bt_uuid_t uuid;
+
+  if (*uuid_str == '\0')
+    return optional;
+  return (strlen(uuid_str) < MAX_LEN_UUID_STR) &&
+    !bt_string_to_uuid(&uuid, uuid_str);
+}
+
+// Parse one line of the Attributes group.
+static int load_attribute(gatt_cache_t *cache, const char *key,
+    const char *value)
+{
+  char          **fields = g_strsplit(value, ":", 0);
+  guint           n      = g_strv_length(fields);
+  unsigned long   handle, v1, v2;
+  int             ret    = -1;
+
+  if (!load_hex(key, 0xffff, &handle) || (handle == INVALID_HANDLE) ||
+      (n == 0))
+    goto exit;
+
+  if (!strcmp(fields[0], GATT_PRIM_SVC_UUID_STR) && (n == 3)) {
+    if (!load_hex(fields[1], 0xffff, &v1) || !load_uuid(fields[2], FALSE))
+      goto exit;
+    attr_insert(cache, attr_new(ATTR_PRIMARY, handle, fields[2],
+          bl_primary_new(fields[2], FALSE, handle, v1)));
+  } else if (!strcmp(fields[0], GATT_INCLUDE_UUID_STR) && (n == 4)) {
+    if (!load_hex(fields[1], 0xffff, &v1) ||
+        !load_hex(fields[2], 0xffff, &v2) || !load_uuid(fields[3], TRUE))
+      goto exit;
+    attr_insert(cache, attr_new(ATTR_INCLUDED, handle, fields[3],
+          bl_included_new(fields[3], handle, v1, v2)));
+  } else if (!strcmp(fields[0], GATT_CHARAC_UUID_STR) && (n == 4)) {
+    if (!load_hex(fields[1], 0xff, &v1) ||
+        !load_hex(fields[2], 0xffff, &v2) || !load_uuid(fields[3], FALSE))
+      goto exit;
+    attr_insert(cache, attr_new(ATTR_CHAR, handle, fields[3],
+          bl_char_new(fields[3], handle, v1, v2)));
+  } else if ((n == 1) && load_uuid(fields[0], FALSE)) {
+    attr_insert(cache, attr_new(ATTR_DESC, handle, fields[0],
+          bl_desc_new(fields[0], handle)));
+  } else
+    goto exit;
+  ret = 0;
+
+exit:
+  g_strfreev(fields);
+  return ret;
+}
+
+static int load_hash(gatt_cache_t *cache, const char *hex)
+{
+  if (strlen(hex) != 2 * sizeof(cache->hash))
+    return -1;
+
+  for (size_t i = 0; i < sizeof(cache->hash); i++) {
+    int high = g_ascii_xdigit_value(hex[2 * i]);
+    int low  = g_ascii_xdigit_value(hex[2 * i + 1]);
+    if ((high < 0) || (low < 0))
+      return -1;
+    cache->hash[i] = (high << 4) | low;
+  }
+  cache->has_hash = TRUE;
+  return 0;
+}
+
+gatt_cache_t *cache_load(const char *dir, const char *mac)
+{
+  GKeyFile     *key_file = g_key_file_new();
+  char         *path     = cache_path(dir, mac);
+  gatt_cache_t *cache    = NULL;
+  char        **keys     = NULL;
+  char         *hash;
+
+  if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, NULL))
+    goto exit;
+
+  cache = cache_new();
+  hash = g_key_file_get_string(key_file, GROUP_DATABASE, "Hash", NULL);
+  if (hash && load_hash(cache, hash))
+    goto corrupted;
+  g_free(hash);
+  hash = NULL;
+
+  keys = g_key_file_get_keys(key_file, GROUP_ATTRIBUTES, NULL, NULL);
+  if (keys == NULL)
+    goto corrupted;
+  for (int i = 0; keys[i]; i++) {
+    char *value = g_key_file_get_string(key_file, GROUP_ATTRIBUTES, keys[i],
+        NULL);
+    int   ret   = value ? load_attribute(cache, keys[i], value) : -1;
+
+    g_free(value);
+    if (ret)
+      goto corrupted;
+  }
+
+  cache_set_complete(cache);
+  printf("Database of %s loaded\n", mac);
+  goto exit;
+
+corrupted:
+  printf("Invalid cache %s, ignored\n", path);
+  g_free(hash);
+  cache_free(cache);
+  cache = NULL;
+exit:
+  g_strfreev(keys);
+  g_free(path);
+  g_key_file_free(key_file);
+  return cache;
+}
+
+int cache_save(gatt_cache_t *cache, const char *dir, const char *mac,
+    GError **gerr)
+{
+  GKeyFile *key_file = g_key_file_new();
+  char     *path     = cache_path(dir, mac);
+  char     *data     = NULL;
+  gsize     length;
+  char      key[5];
+  char      value[64];
+  int       ret      = BL_NO_ERROR;
+
+  if (!cache->complete) {
+    g_set_error(gerr, BL_ERROR_DOMAIN, EINVAL, "Database incomplete\n");
+    ret = EINVAL;
+    goto exit;
+  }
+
+  if (cache->has_hash) {
+    char hash[2 * sizeof(cache->hash) + 1];
+    for (size_t i = 0; i < sizeof(cache->hash); i++)
+      sprintf(&hash[2 * i], "%02x", cache->hash[i]);
+    g_key_file_set_string(key_file, GROUP_DATABASE, "Hash", hash);
+  }
+
+  for (guint i = 0; i < cache->attrs->len; i++) {
+    attr_t        *attr        = attr_at(cache, i);
+    bl_primary_t  *bl_primary  = attr->data;
+    bl_included_t *bl_included = attr->data;
+    bl_char_t     *bl_char     = attr->data;
+    bl_desc_t     *bl_desc     = attr->data;
+
+    sprintf(key, "%04x", attr->handle);
+    switch (attr->type) {
+      case ATTR_PRIMARY:
+        sprintf(value, "%s:%04x:%s", GATT_PRIM_SVC_UUID_STR,
+            bl_primary->end_handle, bl_primary->uuid_str);
+        break;
+      case ATTR_INCLUDED:
+        sprintf(value, "%s:%04x:%04x:%s", GATT_INCLUDE_UUID_STR,
+            bl_included->start_handle, bl_included->end_handle,
+            bl_included->uuid_str);
+        break;
+      case ATTR_CHAR:
+        sprintf(value, "%s:%02x:%04x:%s", GATT_CHARAC_UUID_STR,
+            bl_char->properties, bl_char->value_handle, bl_char->uuid_str);
+        break;
+      default:
+        strcpy(value, bl_desc->uuid_str);
+    }
+    g_key_file_set_string(key_file, GROUP_ATTRIBUTES, key, value);
+  }
+
+  data = g_key_file_to_data(key_file, &length, gerr);
+  if (data == NULL) {
+    ret = BL_MALLOC_ERROR;
+    goto exit;
+  }
+  if (g_mkdir_with_parents(dir, 0700) < 0) {
+    ret = errno;
+    g_set_error(gerr, BL_ERROR_DOMAIN, ret, "Unable to create %s: %s\n",
+        dir, g_strerror(ret));
+    goto exit;
+  }
+  if (!g_file_set_contents(path, data, length, gerr))
+    ret = BL_REQUEST_FAIL_ERROR;
+
+exit:
+  g_free(data);
+  g_free(path);
+  g_key_file_free(key_file);
+  return ret;
+}
+
+void cache_remove(const char *dir, const char *mac)
+{
+  char *path = cache_path(dir, mac);
+
+  g_unlink(path);
+  g_free(path);
+}
+
+
+/********************************* Layouts *********************************/
+// Complete databases by layout identifier, for all the contexts
+static GHashTable *layouts;
+static GMutex      layouts_mutex;
+
+static GHashTable *layouts_table(void)
+{
+  if (layouts == NULL)
+    layouts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) cache_free);
+  return layouts;
+}
+
+gatt_cache_t *cache_layout_get(const char *key, const char *dir)
+{
+  gatt_cache_t *cache;
+
+  g_mutex_lock(&layouts_mutex);
+  cache = g_hash_table_lookup(layouts_table(), key);
+  if ((cache == NULL) && dir) {
+    char *path = g_build_filename(dir, LAYOUTS_DIR, NULL);
+
+    cache = cache_load(path, key);
+    if (cache)
+      g_hash_table_insert(layouts, g_strdup(key), cache);
+    g_free(path);
+  }
+  if (cache)
+    cache = cache_copy(cache);
+  g_mutex_unlock(&layouts_mutex);
+  return cache;
+}
+
+void cache_layout_put(const char *key, gatt_cache_t *cache, const char *dir)
+{
+  GError *gerr = NULL;
+
+  if (!cache->complete)
+    return;
+
+  g_mutex_lock(&layouts_mutex);
+  g_hash_table_insert(layouts_table(), g_strdup(key), cache_copy(cache));
+  if (dir) {
+    char *path = g_build_filename(dir, LAYOUTS_DIR, NULL);
+
+    if (cache_save(cache, path, key, &gerr)) {
+      printf("Error: Layout not saved: %s", gerr ? gerr->message : "\n");
+      g_clear_error(&gerr);
+    }
+    g_free(path);
+  }
+  g_mutex_unlock(&layouts_mutex);
+}
+
+void cache_layout_remove(const char *key, const char *dir)
+{
+  g_mutex_lock(&layouts_mutex);
+  g_hash_table_remove(layouts_table(), key);
+  if (dir) {
+    char *path = g_build_filename(dir, LAYOUTS_DIR, NULL);
+
+    cache_remove(path, key);
+    g_free(path);
+  }
+  g_mutex_unlock(&layouts_mutex);
+}
+
+
+/******************************** Discovery ********************************/
+void cache_invalidate(gatt_cache_t *cache, uint16_t start, uint16_t end)
+{
+  guint i = attr_lower_bound(cache, start);
+
+  while ((i < cache->attrs->len) && (attr_at(cache, i)->handle <= end)) {
+    attr_t *attr = attr_at(cache, i);
+
+    g_ptr_array_remove(g_hash_table_lookup(cache->by_uuid, attr->uuid), attr);
+    g_ptr_array_remove_index(cache->attrs, i);
+  }
+
+  // The descriptors of the characteristic before may go into the range
+  while (i-- > 0) {
+    attr_t *attr = attr_at(cache, i);
+
+    if (attr->type == ATTR_DESC)
+      continue;
+    if ((attr->type == ATTR_CHAR) && (attr->desc_end >= start))
+      attr->desc_end = 0;
+    break;
+  }
+
+  // A service may have been added in the range
+  cache->primaries_known = FALSE;
+  range_remove(cache->included_ranges, start, end);
+  range_remove(cache->char_ranges, start, end);
+  cache->complete     = FALSE;
+  cache->owners_dirty = TRUE;
+}
+
+void cache_add_primaries(gatt_cache_t *cache, GSList *bl_primary_list)
+{
+  for (GSList *l = bl_primary_list; l; l = l->next) {
+    bl_primary_t *bl_primary = l->data;
+    attr_insert(cache, attr_new(ATTR_PRIMARY, bl_primary->start_handle,
+          bl_primary->uuid_str, bl_primary_cpy(bl_primary)));
+  }
+  cache->primaries_known = TRUE;
+}
+
+void cache_add_included(gatt_cache_t *cache, uint16_t start, uint16_t end,
+    GSList *bl_included_list)
+{
+  for (GSList *l = bl_included_list; l; l = l->next) {
+    bl_included_t *bl_included = l->data;
+    attr_insert(cache, attr_new(ATTR_INCLUDED, bl_included->handle,
+          bl_included->uuid_str, bl_included_cpy(bl_included)));
+  }
+  range_add(cache->included_ranges, start, end);
+}
+
+void cache_add_chars(gatt_cache_t *cache, uint16_t start, uint16_t end,
+    GSList *bl_char_list)
+{
+  for (GSList *l = bl_char_list; l; l = l->next) {
+    bl_char_t *bl_char = l->data;
+    attr_insert(cache, attr_new(ATTR_CHAR, bl_char->handle,
+          bl_char->uuid_str, bl_char_cpy(bl_char)));
+  }
+  range_add(cache->char_ranges, start, end);
+  cache->owners_dirty = TRUE;
+}
+
+void cache_add_descs(gatt_cache_t *cache, bl_char_t *bl_char,
+    GSList *bl_desc_list)
+{
+  attr_t *attr = attr_get(cache, bl_char->handle);
+
+  if ((attr == NULL) || (attr->type != ATTR_CHAR)) {
+    attr = attr_new(ATTR_CHAR, bl_char->handle, bl_char->uuid_str,
+        bl_char_cpy(bl_char));
+    attr_insert(cache, attr);
+  }
+
+  attr->desc_end = bl_char->handle;
+  for (GSList *l = bl_desc_list; l; l = l->next) {
+    bl_desc_t *bl_desc = l->data;
+    attr_insert(cache, attr_new(ATTR_DESC, bl_desc->handle,
+          bl_desc->uuid_str, bl_desc_cpy(bl_desc)));
+    attr->desc_end = MAX(attr->desc_end, bl_desc->handle);
+  }
+}
+
+
+/********************************* Lookups *********************************/
+gboolean cache_get_primary(gatt_cache_t *cache, char *uuid_str,
+    GSList **list)
+{
+  if (!cache->primaries_known)
+    return FALSE;
+  *list = attr_collect(cache, ATTR_PRIMARY, uuid_str, 0x0001, 0xffff);
+  return TRUE;
+}
+
+gboolean cache_get_included(gatt_cache_t *cache, bl_primary_t *bl_primary,
+    GSList **list)
+{
+  uint16_t start, end;
+
+  handle_range(bl_primary, &start, &end);
+  if (!range_covered(cache->included_ranges, start, end))
+    return FALSE;
+  *list = attr_collect(cache, ATTR_INCLUDED, NULL, start, end);
+  return TRUE;
+}
+
+gboolean cache_get_char(gatt_cache_t *cache, char *uuid_str,
+    bl_primary_t *bl_primary, GSList **list)
+{
+  uint16_t start, end;
+
+  handle_range(bl_primary, &start, &end);
+  if (!range_covered(cache->char_ranges, start, end))
+    return FALSE;
+  *list = attr_collect(cache, ATTR_CHAR, uuid_str, start, end);
+  return TRUE;
+}
+
+// Same range as send_desc_discovery. The wrong ranges are left to it.
+gboolean cache_get_desc(gatt_cache_t *cache, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GSList **list)
+{
+  attr_t *attr;
+  int     start, end;
+
+  if (start_bl_char == NULL)
+    return FALSE;
+  attr = attr_get(cache, start_bl_char->handle);
+  if ((attr == NULL) || (attr->type != ATTR_CHAR) || !attr->desc_end)
+    return FALSE;
+
+  start = start_bl_char->handle + 1;
+  end   = end_bl_char ? end_bl_char->handle - 1 : 0xffff;
+  if (bl_primary)
+    end = MIN(end, bl_primary->end_handle);
+  if (start > end)
+    return FALSE;
+
+  *list = attr_collect(cache, ATTR_DESC, NULL, start,
+      MIN(end, attr->desc_end));
+  return TRUE;
+}
+
+uint16_t cache_find_value_handle(gatt_cache_t *cache, char *uuid_str)
+{
+  GSList   *list   = attr_collect(cache, ATTR_CHAR, uuid_str, 0x0001,
+      0xffff);
+  uint16_t  handle = INVALID_HANDLE;
+
+  if (list)
+    handle = ((bl_char_t *) list->data)->value_handle;
+  bl_char_list_free(list);
+  return handle;
+}
+
+gboolean cache_lookup_handle(gatt_cache_t *cache, uint16_t handle,
+    bl_primary_t **bl_primary, bl_char_t **bl_char)
+{
+  owner_t *owner = NULL;
+  guint    i;
+
+  owners_update(cache);
+  i = owners_upper_bound(cache, handle);
+  if (i > 0)
+    owner = &g_array_index(cache->owners, owner_t, i - 1);
+  if (owner && (handle <= owner->end)) {
+    if (!owner->known)
+      return FALSE;
+  } else if (cache->primaries_known) {
+    // Outside of the services
+    owner = NULL;
+  } else {
+    return FALSE;
+  }
+
+  if (bl_primary)
+    *bl_primary = owner ? bl_primary_cpy(owner->primary->data) : NULL;
+  if (bl_char)
+    *bl_char = (owner && owner->chr) ? bl_char_cpy(owner->chr->data) : NULL;
+  return TRUE;
+}
+
+gboolean cache_lookup_range(gatt_cache_t *cache, uint16_t start,
+    uint16_t end, GSList **list)
+{
+  GSList *found = NULL;
+  guint   i;
+
+  if (!cache->primaries_known)
+    return FALSE;
+  owners_update(cache);
+  i = owners_upper_bound(cache, start);
+  for (i = (i > 0) ? i - 1 : 0; i < cache->owners->len; i++) {
+    owner_t *owner = &g_array_index(cache->owners, owner_t, i);
+
+    if (owner->start > end)
+      break;
+    if (owner->end < start)
+      continue;
+    if (!owner->known) {
+      bl_char_list_free(found);
+      return FALSE;
+    }
+    if (owner->chr)
+      found = g_slist_prepend(found, bl_char_cpy(owner->chr->data));
+  }
+  *list = g_slist_reverse(found);
+  return TRUE;
+}
+
+bl_database_t *cache_get_database(gatt_cache_t *cache)
+{
+  bl_database_t *bl_db;
+  bl_char_t     *bl_char = NULL;
+  uint16_t       end     = 0;
+  int            primary = -1;
+  int            chr     = -1;
+
+  if (!cache->complete)
+    return NULL;
+
+  // Freed by bl_database_free
+  bl_db = calloc(1, sizeof(bl_database_t) +
+      cache->attrs->len * sizeof(bl_attr_t));
+  if (bl_db == NULL)
+    return NULL;
+  for (guint i = 0; i < cache->attrs->len; i++) {
+    attr_t    *attr    = attr_at(cache, i);
+    bl_attr_t *bl_attr = &bl_db->attrs[bl_db->n_attrs];
+
+    // Characteristics of a secondary service
+    if (attr->handle > end)
+      primary = -1;
+
+    switch (attr->type) {
+      case ATTR_PRIMARY: {
+        bl_primary_t *bl_primary = attr->data;
+        primary               = bl_db->n_attrs;
+        end                   = bl_primary->end_handle;
+        chr                   = -1;
+        bl_char               = NULL;
+        bl_attr->type         = BL_ATTR_PRIMARY;
+        bl_attr->start_handle = bl_primary->start_handle;
+        bl_attr->end_handle   = bl_primary->end_handle;
+        bl_attr->parent       = -1;
+        break;
+      }
+      case ATTR_INCLUDED: {
+        bl_included_t *bl_included = attr->data;
+        bl_attr->type         = BL_ATTR_INCLUDED;
+        bl_attr->start_handle = bl_included->start_handle;
+        bl_attr->end_handle   = bl_included->end_handle;
+        bl_attr->parent       = primary;
+        break;
+      }
+      case ATTR_CHAR:
+        bl_char               = attr->data;
+        chr                   = bl_db->n_attrs;
+        bl_attr->type         = BL_ATTR_CHAR;
+        bl_attr->properties   = bl_char->properties;
+        bl_attr->value_handle = bl_char->value_handle;
+        bl_attr->parent       = primary;
+        break;
+      default:
+        // The value of the characteristic is not a descriptor
+        if ((chr < 0) || (attr->handle == bl_char->value_handle))
+          continue;
+        bl_attr->type   = BL_ATTR_DESC;
+        bl_attr->parent = chr;
+        break;
+    }
+    bl_attr->handle = attr->handle;
+    // uuid_str comes first in all the structures
+    strcpy(bl_attr->uuid_str, ((bl_desc_t *) attr->data)->uuid_str);
+    bl_db->n_attrs++;
+  }
+  return bl_db;
+}
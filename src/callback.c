@@ -23,8 +23,11 @@
 
 #include <glib.h>
 #include <malloc.h>
-#include <unistd.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #include "uuid.h"
 #include "gattrib.h"
@@ -35,32 +38,41 @@
 #include "bluelib_gatt.h"
 #include "conn_state.h"
 #include "callback.h"
+#include "ctx.h"
+#include "database.h"
 #include "gatt_def.h"
 
-extern GAttrib    *attrib;
-extern GIOChannel *iochannel;
-extern int         opt_mtu;
+// Reactor: an event loop thread with its own GMainContext, serving the
+// sockets of several connections. The thread is started by the first
+// connection and kept alive for the next ones.
+struct reactor {
+  GThread      *thread;
+  GMainContext *context;
+  gboolean      running;      // The loop dispatches the sources
+  int           users;        // Connections served
 
-       uint16_t    end_handle_cb = 0;
-static GMainLoop  *event_loop    = NULL;
-static GThread    *event_thread  = NULL;
+  // Load statistics, updated by the thread of the reactor
+  guint64       wakeups;
+  gint64        idle_time;
+  gint64        start_time;
+};
 
-// Block main thread while waiting for callback
-static GMutex     *pending_callback  = NULL;
+static struct reactor reactors[BL_MAX_REACTORS];
+static int            n_reactors = 1;
 
-// Avoid ressources deadlock
-static GMutex     *cb_mutex = NULL;
+// Reactor of the current thread, for the poll function
+static GPrivate       current_reactor;
 
-// The callback and the functions are running in two seperate thread, we need
-// to use transport variables to return the results.
+// Avoid ressources deadlock
+static GMutex         cb_mutex;
+// Signaled when a reactor starts running, with cb_mutex
+static GCond          reactor_cond;
 
-// Return value from the callback functions
-static void       *cb_ret_pointer = NULL;
-static int         cb_ret_val     = BL_NO_ERROR;
-static char        cb_ret_msg[1024];
+#define REACTOR_START_TIMEOUT_S 60
 
-#define CB_TIMEOUT_S 120 /* For every function that have a callback function.
-                          * We will wait 2 minutes before returning */
+// Bounds of the timeout of the requests, adapted to the round trip time
+#define TIMEOUT_MIN_MS  1000
+#define TIMEOUT_MAX_MS 30000 // ATT transaction timeout, used before any RTT
 
 //#define DEBUG_ON       // Activate the Debug print
 #ifdef DEBUG_ON
@@ -81,182 +93,884 @@ static char        cb_ret_msg[1024];
     g_propagate_error(gerr, err); \
   } while (0)
 
+/*
+ * Requests
+ */
+// The request is returned with two references: one for the caller, one for
+// the callback which is released by req_complete().
+bl_req_t *req_new(bl_ctx_t *ctx)
+{
+  bl_req_t *req = g_try_new0(bl_req_t, 1);
+
+  if (req == NULL)
+    return NULL;
+
+  req->refs       = 2;
+  req->ctx        = ctx;
+  req->end_handle = 0xffff;
+  req->ret_val    = BL_NO_ERROR;
+  g_mutex_init(&req->mutex);
+  g_cond_init(&req->cond);
+
+  g_mutex_lock(&ctx->pending_mutex);
+  ctx->pending_reqs = g_slist_prepend(ctx->pending_reqs, req);
+  g_mutex_unlock(&ctx->pending_mutex);
+  return req;
+}
+
+bl_req_t *req_ref(bl_req_t *req)
+{
+  __sync_fetch_and_add(&req->refs, 1);
+  return req;
+}
+
+void req_unref(bl_req_t *req)
+{
+  if (!req)
+    return;
+
+  if (__sync_sub_and_fetch(&req->refs, 1) > 0)
+    return;
+
+  g_mutex_clear(&req->mutex);
+  g_cond_clear(&req->cond);
+  g_free(req);
+}
+
+// Wake up the thread waiting on the request.
+static gboolean req_signal(bl_req_t *req)
+{
+  gboolean first;
+
+  g_mutex_lock(&req->mutex);
+  first = !req->done;
+  req->done = TRUE;
+  g_cond_broadcast(&req->cond);
+  g_mutex_unlock(&req->mutex);
+  return first;
+}
+
+// Give the result of an asynchronous request to the user.
+// The result is freed if the request has been cancelled.
+static void req_deliver(bl_req_t *req)
+{
+  if (req->func == NULL)
+    return;
+
+  g_mutex_lock(&req->mutex);
+  gboolean cancelled = req->cancelled;
+  g_mutex_unlock(&req->mutex);
+
+  if (cancelled) {
+    if (req->ret_pointer && req->ret_free)
+      req->ret_free(req->ret_pointer);
+    req->ret_pointer = NULL;
+    req->func(BL_CANCELLED_ERROR, NULL, req->user_data);
+  } else
+    req->func(req->ret_val, req->ret_pointer, req->user_data);
+}
+
+void req_complete(bl_req_t *req)
+{
+  g_mutex_lock(&req->ctx->pending_mutex);
+  req->ctx->pending_reqs = g_slist_remove(req->ctx->pending_reqs, req);
+  g_mutex_unlock(&req->ctx->pending_mutex);
+
+  if (req_signal(req))
+    req_deliver(req);
+  else if (req->func && req->ret_pointer && req->ret_free)
+    // Already aborted, nobody will take the result
+    req->ret_free(req->ret_pointer);
+  req_unref(req);
+}
+
+void req_drop(bl_req_t *req)
+{
+  g_mutex_lock(&req->ctx->pending_mutex);
+  req->ctx->pending_reqs = g_slist_remove(req->ctx->pending_reqs, req);
+  g_mutex_unlock(&req->ctx->pending_mutex);
+
+  req_signal(req);
+  req_unref(req);
+}
+
+guint req_new_id(void)
+{
+  static guint last_id = 0;
+  guint        id;
+
+  // Unique among all the contexts
+  do {
+    id = __sync_add_and_fetch(&last_id, 1);
+  } while (id == 0);
+  return id;
+}
+
+static int req_cmp_by_id(gconstpointer a, gconstpointer b)
+{
+  const bl_req_t *req = a;
+  guint           id  = GPOINTER_TO_UINT(b);
+
+  return (req->id == id) ? 0 : 1;
+}
+
+int req_cancel(bl_ctx_t *ctx, guint id, bl_req_t **to_complete)
+{
+  bl_req_t *req = NULL;
+  GSList   *l;
+
+  *to_complete = NULL;
+  if (id == 0)
+    return EINVAL;
+
+  g_mutex_lock(&ctx->pending_mutex);
+  l = g_slist_find_custom(ctx->pending_reqs, GUINT_TO_POINTER(id),
+      req_cmp_by_id);
+  if (l)
+    req = req_ref(l->data);
+  g_mutex_unlock(&ctx->pending_mutex);
+
+  if (req == NULL)
+    return EINVAL;
+
+  g_mutex_lock(&req->mutex);
+  req->cancelled = TRUE;
+  g_mutex_unlock(&req->mutex);
+
+  // If the request is still on the GAttrib, its callback will never be
+  // called. Else the callback will see the cancelled flag.
+  // A write command is already completed by its destroy notify.
+  if (g_attrib_cancel(ctx->attrib, req->att_id)) {
+    g_mutex_lock(&ctx->pending_mutex);
+    if (g_slist_find(ctx->pending_reqs, req))
+      *to_complete = req;
+    g_mutex_unlock(&ctx->pending_mutex);
+  }
+
+  // The reference of the callback is still held for to_complete
+  req_unref(req);
+  return BL_NO_ERROR;
+}
+
+static void abort_pending_reqs(bl_ctx_t *ctx);
+
+void req_expire(bl_req_t *req)
+{
+  bl_ctx_t *ctx = req->ctx;
+  gboolean  done;
+
+  g_mutex_lock(&req->mutex);
+  done = req->done;
+  g_mutex_unlock(&req->mutex);
+  if (done)
+    return;
+
+  if (!g_attrib_cancel(ctx->attrib, req->att_id)) {
+    // Nothing to cancel (connection, next page of a procedure): the
+    // answer may never come, the connection is considered lost
+    conn_abort(ctx);
+    return;
+  }
+
+  g_mutex_lock(&ctx->pending_mutex);
+  if (!g_slist_find(ctx->pending_reqs, req))
+    req = NULL;
+  g_mutex_unlock(&ctx->pending_mutex);
+
+  if (req) {
+    req->ret_val = BL_NO_CALLBACK_ERROR;
+    strcpy(req->ret_msg, "Timeout no callback received\n");
+    req_complete(req);
+  }
+}
+
+// Called once the context is disconnected, no callback can be expected
+// anymore. The reference of the callback is kept in case it still comes later.
+static void abort_pending_reqs(bl_ctx_t *ctx)
+{
+  GSList *l;
+
+  g_mutex_lock(&ctx->pending_mutex);
+  l = ctx->pending_reqs;
+  ctx->pending_reqs = NULL;
+  g_mutex_unlock(&ctx->pending_mutex);
+
+  for (GSList *it = l; it; it = it->next) {
+    bl_req_t *req = it->data;
+
+    g_mutex_lock(&req->mutex);
+    if (!req->done) {
+      req->ret_val = BL_DISCONNECTED_ERROR;
+      strcpy(req->ret_msg, "Event loop is not running\n");
+    }
+    g_mutex_unlock(&req->mutex);
+    if (req_signal(req))
+      req_deliver(req);
+  }
+  g_slist_free(l);
+}
+
+// The requests are done first: connect_cb then leaves the connection alone.
+void conn_abort(bl_ctx_t *ctx)
+{
+  abort_pending_reqs(ctx);
+  disconnect_io(ctx);
+}
+
+/*
+ * Pollable fd of a main context
+ */
+// epoll set following the fds of a main context, see bl_get_fd.
+struct poll_set {
+  int                 epoll_fd;
+  int                 timer_fd;   // Armed with the timeout of the context
+  GPollFD            *fds;        // Last query of the context
+  gint                size;
+  struct epoll_event *events;     // Registered in epoll_fd, one per fd
+  int                 n_events;
+};
+
+// Dispatches done by one bl_dispatch, the rest is left to the next call
+#define DISPATCH_MAX 64
+
+static struct epoll_event *find_event(struct epoll_event *events, int n,
+    int fd)
+{
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.fd == fd)
+      return &events[i];
+  }
+  return NULL;
+}
+
+// Register the fds of the last query in the epoll set and arm the timer.
+static void poll_set_update(struct poll_set *set, gint n, gint timeout)
+{
+  struct epoll_event *events   = g_new(struct epoll_event, n ? n : 1);
+  int                 n_events = 0;
+  struct itimerspec   its      = { { 0, 0 }, { 0, 0 } };
+
+  // A fd can be watched by several sources
+  for (int i = 0; i < n; i++) {
+    struct epoll_event *event = find_event(events, n_events, set->fds[i].fd);
+
+    if (event == NULL) {
+      event = &events[n_events++];
+      event->data.fd = set->fds[i].fd;
+      event->events  = 0;
+    }
+    if (set->fds[i].events & G_IO_IN)
+      event->events |= EPOLLIN;
+    if (set->fds[i].events & G_IO_PRI)
+      event->events |= EPOLLPRI;
+    if (set->fds[i].events & G_IO_OUT)
+      event->events |= EPOLLOUT;
+  }
+
+  // A closed fd leaves the epoll set by itself and its number can be reused:
+  // adding first is the only reliable check.
+  for (int i = 0; i < n_events; i++) {
+    struct epoll_event *old = find_event(set->events, set->n_events,
+        events[i].data.fd);
+
+    if (epoll_ctl(set->epoll_fd, EPOLL_CTL_ADD, events[i].data.fd,
+          &events[i]) && (errno == EEXIST) && old &&
+        (old->events != events[i].events))
+      epoll_ctl(set->epoll_fd, EPOLL_CTL_MOD, events[i].data.fd, &events[i]);
+  }
+  for (int i = 0; i < set->n_events; i++) {
+    if (!find_event(events, n_events, set->events[i].data.fd))
+      epoll_ctl(set->epoll_fd, EPOLL_CTL_DEL, set->events[i].data.fd, NULL);
+  }
+  g_free(set->events);
+  set->events   = events;
+  set->n_events = n_events;
+
+  if (timeout == 0) {
+    its.it_value.tv_nsec = 1;
+  } else if (timeout > 0) {
+    its.it_value.tv_sec  = timeout / 1000;
+    its.it_value.tv_nsec = (timeout % 1000) * 1000000;
+  }
+  timerfd_settime(set->timer_fd, 0, &its, NULL);
+}
+
+// Dispatch what is ready without blocking then follow the new fds of the
+// context. The context must be acquired.
+static void poll_set_dispatch(struct poll_set *set, GMainContext *context)
+{
+  gint    priority, timeout, n;
+  guint64 expirations;
+
+  while (read(set->timer_fd, &expirations, sizeof(expirations)) > 0)
+    continue;
+
+  for (int dispatched = 0; ; dispatched++) {
+    g_main_context_prepare(context, &priority);
+    while ((n = g_main_context_query(context, priority, &timeout, set->fds,
+            set->size)) > set->size) {
+      set->fds  = g_renew(GPollFD, set->fds, n);
+      set->size = n;
+    }
+    g_poll(set->fds, n, 0);
+    if (!g_main_context_check(context, priority, set->fds, n) ||
+        (dispatched == DISPATCH_MAX))
+      break;
+    g_main_context_dispatch(context);
+  }
+  poll_set_update(set, n, timeout);
+}
+
+void free_poll_set(bl_ctx_t *ctx)
+{
+  struct poll_set *set = ctx->poll_set;
+
+  if (set == NULL)
+    return;
+  close(set->epoll_fd);
+  close(set->timer_fd);
+  g_free(set->fds);
+  g_free(set->events);
+  g_free(set);
+  ctx->poll_set = NULL;
+}
+
+/*
+ * Timeouts
+ */
+// Smoothed RTT and its variation as in RFC 6298, from the round trip time
+// of each ATT transaction. Called by the event loop.
+static void rtt_update(gint64 rtt_us, gpointer user_data)
+{
+  bl_ctx_t *ctx = user_data;
+
+  g_mutex_lock(&ctx->pending_mutex);
+  if (ctx->srtt_us == 0) {
+    ctx->srtt_us   = rtt_us;
+    ctx->rttvar_us = rtt_us / 2;
+  } else {
+    ctx->rttvar_us = (3 * ctx->rttvar_us + ABS(ctx->srtt_us - rtt_us)) / 4;
+    ctx->srtt_us   = (7 * ctx->srtt_us + rtt_us) / 8;
+  }
+  ctx->last_rx_time = g_get_monotonic_time();
+  g_mutex_unlock(&ctx->pending_mutex);
+}
+
+// pending_mutex must be held.
+static gint64 request_timeout(bl_ctx_t *ctx)
+{
+  gint64 timeout;
+
+  if (ctx->timeout_ms > 0)
+    return (gint64) ctx->timeout_ms * 1000;
+  if (ctx->srtt_us == 0)
+    return TIMEOUT_MAX_MS * 1000;
+
+  timeout = ctx->srtt_us + 4 * ctx->rttvar_us;
+  return CLAMP(timeout, TIMEOUT_MIN_MS * 1000, TIMEOUT_MAX_MS * 1000);
+}
+
+// Time at which a wait started at start expires. The timeout runs from the
+// last answer received: a procedure made of several transactions, or queued
+// behind other requests, does not expire while the connection progresses.
+static gint64 wait_deadline(bl_ctx_t *ctx, gint64 start)
+{
+  gint64 deadline;
+
+  g_mutex_lock(&ctx->pending_mutex);
+  deadline = MAX(start, ctx->last_rx_time) + request_timeout(ctx);
+  g_mutex_unlock(&ctx->pending_mutex);
+  return deadline;
+}
+
+int bl_ctx_set_timeout(bl_ctx_t *ctx, int timeout_ms)
+{
+  if (ctx == NULL)
+    return BL_NOT_INIT_ERROR;
+  if (timeout_ms < 0)
+    return EINVAL;
+
+  g_mutex_lock(&ctx->pending_mutex);
+  ctx->timeout_ms = timeout_ms;
+  g_mutex_unlock(&ctx->pending_mutex);
+  return BL_NO_ERROR;
+}
+
+int bl_ctx_get_timeout(bl_ctx_t *ctx)
+{
+  int timeout_ms;
+
+  if (ctx == NULL)
+    return BL_NOT_INIT_ERROR;
+
+  g_mutex_lock(&ctx->pending_mutex);
+  timeout_ms = request_timeout(ctx) / 1000;
+  g_mutex_unlock(&ctx->pending_mutex);
+  return timeout_ms;
+}
+
+typedef struct {
+  bl_ctx_t *ctx;
+  gint64    start;
+  gboolean  expired;
+} wait_timeout_t;
+
+static gboolean wait_timeout_cb(gpointer user_data)
+{
+  wait_timeout_t *wait = user_data;
+
+  if (g_get_monotonic_time() < wait_deadline(wait->ctx, wait->start))
+    return TRUE;
+  wait->expired = TRUE;
+  return FALSE;
+}
+
+// Dispatch the main context of the application until done is set or the
+// timeout is reached. Nothing is done if another thread runs it: done is
+// then set from this thread.
+static void iterate_main_context(bl_ctx_t *ctx, gint64 start, GMutex *mutex,
+    gboolean *done)
+{
+  GMainContext   *context = ctx->main_context;
+  wait_timeout_t  wait    = { ctx, start, FALSE };
+  gint64          spin_end;
+  GSource        *source;
+
+  if (!context || !g_main_context_acquire(context))
+    return;
+  // The deadline moves with the answers, it is checked periodically
+  source = g_timeout_source_new(TIMEOUT_MIN_MS / 4);
+  g_source_set_callback(source, wait_timeout_cb, &wait, NULL);
+  g_source_attach(source, context);
+  // Busy poll first: the answer is read as soon as it is received
+  spin_end = g_get_monotonic_time() + ctx->busy_poll_us;
+  g_mutex_lock(mutex);
+  while (!*done && !wait.expired) {
+    g_mutex_unlock(mutex);
+    g_main_context_iteration(context, g_get_monotonic_time() >= spin_end);
+    g_mutex_lock(mutex);
+  }
+  g_mutex_unlock(mutex);
+  g_source_destroy(source);
+  g_source_unref(source);
+  // The sources have changed without the poller of the fd knowing
+  if (ctx->poll_set)
+    poll_set_dispatch(ctx->poll_set, context);
+  g_main_context_release(context);
+}
+
 /*
  * Global functions
  */
-int wait_for_cb(void **ret_pointer, GError **gerr)
-{
-  int wait_cnt = 0;
-  if (!g_mutex_trylock(pending_callback) && is_event_loop_running()) {
-    // Reset return value
-    cb_ret_val     = BL_NO_CALLBACK_ERROR;
-    cb_ret_pointer = NULL;
-
-    printf_dbg("Waiting for callback\n");
-    while (is_event_loop_running() && !g_mutex_trylock(pending_callback)) {
-      usleep(100000);
-
-      if (wait_cnt < CB_TIMEOUT_S*10) {
-        wait_cnt++;
-      } else {
-        GError *err = g_error_new(BL_ERROR_DOMAIN, BL_NO_CALLBACK_ERROR,
-            "Timeout no callback received\n");
-        printf_dbg("%s", err->message);
-        PROPAGATE_ERROR;
-        set_conn_state(STATE_DISCONNECTED);
-        return BL_NO_CALLBACK_ERROR;
-      }
+int wait_for_done(bl_ctx_t *ctx, GMutex *mutex, GCond *cond, gboolean *done)
+{
+  gint64 start = g_get_monotonic_time();
+  int    ret   = BL_NO_ERROR;
+
+  iterate_main_context(ctx, start, mutex, done);
+  g_mutex_lock(mutex);
+  while (!*done) {
+    gint64 deadline = wait_deadline(ctx, start);
+
+    if (g_get_monotonic_time() >= deadline) {
+      ret = BL_NO_CALLBACK_ERROR;
+      break;
     }
+    g_cond_wait_until(cond, mutex, deadline);
+  }
+  g_mutex_unlock(mutex);
+  return ret;
+}
+
+// Immediate unless an answer is being handled. The main context must still
+// be iterated: in main context and inline modes, nobody else runs it.
+void wait_for_expired(bl_ctx_t *ctx, GMutex *mutex, GCond *cond,
+    gboolean *done)
+{
+  if (wait_for_done(ctx, mutex, cond, done) == BL_NO_ERROR)
+    return;
+
+  conn_abort(ctx);
+  // The callbacks of the aborted requests have been called, unless they
+  // were running on the reactor
+  g_mutex_lock(mutex);
+  while (!*done)
+    g_cond_wait(cond, mutex);
+  g_mutex_unlock(mutex);
+}
+
+int wait_for_cb(bl_req_t *req, void **ret_pointer, GError **gerr)
+{
+  printf_dbg("Waiting for callback\n");
+  if (wait_for_done(req->ctx, &req->mutex, &req->cond, &req->done)) {
+    // Completed with BL_NO_CALLBACK_ERROR, unless the answer came meanwhile
+    printf_dbg("Timeout no callback received\n");
+    req_expire(req);
+    wait_for_expired(req->ctx, &req->mutex, &req->cond, &req->done);
   }
 
-  if (!is_event_loop_running()) {
-    set_conn_state(STATE_DISCONNECTED);
+  if (req->ret_val == BL_DISCONNECTED_ERROR) {
+    set_conn_state(req->ctx, STATE_DISCONNECTED);
     GError *err = g_error_new(BL_ERROR_DOMAIN, BL_DISCONNECTED_ERROR,
-        "Event loop is not running\n");
+        "%s", req->ret_msg);
     printf_dbg("%s", err->message);
     PROPAGATE_ERROR;
     return BL_DISCONNECTED_ERROR;
   } else
-    printf_dbg("Callback returned <%d, %p>\n", cb_ret_val, cb_ret_pointer);
+    printf_dbg("Callback returned <%d, %p>\n", req->ret_val,
+        req->ret_pointer);
 
-  if (cb_ret_val != BL_NO_ERROR) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, cb_ret_val, "%s", cb_ret_msg);
+  if (req->ret_val != BL_NO_ERROR) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, req->ret_val, "%s",
+        req->ret_msg);
     PROPAGATE_ERROR;
   }
 
-  if (*cb_ret_msg != '\0') {
-    printf_dbg("%s", cb_ret_msg);
+  if (*req->ret_msg != '\0') {
+    printf_dbg("%s", req->ret_msg);
   }
-  strcpy(cb_ret_msg, "\0");
   if (ret_pointer)
-    *ret_pointer = cb_ret_pointer;
-  return cb_ret_val;
+    *ret_pointer = req->ret_pointer;
+  return req->ret_val;
 }
 
 
 /*
- * Event loop thread
+ * Event loop threads
  */
+// Poll of the reactors, the time spent in it is the idle time.
+static gint reactor_poll(GPollFD *ufds, guint nfds, gint timeout)
+{
+  struct reactor *reactor = g_private_get(&current_reactor);
+  gint64          start   = g_get_monotonic_time();
+  gint            ret     = g_poll(ufds, nfds, timeout);
+
+  if (reactor) {
+    __sync_fetch_and_add(&reactor->idle_time,
+        g_get_monotonic_time() - start);
+    __sync_fetch_and_add(&reactor->wakeups, 1);
+  }
+  return ret;
+}
+
+// First source dispatched by a reactor: it is ready to serve connections.
+static gboolean reactor_ready(gpointer data)
+{
+  struct reactor *reactor = data;
+
+  g_mutex_lock(&cb_mutex);
+  reactor->running = TRUE;
+  g_cond_broadcast(&reactor_cond);
+  g_mutex_unlock(&cb_mutex);
+  return FALSE;
+}
+
 static gpointer _event_thread(gpointer data)
 {
+  struct reactor *reactor = data;
+  GMainLoop      *loop    = g_main_loop_new(reactor->context, FALSE);
+  GSource        *source  = g_idle_source_new();
+
   printf_dbg("Event loop START\n");
-  g_mutex_lock(cb_mutex);
-  event_loop = g_main_loop_new(NULL, FALSE);
-  g_mutex_unlock(cb_mutex);
-  g_main_loop_run(event_loop);
-  g_main_loop_unref(event_loop);
-  event_loop = NULL;
+  g_private_set(&current_reactor, reactor);
+  g_main_context_push_thread_default(reactor->context);
+  g_source_set_priority(source, G_PRIORITY_HIGH);
+  g_source_set_callback(source, reactor_ready, reactor, NULL);
+  g_source_attach(source, reactor->context);
+  g_source_unref(source);
+
+  // Never quit: a connection only has to attach its sources to the context
+  g_main_loop_run(loop);
+
+  g_main_loop_unref(loop);
+  g_main_context_pop_thread_default(reactor->context);
   printf_dbg("Event loop EXIT\n");
-  g_thread_exit(0);
-  return 0;
+  return NULL;
 }
 
-int start_event_loop(GError **gerr)
+// Least loaded reactor, cb_mutex must be held.
+static struct reactor *pick_reactor(void)
 {
-  pending_callback = malloc(sizeof(GMutex));
-  if (pending_callback == NULL) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,
-        "Start event loop: Malloc error\n");
-    PROPAGATE_ERROR;
-    goto error1;
-  }
-  g_mutex_init(pending_callback);
-  g_mutex_lock(pending_callback);
-  cb_mutex = malloc(sizeof(GMutex));
-  if (cb_mutex == NULL) {
-    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_MALLOC_ERROR,
-        "Start event loop: Malloc error\n");
-    PROPAGATE_ERROR;
-    goto error2;
+  struct reactor *reactor = &reactors[0];
+
+  for (int i = 1; i < n_reactors; i++) {
+    if (reactors[i].users < reactor->users)
+      reactor = &reactors[i];
   }
-  g_mutex_init(cb_mutex);
+  return reactor;
+}
 
-  event_thread = g_thread_try_new("event_loop", _event_thread, NULL, gerr);
+// Attach the context to a reactor and wait for the reactor to run. Only the
+// first connection of a reactor starts its thread.
+int start_event_loop(bl_ctx_t *ctx, GError **gerr)
+{
+  struct reactor *reactor;
+  gint64          end_time;
+  int             ret = 0;
 
-  for (int cnt = 0;
-      (!is_event_loop_running()) && (cnt < 60) && (event_thread != NULL) &&
-      (get_conn_state() == STATE_CONNECTING);
-      cnt++) {
-    sleep(1);
-    printf_dbg("wait for event loop\n");
+  g_mutex_lock(&cb_mutex);
+  if (ctx->reactor || ctx->main_context)
+    goto exit;
+  reactor = pick_reactor();
+  if (reactor->thread == NULL) {
+    reactor->context = g_main_context_new();
+    g_main_context_set_poll_func(reactor->context, reactor_poll);
+    reactor->start_time = g_get_monotonic_time();
+    reactor->thread = g_thread_try_new("event_loop", _event_thread, reactor,
+        gerr);
+    if (reactor->thread == NULL) {
+      printf_dbg("%s\n", (*gerr)->message);
+      g_main_context_unref(reactor->context);
+      reactor->context = NULL;
+      ret = -1;
+      goto exit;
+    }
   }
 
-  if (event_thread == NULL) {
-    printf_dbg("%s\n", (*gerr)->message);
-    goto error3;
+  end_time = g_get_monotonic_time() +
+    REACTOR_START_TIMEOUT_S * G_TIME_SPAN_SECOND;
+  while (!reactor->running) {
+    if (!g_cond_wait_until(&reactor_cond, &cb_mutex, end_time)) {
+      g_set_error(gerr, BL_ERROR_DOMAIN, BL_NO_CALLBACK_ERROR,
+          "Event loop not started");
+      ret = -1;
+      goto exit;
+    }
   }
+  ctx->reactor = reactor;
+  reactor->users++;
 
-  return 0;
+exit:
+  g_mutex_unlock(&cb_mutex);
+  return ret;
+}
+
+// Detach the context from its reactor and fail its pending requests. The
+// thread of the reactor keeps running for the next connections.
+void stop_event_loop(bl_ctx_t *ctx)
+{
+  g_mutex_lock(&cb_mutex);
+  if (ctx->reactor) {
+    ctx->reactor->users--;
+    ctx->reactor = NULL;
+  }
+  g_mutex_unlock(&cb_mutex);
+  abort_pending_reqs(ctx);
+}
+
+int is_event_loop_running(bl_ctx_t *ctx)
+{
+  g_mutex_lock(&cb_mutex);
+  int ret = ((ctx->main_context != NULL) ||
+      ((ctx->reactor != NULL) && ctx->reactor->running));
+  g_mutex_unlock(&cb_mutex);
+  return ret;
+}
+
+GMainContext *event_loop_context(bl_ctx_t *ctx)
+{
+  g_mutex_lock(&cb_mutex);
+  GMainContext *context = ctx->main_context;
+  if (!context && ctx->reactor)
+    context = ctx->reactor->context;
+  g_mutex_unlock(&cb_mutex);
+  return context;
+}
+
+int bl_set_reactors(int n)
+{
+  int ret = BL_NO_ERROR;
 
- error3:
-  free(cb_mutex);
-  cb_mutex = NULL;
+  if ((n < 1) || (n > BL_MAX_REACTORS))
+    return EINVAL;
 
- error2:
-  free(pending_callback);
-  pending_callback = NULL;
- error1:
-  return -1;
+  g_mutex_lock(&cb_mutex);
+  for (int i = 0; i < n_reactors; i++) {
+    if (reactors[i].users) {
+      ret = BL_ALREADY_CONNECTED_ERROR;
+      goto exit;
+    }
+  }
+  n_reactors = n;
+exit:
+  g_mutex_unlock(&cb_mutex);
+  return ret;
+}
+
+int bl_get_reactors(void)
+{
+  return n_reactors;
 }
 
-void stop_event_loop(void)
+int bl_get_reactor_stats(int index, bl_reactor_stats_t *stats)
 {
-  g_mutex_lock(cb_mutex);
-  if (event_loop)
-    g_main_loop_quit(event_loop);
-  g_mutex_unlock(cb_mutex);
+  if ((index < 0) || (index >= n_reactors) || !stats)
+    return EINVAL;
+
+  struct reactor *reactor = &reactors[index];
+
+  g_mutex_lock(&cb_mutex);
+  stats->connections = reactor->users;
+  stats->wakeups     = __sync_fetch_and_add(&reactor->wakeups, 0);
+  stats->uptime_us   = reactor->thread ?
+    g_get_monotonic_time() - reactor->start_time : 0;
+  stats->busy_us     = stats->uptime_us -
+    __sync_fetch_and_add(&reactor->idle_time, 0);
+  g_mutex_unlock(&cb_mutex);
+  return BL_NO_ERROR;
 }
 
-int is_event_loop_running(void)
+int bl_ctx_get_fd(bl_ctx_t *ctx, GError **gerr)
 {
-  if (!cb_mutex)
-    return 0;
-  g_mutex_lock(cb_mutex);
-  int ret = ((event_thread != NULL) && (event_loop != NULL) &&
-             (pending_callback != NULL));
-  g_mutex_unlock(cb_mutex);
+  struct epoll_event  event = { .events = EPOLLIN };
+  struct poll_set    *set;
+  int                 ret   = -1;
+
+  if (ctx == NULL) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_NOT_INIT_ERROR,
+        "Bluelib not initialised\n");
+    PROPAGATE_ERROR;
+    return -1;
+  }
+
+  g_mutex_lock(&ctx->mutex);
+  if (ctx->poll_set) {
+    ret = ctx->poll_set->epoll_fd;
+    goto exit;
+  }
+  if (!ctx->main_context && (ctx->conn_state != STATE_DISCONNECTED)) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, BL_ALREADY_CONNECTED_ERROR,
+        "Already connected from a reactor\n");
+    PROPAGATE_ERROR;
+    goto exit;
+  }
+
+  set = g_new0(struct poll_set, 1);
+  set->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  set->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  event.data.fd = set->timer_fd;
+  if ((set->epoll_fd < 0) || (set->timer_fd < 0) ||
+      epoll_ctl(set->epoll_fd, EPOLL_CTL_ADD, set->timer_fd, &event)) {
+    GError *err = g_error_new(BL_ERROR_DOMAIN, errno, "%s\n",
+        strerror(errno));
+    PROPAGATE_ERROR;
+    if (set->epoll_fd >= 0)
+      close(set->epoll_fd);
+    if (set->timer_fd >= 0)
+      close(set->timer_fd);
+    g_free(set);
+    goto exit;
+  }
+
+  if (!ctx->main_context)
+    ctx->main_context = g_main_context_new();
+  ctx->poll_set = set;
+  if (g_main_context_acquire(ctx->main_context)) {
+    poll_set_dispatch(set, ctx->main_context);
+    g_main_context_release(ctx->main_context);
+  }
+  ret = set->epoll_fd;
+
+exit:
+  g_mutex_unlock(&ctx->mutex);
   return ret;
 }
 
+int bl_ctx_dispatch(bl_ctx_t *ctx)
+{
+  if (ctx == NULL)
+    return BL_NOT_INIT_ERROR;
+  if (ctx->main_context == NULL)
+    return EINVAL;
+  if (!g_main_context_acquire(ctx->main_context))
+    return EBUSY;
+  if (ctx->poll_set) {
+    poll_set_dispatch(ctx->poll_set, ctx->main_context);
+  } else {
+    for (int i = 0; i < DISPATCH_MAX; i++) {
+      if (!g_main_context_iteration(ctx->main_context, FALSE))
+        break;
+    }
+  }
+  g_main_context_release(ctx->main_context);
+  return BL_NO_ERROR;
+}
+
 /*
  * Callback functions
  */
+// Watch the indications of Service Changed: the range indicated is discovered
+// again. They are confirmed here unless the user registered for them.
+static void att_event_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+{
+  bl_ctx_t *ctx    = user_data;
+  gint      handle = g_atomic_int_get(&ctx->service_changed_handle);
+  uint8_t  *opdu;
+  size_t    plen;
+  int16_t   olen;
+
+  if ((pdu[0] != ATT_OP_HANDLE_IND) || (len < 7) ||
+      (handle == INVALID_HANDLE) || (att_get_u16(&pdu[1]) != handle))
+    return;
+
+  if (event_get_uuid_by_handle(ctx->attrib, handle) == NULL) {
+    opdu = g_attrib_get_buffer(ctx->attrib, &plen);
+    olen = enc_confirmation(opdu, plen);
+    if (olen > 0)
+      g_attrib_send(ctx->attrib, 0, opdu, olen, NULL, NULL, NULL);
+  }
+  database_changed(ctx, att_get_u16(&pdu[3]), att_get_u16(&pdu[5]));
+}
+
 void connect_cb(GIOChannel *io, GError *err, gpointer user_data)
 {
+  bl_req_t *req = user_data;
+
   printf_dbg("[CB] IN connect_cb\n");
+  // Once bl_connect has given up, the connection must not be set up: its
+  // teardown only sees what is set before the request is done.
+  g_mutex_lock(&req->mutex);
+  if (req->done)
+    goto error;
   if (err) {
-    set_conn_state(STATE_DISCONNECTED);
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "%s", err->message);
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "%s", err->message);
+    set_conn_state(req->ctx, STATE_DISCONNECTED);
     goto error;
   }
-  attrib = g_attrib_new(iochannel);
-  set_conn_state(STATE_CONNECTED);
-  strcpy(cb_ret_msg, "Connection successful\n");
-  cb_ret_val = BL_NO_ERROR;
+  req->ctx->timings.socket_connect_us =
+    g_get_monotonic_time() - req->ctx->connect_time;
+  req->ctx->attrib = g_attrib_new_full(io, event_loop_context(req->ctx));
+  g_attrib_set_rtt_function(req->ctx->attrib, rtt_update, req->ctx);
+  g_attrib_set_event_function(req->ctx->attrib, att_event_cb, req->ctx);
+  set_conn_state(req->ctx, STATE_CONNECTED);
+  strcpy(req->ret_msg, "Connection successful\n");
+  req->ret_val = BL_NO_ERROR;
 
  error:
-  g_mutex_unlock(pending_callback);
+  g_mutex_unlock(&req->mutex);
+  req_complete(req);
   printf_dbg("[CB] OUT connect_cb\n");
 }
 
 void primary_all_cb(GSList *services, guint8 status,
                     gpointer user_data)
 {
+  bl_req_t *req = user_data;
   GSList *l = NULL;
   GSList *bl_primary_list = NULL;
 
   printf_dbg("[CB] IN Primary_all_cb\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Primary callback: Failure: %s\n",
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Primary callback: Failure: %s\n",
             att_ecode2str(status));
     goto error;
   }
 
   if (services == NULL) {
-    cb_ret_val = BL_NO_ERROR;
-    strcpy(cb_ret_msg, "Primary callback: Nothing found\n");
+    req->ret_val = BL_NO_ERROR;
+    strcpy(req->ret_msg, "Primary callback: Nothing found\n");
     goto exit;
   }
 
@@ -268,15 +982,15 @@ void primary_all_cb(GSList *services, guint8 status,
     g_free(prim);
 
     if (bl_primary == NULL) {
-      cb_ret_val = BL_MALLOC_ERROR;
-      strcpy(cb_ret_msg, "Primary callback: Malloc error\n");
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Primary callback: Malloc error\n");
       goto error;
     }
     if (bl_primary_list == NULL) {
       bl_primary_list = g_slist_alloc();
       if (bl_primary_list == NULL) {
-        cb_ret_val = BL_MALLOC_ERROR;
-        strcpy(cb_ret_msg, "Primary callback: Malloc error\n");
+        req->ret_val = BL_MALLOC_ERROR;
+        strcpy(req->ret_msg, "Primary callback: Malloc error\n");
         goto error;
       }
       bl_primary_list->data = bl_primary;
@@ -285,9 +999,9 @@ void primary_all_cb(GSList *services, guint8 status,
     }
   }
 
-  cb_ret_val = BL_NO_ERROR;
-  cb_ret_pointer = bl_primary_list;
-  strcpy(cb_ret_msg, "Primary callback: Sucess\n");
+  req->ret_val = BL_NO_ERROR;
+  req->ret_pointer = bl_primary_list;
+  strcpy(req->ret_msg, "Primary callback: Sucess\n");
   goto exit;
 
  error:
@@ -296,46 +1010,146 @@ void primary_all_cb(GSList *services, guint8 status,
  exit:
   if (l)
     g_slist_free(l);
-  g_mutex_unlock(pending_callback);
+  req_complete(req);
   printf_dbg("[CB] OUT primary_all_cb\n");
 }
 
+// Give a page of a streaming discovery to the user, then free it. FALSE if
+// the discovery must stop: the user asked for it, or the request is already
+// cancelled or aborted.
+static gboolean req_page(bl_req_t *req, GSList *page)
+{
+  gboolean go_on;
+
+  g_mutex_lock(&req->mutex);
+  go_on = !req->cancelled && !req->done;
+  g_mutex_unlock(&req->mutex);
+
+  if (go_on && page)
+    go_on = req->page_func(page, req->user_data);
+  list_free(page);
+  return go_on;
+}
+
+// Read By Group Type of the primary services, the next page starts after
+// the last service of this one.
+void primary_stream_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data)
+{
+  bl_req_t             *req  = user_data;
+  struct att_data_list *list = NULL;
+  GSList               *page = NULL;
+  uint16_t              end  = 0xffff;
+  bt_uuid_t             prim;
+  uint8_t              *buf;
+  size_t                buflen;
+  guint16               olen;
+
+  printf_dbg("[CB] IN primary_stream_cb\n");
+  if (status) {
+    // The end of the services
+    req->ret_val = BL_NO_ERROR;
+    if (status != ATT_ECODE_ATTR_NOT_FOUND) {
+      req->att_status = status;
+      req->ret_val    = BL_REQUEST_FAIL_ERROR;
+      sprintf(req->ret_msg, "Primary stream callback: Failure: %s\n",
+          att_ecode2str(status));
+    }
+    goto exit;
+  }
+
+  list = dec_read_by_grp_resp(pdu, plen);
+  if (list == NULL) {
+    req->ret_val = BL_PROTOCOL_ERROR;
+    strcpy(req->ret_msg, "Primary stream callback: Invalid response\n");
+    goto exit;
+  }
+
+  for (int i = 0; i < list->num; i++) {
+    const uint8_t *data = list->data[i];
+    bl_primary_t  *bl_primary;
+    bt_uuid_t      uuid;
+    char           uuid_str[MAX_LEN_UUID_STR];
+
+    end = att_get_u16(&data[2]);
+    if (list->len == 6) {
+      bt_uuid_t uuid16 = att_get_uuid16(&data[4]);
+      bt_uuid_to_uuid128(&uuid16, &uuid);
+    } else if (list->len == 20) {
+      uuid = att_get_uuid128(&data[4]);
+    } else
+      continue;
+    bt_uuid_to_string(&uuid, uuid_str, MAX_LEN_UUID_STR);
+
+    bl_primary = bl_primary_new(uuid_str, FALSE, att_get_u16(&data[0]), end);
+    if (bl_primary == NULL) {
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Primary stream callback: Malloc error\n");
+      bl_primary_list_free(page);
+      goto exit;
+    }
+    page = g_slist_prepend(page, bl_primary);
+  }
+
+  req->ret_val = BL_NO_ERROR;
+  if (!req_page(req, g_slist_reverse(page)) || (end == 0xffff))
+    goto exit;
+
+  buf = g_attrib_get_buffer(req->ctx->attrib, &buflen);
+  bt_uuid16_create(&prim, GATT_PRIM_SVC_UUID);
+  olen = enc_read_by_grp_req(end + 1, 0xffff, &prim, buf, buflen);
+  req->att_id = g_attrib_send(req->ctx->attrib, 0, buf, olen,
+      primary_stream_cb, req, NULL);
+  if (req->att_id)
+    goto next;
+  req->ret_val = BL_SEND_REQUEST_ERROR;
+  strcpy(req->ret_msg, "Unable to send request\n");
+
+exit:
+  req_complete(req);
+next:
+  if (list)
+    att_data_list_free(list);
+  printf_dbg("[CB] OUT primary_stream_cb\n");
+}
+
 void primary_by_uuid_cb(GSList *ranges, guint8 status,
                         gpointer user_data)
 {
+  bl_req_t *req = user_data;
   GSList *l;
   GSList  *bl_primary_list = NULL;
 
   printf_dbg("[CB] IN primary_by_uuid_cb\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Primary by UUID callback: Failure: %s\n",
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Primary by UUID callback: Failure: %s\n",
             att_ecode2str(status));
     goto error;
   }
   if (ranges == NULL) {
-    cb_ret_val = BL_NO_ERROR;
-    strcpy(cb_ret_msg, "Primary by UUID callback: Nothing found\n");
+    req->ret_val = BL_NO_ERROR;
+    strcpy(req->ret_msg, "Primary by UUID callback: Nothing found\n");
     goto exit;
   }
 
   for (l = ranges; l; l = l->next) {
     struct att_range *range = l->data;
-    bl_primary_t *bl_primary = bl_primary_new(NULL, 0, range->start,
-                                              range->end);
+    bl_primary_t *bl_primary = bl_primary_new(req->uuid_str, 0,
+                                              range->start, range->end);
     free(range);
 
     if (bl_primary == NULL) {
-      cb_ret_val = BL_MALLOC_ERROR;
-      strcpy(cb_ret_msg, "Primary by UUID callback: Malloc error\n");
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Primary by UUID callback: Malloc error\n");
       goto error;
     }
     if (bl_primary_list == NULL) {
       bl_primary_list = g_slist_alloc();
 
       if (bl_primary_list == NULL) {
-        cb_ret_val = BL_MALLOC_ERROR;
-        strcpy(cb_ret_msg, "Primary by UUID callback: Malloc error\n");
+        req->ret_val = BL_MALLOC_ERROR;
+        strcpy(req->ret_msg, "Primary by UUID callback: Malloc error\n");
         goto error;
       }
       bl_primary_list->data = bl_primary;
@@ -343,34 +1157,35 @@ void primary_by_uuid_cb(GSList *ranges, guint8 status,
       bl_primary_list = g_slist_append(bl_primary_list, bl_primary);
     }
   }
-  cb_ret_val = BL_NO_ERROR;
-  cb_ret_pointer = bl_primary_list;
+  req->ret_val = BL_NO_ERROR;
+  req->ret_pointer = bl_primary_list;
   goto exit;
 
  error:
   if (bl_primary_list)
     bl_primary_list_free(bl_primary_list);
  exit:
-  g_mutex_unlock(pending_callback);
+  req_complete(req);
   printf_dbg("[CB] OUT primary_by_uuid_cb\n");
 }
 
 void included_cb(GSList *includes, guint8 status, gpointer user_data)
 {
+  bl_req_t *req = user_data;
   GSList *l = NULL;
   GSList *bl_included_list = NULL;
 
   printf_dbg("[CB] IN included_cb\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Included callback: Failure: %s\n",
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Included callback: Failure: %s\n",
             att_ecode2str(status));
     goto error;
   }
 
   if (includes == NULL) {
-    cb_ret_val = BL_NO_ERROR;
-    strcpy(cb_ret_msg, "Included callback: Nothing found\n");
+    req->ret_val = BL_NO_ERROR;
+    strcpy(req->ret_msg, "Included callback: Nothing found\n");
     goto exit;
   }
 
@@ -379,15 +1194,15 @@ void included_cb(GSList *includes, guint8 status, gpointer user_data)
     bl_included_t *bl_included = bl_included_new(incl->uuid, incl->handle,
         incl->range.start, incl->range.end);
     if (bl_included == NULL) {
-      cb_ret_val = BL_MALLOC_ERROR;
-      strcpy(cb_ret_msg, "Included callback: Malloc error\n");
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Included callback: Malloc error\n");
       goto error;
     }
     if (bl_included_list == NULL) {
       bl_included_list = g_slist_alloc();
       if (bl_included_list == NULL) {
-        cb_ret_val = BL_MALLOC_ERROR;
-        strcpy(cb_ret_msg, "Included callback: Malloc error\n");
+        req->ret_val = BL_MALLOC_ERROR;
+        strcpy(req->ret_msg, "Included callback: Malloc error\n");
         goto error;
       }
       bl_included_list->data = bl_included;
@@ -396,8 +1211,8 @@ void included_cb(GSList *includes, guint8 status, gpointer user_data)
     }
   }
 
-  cb_ret_val     = BL_NO_ERROR;
-  cb_ret_pointer = bl_included_list;
+  req->ret_val     = BL_NO_ERROR;
+  req->ret_pointer = bl_included_list;
   goto exit;
 
  error:
@@ -406,20 +1221,22 @@ void included_cb(GSList *includes, guint8 status, gpointer user_data)
  exit:
   if (l)
     g_slist_free(l);
-  g_mutex_unlock(pending_callback);
+  req_complete(req);
   printf_dbg("[CB] OUT included_cb\n");
 }
 
 void char_by_uuid_cb(GSList *characteristics, guint8 status,
                      gpointer user_data)
 {
+  bl_req_t *req = user_data;
   GSList *l            = NULL;
   GSList *bl_char_list = NULL;
 
   printf_dbg("[CB] IN char_by_uuid\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Characteristic by UUID callback: Failure: %s\n",
+    req->att_status = status;
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Characteristic by UUID callback: Failure: %s\n",
             att_ecode2str(status));
     goto error;
   }
@@ -432,8 +1249,8 @@ void char_by_uuid_cb(GSList *characteristics, guint8 status,
 
     // Add it to the characteristic
     if (bl_char == NULL) {
-      cb_ret_val = BL_MALLOC_ERROR;
-      strcpy(cb_ret_msg, "Characteristic by UUID callback: Malloc error\n");
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Characteristic by UUID callback: Malloc error\n");
       goto error;
     }
 
@@ -441,8 +1258,8 @@ void char_by_uuid_cb(GSList *characteristics, guint8 status,
     if (bl_char_list == NULL) {
       bl_char_list = g_slist_alloc();
       if (bl_char_list == NULL) {
-        cb_ret_val = BL_MALLOC_ERROR;
-        strcpy(cb_ret_msg, "Characteristic by UUID callback: Malloc error\n");
+        req->ret_val = BL_MALLOC_ERROR;
+        strcpy(req->ret_msg, "Characteristic by UUID callback: Malloc error\n");
         goto error;
       }
       bl_char_list->data = bl_char;
@@ -451,8 +1268,8 @@ void char_by_uuid_cb(GSList *characteristics, guint8 status,
     }
   }
 
-  cb_ret_val     = BL_NO_ERROR;
-  cb_ret_pointer = bl_char_list;
+  req->ret_val     = BL_NO_ERROR;
+  req->ret_pointer = bl_char_list;
   goto exit;
 
  error:
@@ -461,14 +1278,99 @@ void char_by_uuid_cb(GSList *characteristics, guint8 status,
  exit:
   if (l)
     g_slist_free(l);
-  g_mutex_unlock(pending_callback);
+  req_complete(req);
   printf_dbg("[CB] OUT char_by_uuid\n");
 }
 
-static GSList *bl_desc_list = NULL;
+// Read By Type of the characteristic declarations up to req->end_handle,
+// the next page starts after the last declaration of this one.
+void char_stream_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data)
+{
+  bl_req_t             *req  = user_data;
+  struct att_data_list *list = NULL;
+  GSList               *page = NULL;
+  uint16_t              last = 0;
+  bt_uuid_t             charac;
+  uint8_t              *buf;
+  size_t                buflen;
+  guint16               olen;
+
+  printf_dbg("[CB] IN char_stream_cb\n");
+  if (status) {
+    // The end of the characteristics
+    req->ret_val = BL_NO_ERROR;
+    if (status != ATT_ECODE_ATTR_NOT_FOUND) {
+      req->att_status = status;
+      req->ret_val    = BL_REQUEST_FAIL_ERROR;
+      sprintf(req->ret_msg, "Characteristic stream callback: Failure: %s\n",
+          att_ecode2str(status));
+    }
+    goto exit;
+  }
+
+  list = dec_read_by_type_resp(pdu, plen);
+  if (list == NULL) {
+    req->ret_val = BL_PROTOCOL_ERROR;
+    strcpy(req->ret_msg, "Characteristic stream callback: Invalid "
+        "response\n");
+    goto exit;
+  }
+
+  for (int i = 0; i < list->num; i++) {
+    uint8_t   *value = list->data[i];
+    bl_char_t *bl_char;
+    bt_uuid_t  uuid;
+    char       uuid_str[MAX_LEN_UUID_STR];
+
+    last = att_get_u16(value);
+    if (list->len == 7) {
+      bt_uuid_t uuid16 = att_get_uuid16(&value[5]);
+      bt_uuid_to_uuid128(&uuid16, &uuid);
+    } else
+      uuid = att_get_uuid128(&value[5]);
+    bt_uuid_to_string(&uuid, uuid_str, MAX_LEN_UUID_STR);
+
+    bl_char = bl_char_new(uuid_str, last, value[2], att_get_u16(&value[3]));
+    if (bl_char == NULL) {
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Characteristic stream callback: Malloc error\n");
+      bl_char_list_free(page);
+      goto exit;
+    }
+    page = g_slist_prepend(page, bl_char);
+  }
+
+  req->ret_val = BL_NO_ERROR;
+  if (!req_page(req, g_slist_reverse(page)) || (last == 0) ||
+      (last + 1 >= req->end_handle))
+    goto exit;
+
+  buf = g_attrib_get_buffer(req->ctx->attrib, &buflen);
+  bt_uuid16_create(&charac, GATT_CHARAC_UUID);
+  olen = enc_read_by_type_req(last + 1, req->end_handle, &charac, buf,
+      buflen);
+  req->att_id = g_attrib_send(req->ctx->attrib, 0, buf, olen,
+      char_stream_cb, req, NULL);
+  if (req->att_id)
+    goto next;
+  req->ret_val = BL_SEND_REQUEST_ERROR;
+  strcpy(req->ret_msg, "Unable to send request\n");
+
+exit:
+  req_complete(req);
+next:
+  if (list)
+    att_data_list_free(list);
+  printf_dbg("[CB] OUT char_stream_cb\n");
+}
+
 void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
                   gpointer user_data) {
+  bl_req_t *req = user_data;
   struct att_data_list *list   = NULL;
+  GSList               *page   = NULL;
+  gboolean              last   = FALSE;
   guint8                format;
   uint16_t              handle = 0xffff;
   int                   i;
@@ -477,19 +1379,24 @@ void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
 
   printf_dbg("[CB] IN char_desc_cb\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Characteristic descriptor "
+    req->att_status = status;
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Characteristic descriptor "
         "callback: Failure: %s\n", att_ecode2str(status));
+    // A stream ends there
+    if (req->page_func && (status == ATT_ECODE_ATTR_NOT_FOUND))
+      req->ret_val = BL_NO_ERROR;
     goto exit;
   }
 
   list = dec_find_info_resp(pdu, plen, &format);
   if (list == NULL) {
-    cb_ret_val = BL_NO_ERROR;
-    strcpy(cb_ret_msg, "Characteristic descriptor callback: Nothing found\n");
+    req->ret_val = BL_NO_ERROR;
+    strcpy(req->ret_msg, "Characteristic descriptor callback: Nothing found\n");
     goto exit;
   }
 
+  req->ret_val = BL_NO_ERROR;
   for (i = 0; i < list->num; i++) {
     bt_uuid_t uuid;
 
@@ -502,52 +1409,55 @@ void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen,
       uuid = att_get_uuid128(&value[2]);
 
     bt_uuid_to_string(&uuid, uuid_str, MAX_LEN_UUID_STR);
-    if (strcmp(uuid_str, GATT_PRIM_SVC_UUID_STR) &&
-        strcmp(uuid_str, GATT_SND_SVC_UUID_STR)  &&
-        strcmp(uuid_str, GATT_INCLUDE_UUID_STR)  &&
-        strcmp(uuid_str, GATT_CHARAC_UUID_STR)) {
+    if (req->sweep ||
+        (strcmp(uuid_str, GATT_PRIM_SVC_UUID_STR) &&
+         strcmp(uuid_str, GATT_SND_SVC_UUID_STR)  &&
+         strcmp(uuid_str, GATT_INCLUDE_UUID_STR)  &&
+         strcmp(uuid_str, GATT_CHARAC_UUID_STR))) {
       bl_desc_t *bl_desc = bl_desc_new(uuid_str, handle);
       if (bl_desc == NULL) {
-        cb_ret_val = BL_MALLOC_ERROR;
-        strcpy(cb_ret_msg, "Characteristic descriptor callback: Malloc "
+        req->ret_val = BL_MALLOC_ERROR;
+        strcpy(req->ret_msg, "Characteristic descriptor callback: Malloc "
             "error\n");
-        goto exit;
-      }
-      if (bl_desc_list == NULL) {
-        bl_desc_list = g_slist_alloc();
-        if (bl_desc_list == NULL) {
-          cb_ret_val = BL_MALLOC_ERROR;
-          strcpy(cb_ret_msg, "Characteristic descriptor callback: Malloc "
-              "error\n");
-          goto exit;
-        }
-        bl_desc_list->data = bl_desc;
-      } else {
-        bl_desc_list = g_slist_append(bl_desc_list, bl_desc);
+        break;
       }
+      page = g_slist_prepend(page, bl_desc);
     } else {
       printf_dbg("Reach end of descriptor list\n");
-      goto exit;
+      last = TRUE;
+      break;
     }
   }
-  if ((handle != 0xffff) && (handle < end_handle_cb)) {
+
+  // A stream gives the page, else it is gathered with the previous ones
+  page = g_slist_reverse(page);
+  if (req->page_func) {
+    if (!req_page(req, page))
+      last = TRUE;
+  } else
+    req->list = g_slist_concat(req->list, page);
+  // Malloc error
+  if (req->ret_val)
+    goto exit;
+
+  if (!last && (handle != 0xffff) && (handle < req->end_handle)) {
     printf_dbg("[CB] OUT with asking for a new request\n");
-    if (gatt_discover_char_desc(attrib, handle + 1, end_handle_cb,
-          char_desc_cb, NULL)) {
+    req->att_id = gatt_discover_char_desc(req->ctx->attrib, handle + 1,
+        req->end_handle, char_desc_cb, req);
+    if (req->att_id)
       goto next;
-    }
-    cb_ret_val = BL_SEND_REQUEST_ERROR;
-    strcpy(cb_ret_msg, "Unable to send request\n");
+    req->ret_val = BL_SEND_REQUEST_ERROR;
+    strcpy(req->ret_msg, "Unable to send request\n");
   }
 
 exit:
-  if (bl_desc_list) {
+  if (req->list) {
     // Return what we got if we add something
-    cb_ret_val = BL_NO_ERROR;
-    cb_ret_pointer = bl_desc_list;
+    req->ret_val = BL_NO_ERROR;
+    req->ret_pointer = req->list;
   }
-  bl_desc_list = NULL;
-  g_mutex_unlock(pending_callback);
+  req->list = NULL;
+  req_complete(req);
 next:
   if (list)
     att_data_list_free(list);
@@ -557,159 +1467,302 @@ next:
 void read_by_hnd_cb(guint8 status, const guint8 *pdu, guint16 plen,
                     gpointer user_data)
 {
-  uint8_t  data[plen];
+  bl_req_t *req = user_data;
   ssize_t  vlen;
 
   printf_dbg("[CB] IN read_by_hnd_cb\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Read by handle callback: Failure: %s\n",
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Read by handle callback: Failure: %s\n",
             att_ecode2str(status));
-    goto error;
-  }
-
-  if (data == NULL) {
-    cb_ret_val = BL_MALLOC_ERROR;
-    strcpy(cb_ret_msg, "Read by handle callback: Malloc error\n");
-    goto error;
+    goto exit;
   }
 
-  vlen = dec_read_resp(pdu, plen, data, sizeof(data));
+  // The value is taken from the PDU, without copy on the way
+  vlen = dec_read_resp(pdu, plen, NULL, 0);
   if (vlen < 0) {
-    cb_ret_val = BL_PROTOCOL_ERROR;
-    strcpy(cb_ret_msg, "Read by handle callback: Protocol error\n");
-    goto error;
+    req->ret_val = BL_PROTOCOL_ERROR;
+    strcpy(req->ret_msg, "Read by handle callback: Protocol error\n");
+    goto exit;
   }
 
-  cb_ret_pointer = bl_value_new(NULL, 0, vlen, data);
-  if (cb_ret_pointer == NULL) {
-    cb_ret_val = BL_MALLOC_ERROR;
-    strcpy(cb_ret_msg, "Read by handle callback: Malloc error\n");
+  req->ret_pointer = bl_value_new(req->uuid_str, req->handle, vlen,
+      (uint8_t *) pdu + 1);
+  if (req->ret_pointer == NULL) {
+    req->ret_val = BL_MALLOC_ERROR;
+    strcpy(req->ret_msg, "Read by handle callback: Malloc error\n");
+    goto exit;
   }
 
-  cb_ret_val = BL_NO_ERROR;
-  goto exit;
-
- error:
-  if (cb_ret_pointer)
-    free(cb_ret_pointer);
+  req->ret_val = BL_NO_ERROR;
  exit:
-  g_mutex_unlock(pending_callback);
+  req_complete(req);
   printf_dbg("[CB] OUT read_by_hnd_cb\n");
 }
 
+// Read into the buffer of the caller, nothing is allocated. The value is
+// only copied while the caller still waits for it. The part of a long value
+// given by a Read Blob is read the same way.
+void read_into_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data)
+{
+  bl_req_t *req = user_data;
+  ssize_t   vlen;
+
+  printf_dbg("[CB] IN read_into_cb\n");
+  if (status) {
+    req->att_status = status;
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Read into callback: Failure: %s\n",
+        att_ecode2str(status));
+    goto exit;
+  }
+
+  if (plen && (pdu[0] == ATT_OP_READ_BLOB_RESP))
+    vlen = dec_read_blob_resp(pdu, plen, NULL, 0);
+  else
+    vlen = dec_read_resp(pdu, plen, NULL, 0);
+  if (vlen < 0) {
+    req->ret_val = BL_PROTOCOL_ERROR;
+    strcpy(req->ret_msg, "Read into callback: Protocol error\n");
+    goto exit;
+  }
+
+  g_mutex_lock(&req->mutex);
+  // buf may be NULL to get the size only
+  if (!req->done && req->buf_size)
+    memcpy(req->buf, pdu + 1, MIN((size_t) vlen, req->buf_size));
+  g_mutex_unlock(&req->mutex);
+  req->value_size = vlen;
+  req->ret_val    = BL_NO_ERROR;
+exit:
+  req_complete(req);
+  printf_dbg("[CB] OUT read_into_cb\n");
+}
+
+// Part of a streamed long read, given to the user while the caller waits.
+gboolean read_chunk_cb(const guint8 *value, guint16 vlen, guint16 offset,
+    gpointer user_data)
+{
+  bl_req_t *req   = user_data;
+  gboolean  go_on;
+
+  // The caller doesn't return meanwhile
+  g_mutex_lock(&req->mutex);
+  go_on = !req->cancelled && !req->done &&
+    req->chunk_func(value, vlen, offset, req->user_data);
+  g_mutex_unlock(&req->mutex);
+  return go_on;
+}
+
+// End of a streamed long read, plen is the size of the value.
+void read_stream_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data)
+{
+  bl_req_t *req = user_data;
+
+  printf_dbg("[CB] IN read_stream_cb\n");
+  if (status) {
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Read stream callback: Failure: %s\n",
+        att_ecode2str(status));
+  } else {
+    req->value_size = plen;
+    req->ret_val    = BL_NO_ERROR;
+  }
+  req_complete(req);
+  printf_dbg("[CB] OUT read_stream_cb\n");
+}
+
+// Read By Type of the values, the next page starts after the last handle of
+// this one. The values of all the pages are returned together.
 void read_by_uuid_cb(guint8 status, const guint8 *pdu, guint16 plen,
     gpointer user_data)
 {
-  struct att_data_list *list;
-  GSList               *bl_value_list = NULL;
+  bl_req_t             *req  = user_data;
+  struct att_data_list *list = NULL;
+  uint16_t              last = 0;
+  bt_uuid_t             uuid;
+  uint8_t              *buf;
+  size_t                buflen;
+  guint16               olen;
 
   printf_dbg("[CB] IN read_by_uuid_cb\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Read by uuid callback: Failure: %s\n",
+    req->att_status = status;
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Read by uuid callback: Failure: %s\n",
         att_ecode2str(status));
-    goto error;
+    // Past the first page, it is the end of the values
+    if (req->list && (status == ATT_ECODE_ATTR_NOT_FOUND))
+      req->ret_val = BL_NO_ERROR;
+    goto exit;
   }
 
   list = dec_read_by_type_resp(pdu, plen);
   if (list == NULL) {
-    strcpy(cb_ret_msg, "Read by uuid callback: Nothing found\n");
-    cb_ret_val = BL_NO_ERROR;
-    goto error;
+    strcpy(req->ret_msg, "Read by uuid callback: Nothing found\n");
+    req->ret_val = BL_NO_ERROR;
+    goto exit;
   }
 
+  req->ret_val = BL_NO_ERROR;
   for (int i = 0; i < list->num; i++) {
-    bl_value_t *bl_value = bl_value_new(NULL, att_get_u16(list->data[i]),
-        list->len - 2, list->data[i] + 2);
-    if (bl_value == NULL) {
-      cb_ret_val = BL_MALLOC_ERROR;
-      strcpy(cb_ret_msg, "Read by uuid callback: Malloc error\n");
-      goto error;
-    }
+    bl_value_t *bl_value;
 
-    // Add it to the value list
-    if (bl_value_list == NULL) {
-      bl_value_list = g_slist_alloc();
-      if (bl_value_list == NULL) {
-        cb_ret_val = BL_MALLOC_ERROR;
-        strcpy(cb_ret_msg, "Read by uuid callback: Malloc error\n");
-        goto error;
-      }
-      bl_value_list->data = bl_value;
-    } else {
-      bl_value_list = g_slist_append(bl_value_list, bl_value);
+    last = att_get_u16(list->data[i]);
+    bl_value = bl_value_new(req->uuid_str, last, list->len - 2,
+        list->data[i] + 2);
+    if (bl_value == NULL) {
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Read by uuid callback: Malloc error\n");
+      goto exit;
     }
+    // Reversed once at the end
+    req->list = g_slist_prepend(req->list, bl_value);
   }
 
-  att_data_list_free(list);
+  if ((last == 0) || (last >= req->end_handle))
+    goto exit;
 
-  cb_ret_pointer = bl_value_list;
-  cb_ret_val     = BL_NO_ERROR;
-  goto exit;
+  buf = g_attrib_get_buffer(req->ctx->attrib, &buflen);
+  bt_string_to_uuid(&uuid, req->uuid_str);
+  olen = enc_read_by_type_req(last + 1, req->end_handle, &uuid, buf, buflen);
+  req->att_id = g_attrib_send(req->ctx->attrib, 0, buf, olen,
+      read_by_uuid_cb, req, NULL);
+  if (req->att_id)
+    goto next;
+  req->ret_val = BL_SEND_REQUEST_ERROR;
+  strcpy(req->ret_msg, "Unable to send request\n");
 
- error:
-  if (bl_value_list)
-    bl_value_list_free(bl_value_list);
- exit:
-  g_mutex_unlock(pending_callback);
+exit:
+  if (req->ret_val == BL_NO_ERROR)
+    req->ret_pointer = g_slist_reverse(req->list);
+  else
+    bl_value_list_free(req->list);
+  req->list = NULL;
+  req_complete(req);
+next:
+  if (list)
+    att_data_list_free(list);
   printf_dbg("[CB] OUT read_by_uuid_cb\n");
 }
 
+// Read Multiple Variable Length, one value for each handle in the response.
+// The values left out of a response cut by the MTU are not in the result,
+// they are asked again by the caller.
+void read_multi_cb(guint8 status, const guint8 *pdu, guint16 plen,
+    gpointer user_data)
+{
+  bl_req_t      *req  = user_data;
+  GSList        *list = NULL;
+  const uint8_t *values[READ_MULTI_MAX];
+  uint16_t       vlens[READ_MULTI_MAX];
+  int            n;
+
+  printf_dbg("[CB] IN read_multi_cb\n");
+  if (status) {
+    req->att_status = status;
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Read multiple callback: Failure: %s\n",
+        att_ecode2str(status));
+    goto exit;
+  }
+
+  n = dec_read_multi_var_resp(pdu, plen, values, vlens, req->n_handles);
+  if (n <= 0) {
+    req->ret_val = BL_PROTOCOL_ERROR;
+    strcpy(req->ret_msg, "Read multiple callback: Protocol error\n");
+    goto exit;
+  }
+
+  for (int i = n - 1; i >= 0; i--) {
+    bl_value_t *bl_value = bl_value_new(NULL, req->handles[i], vlens[i],
+        (uint8_t *) values[i]);
+    if (bl_value == NULL) {
+      req->ret_val = BL_MALLOC_ERROR;
+      strcpy(req->ret_msg, "Read multiple callback: Malloc error\n");
+      bl_value_list_free(list);
+      goto exit;
+    }
+    list = g_slist_prepend(list, bl_value);
+  }
+
+  req->ret_pointer = list;
+  req->ret_val     = BL_NO_ERROR;
+exit:
+  req_complete(req);
+  printf_dbg("[CB] OUT read_multi_cb\n");
+}
+
 void write_req_cb(guint8 status, const guint8 *pdu, guint16 plen,
                   gpointer user_data)
 {
+  bl_req_t *req = user_data;
   printf_dbg("[CB] IN write_req_cb\n");
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "Write request callback: Failure: %s\n",
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "Write request callback: Failure: %s\n",
             att_ecode2str(status));
     goto end;
   }
 
   if (!dec_write_resp(pdu, plen) && !dec_exec_write_resp(pdu, plen)) {
-    cb_ret_val = BL_PROTOCOL_ERROR;
+    req->ret_val = BL_PROTOCOL_ERROR;
     printf("Write request callback: Protocol error\n");
     goto end;
   }
 
-  cb_ret_val = BL_NO_ERROR;
-  strcpy(cb_ret_msg, "Write request callback: Success\n");
+  req->ret_val = BL_NO_ERROR;
+  strcpy(req->ret_msg, "Write request callback: Success\n");
  end:
-  g_mutex_unlock(pending_callback);
+  req_complete(req);
   printf_dbg("[CB] OUT write_req_cb\n");
 }
 
+// Write commands have no response, the request is completed once the command
+// has left the queue of the GAttrib.
+void write_cmd_cb(gpointer user_data)
+{
+  bl_req_t *req = user_data;
+
+  printf_dbg("[CB] IN write_cmd_cb\n");
+  req->ret_val = BL_NO_ERROR;
+  req_complete(req);
+  printf_dbg("[CB] OUT write_cmd_cb\n");
+}
+
 void exchange_mtu_cb(guint8 status, const guint8 *pdu, guint16 plen,
                      gpointer user_data)
 {
+  bl_req_t *req = user_data;
   uint16_t mtu;
   printf_dbg("[CB] IN exchange_mtu_cb\n");
 
   if (status) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    sprintf(cb_ret_msg, "MTU exchange callback: Failure: %s\n",
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    sprintf(req->ret_msg, "MTU exchange callback: Failure: %s\n",
             att_ecode2str(status));
     goto error;
   }
 
   if (!dec_mtu_resp(pdu, plen, &mtu)) {
-    cb_ret_val = BL_PROTOCOL_ERROR;
-    strcpy(cb_ret_msg, "MTU exchange callback: PROTOCOL ERROR\n");
+    req->ret_val = BL_PROTOCOL_ERROR;
+    strcpy(req->ret_msg, "MTU exchange callback: PROTOCOL ERROR\n");
     goto error;
   }
 
-  mtu = MIN(mtu, opt_mtu);
+  mtu = MIN(mtu, req->ctx->opt_mtu);
   /* Set new value for MTU in client */
-  if (!g_attrib_set_mtu(attrib, mtu)) {
-    cb_ret_val = BL_REQUEST_FAIL_ERROR;
-    strcpy(cb_ret_msg, "MTU exchange callback: Unable to set new MTU value "
+  if (!g_attrib_set_mtu(req->ctx->attrib, mtu)) {
+    req->ret_val = BL_REQUEST_FAIL_ERROR;
+    strcpy(req->ret_msg, "MTU exchange callback: Unable to set new MTU value "
            "in client\n");
   } else {
-    sprintf(cb_ret_msg, "MTU exchange callback: Success: %d\n", mtu);
-    cb_ret_val = BL_NO_ERROR;
+    sprintf(req->ret_msg, "MTU exchange callback: Success: %d\n", mtu);
+    req->ret_val = BL_NO_ERROR;
   }
  error:
-  g_mutex_unlock(pending_callback);
+  req_complete(req);
   printf_dbg("[CB] OUT exchange_mtu_cb\n");
 }
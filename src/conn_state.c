@@ -24,19 +24,20 @@
 #include <glib.h>
 #include "conn_state.h"
 #include "callback.h"
+#include "ctx.h"
 #include <stdio.h>
 
-static conn_state_t conn_state = STATE_DISCONNECTED;
-
-void set_conn_state(conn_state_t state)
+void set_conn_state(bl_ctx_t *ctx, conn_state_t state)
 {
-  printf("[CONN STATE] %d => %d\n", conn_state, state);
-  conn_state = state;
-  if ((state == STATE_DISCONNECTED) && is_event_loop_running())
-    stop_event_loop();
+  printf("[CONN STATE] %d => %d\n", ctx->conn_state, state);
+  ctx->conn_state = state;
+  if (state == STATE_DISCONNECTED)
+    stop_event_loop(ctx);
 }
 
-conn_state_t get_conn_state(void)
+conn_state_t bl_ctx_get_conn_state(bl_ctx_t *ctx)
 {
-  return conn_state;
+  if (ctx == NULL)
+    return STATE_DISCONNECTED;
+  return ctx->conn_state;
 }
@@ -0,0 +1,589 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bluelib.h"
+#include "callback.h"
+#include "ctx.h"
+#include "database.h"
+#include "gatt_def.h"
+
+#include "att.h"
+
+#define printf(...) printf("[DB] " __VA_ARGS__)
+
+// The discovery is made of these steps, each one paginated by BlueZ or by
+// char_desc_cb:
+// - Read By Group Type for all the primary services,
+// - Read By Type for all the included services,
+// - Read By Type for all the characteristics,
+// - Find Information for the descriptors, one sweep per service going on
+//   past the declarations, from the first handle left after a
+//   characteristic value to the last one. The attributes found are split
+//   by characteristic, the declarations and the values are dropped.
+// The included services and the characteristics are asked over the whole
+// range rather than service by service: the pages are filled across the
+// services and a service without characteristic costs no request.
+// After a Service Changed, the range is limited to the services it
+// overlaps, all the primary services are still discovered.
+typedef enum {
+  STEP_PRIMARY,
+  STEP_INCLUDED,
+  STEP_CHAR,
+  STEP_DESC,
+} step_t;
+
+static const char *step_names[] = {
+  "Primary service", "Included service", "Characteristic", "Descriptor"
+};
+
+// State of a discovery. The steps are sent by the callback of the previous
+// one, under mutex. A synchronous discovery is on the stack of the waiting
+// thread, an asynchronous one calls done_cb at the end.
+typedef struct {
+  bl_ctx_t      *ctx;
+  step_t         step;
+  bl_primary_t   range;      // Handles discovered
+  GSList        *primaries;
+  GSList        *included;
+  GSList        *chars;
+  GSList        *descs;      // Descriptors of all the characteristics
+  GSList        *next_primary; // Service of the next descriptor sweep
+  void         (*done_cb)(void *proc);
+
+  GMutex         mutex;
+  GCond          cond;
+  bl_req_t      *req;        // Request of the current step
+  gboolean       aborted;    // The waiting thread timed out
+  gboolean       done;
+  int            status;
+} db_proc_t;
+
+static void proc_init(db_proc_t *proc, bl_ctx_t *ctx, uint16_t start,
+    uint16_t end)
+{
+  memset(proc, 0, sizeof(db_proc_t));
+  proc->ctx                = ctx;
+  proc->step               = STEP_PRIMARY;
+  proc->range.start_handle = start;
+  proc->range.end_handle   = end;
+  g_mutex_init(&proc->mutex);
+  g_cond_init(&proc->cond);
+}
+
+static void proc_clear(db_proc_t *proc)
+{
+  req_unref(proc->req);
+  bl_primary_list_free(proc->primaries);
+  bl_included_list_free(proc->included);
+  bl_char_list_free(proc->chars);
+  bl_desc_list_free(proc->descs);
+  g_mutex_clear(&proc->mutex);
+  g_cond_clear(&proc->cond);
+}
+
+static void proc_end(db_proc_t *proc, int status)
+{
+  if (status)
+    printf("%s discovery failed: %d\n", step_names[proc->step], status);
+  proc->status = status;
+  proc->done   = TRUE;
+  g_cond_broadcast(&proc->cond);
+}
+
+// Handles between the value of the characteristic of l and the next
+// declaration, FALSE if there is none.
+static gboolean desc_range(db_proc_t *proc, GSList *l, uint16_t *start,
+    uint16_t *end)
+{
+  bl_char_t *bl_char = l->data;
+  int        last    = proc->range.end_handle;
+
+  if (l->next)
+    last = ((bl_char_t *) l->next->data)->handle - 1;
+
+  for (GSList *p = proc->primaries; p; p = p->next) {
+    bl_primary_t *bl_primary = p->data;
+    if (bl_primary->start_handle > bl_char->value_handle)
+      last = MIN(last, bl_primary->start_handle - 1);
+    else if (bl_char->handle <= bl_primary->end_handle)
+      last = MIN(last, bl_primary->end_handle);
+  }
+  for (GSList *i = proc->included; i; i = i->next) {
+    bl_included_t *bl_included = i->data;
+    if (bl_included->handle > bl_char->value_handle)
+      last = MIN(last, bl_included->handle - 1);
+  }
+
+  if (bl_char->value_handle >= last)
+    return FALSE;
+  *start = bl_char->value_handle + 1;
+  *end   = last;
+  return TRUE;
+}
+
+static gboolean in_primary(bl_char_t *bl_char, bl_primary_t *bl_primary)
+{
+  return (bl_char->handle >= bl_primary->start_handle) &&
+    (bl_char->handle <= bl_primary->end_handle);
+}
+
+// Handles of the sweep of bl_primary: from the first descriptor range of its
+// characteristics to the last one. FALSE if none of them has a descriptor.
+static gboolean sweep_range(db_proc_t *proc, bl_primary_t *bl_primary,
+    uint16_t *start, uint16_t *end)
+{
+  gboolean found = FALSE;
+  uint16_t first, last;
+
+  for (GSList *l = proc->chars; l; l = l->next) {
+    if (!in_primary(l->data, bl_primary) ||
+        !desc_range(proc, l, &first, &last))
+      continue;
+    if (!found)
+      *start = first;
+    *end  = last;
+    found = TRUE;
+  }
+  return found;
+}
+
+// Keep the descriptors of the characteristics of bl_primary among the
+// attributes of its sweep, in the order of the handles. The rest is freed.
+static GSList *sweep_split(db_proc_t *proc, bl_primary_t *bl_primary,
+    GSList *attrs)
+{
+  GSList   *descs     = NULL;
+  GSList   *owner     = NULL;  // Last characteristic declared before
+  GSList   *next      = proc->chars;
+  gboolean  has_range = FALSE;
+  uint16_t  start     = 0;
+  uint16_t  end       = 0;
+
+  for (GSList *l = attrs; l; l = l->next) {
+    bl_desc_t *bl_desc = l->data;
+
+    if (next && (((bl_char_t *) next->data)->handle < bl_desc->handle)) {
+      while (next && (((bl_char_t *) next->data)->handle < bl_desc->handle)) {
+        owner = next;
+        next  = next->next;
+      }
+      has_range = in_primary(owner->data, bl_primary) &&
+        desc_range(proc, owner, &start, &end);
+    }
+    if (has_range && (bl_desc->handle >= start) && (bl_desc->handle <= end)) {
+      descs   = g_slist_prepend(descs, bl_desc);
+      l->data = NULL;
+    }
+  }
+  bl_desc_list_free(attrs);
+  return g_slist_reverse(descs);
+}
+
+static void proc_cb(int status, void *result, void *user_data);
+
+// Send the request of the current step, or end the discovery when nothing is
+// left. Called with the mutex of proc held.
+static void proc_next(db_proc_t *proc)
+{
+  GError   *gerr  = NULL;
+  bl_req_t *req;
+  uint16_t  start = 0;
+  uint16_t  end   = 0;
+  guint     sent;
+
+  if (proc->aborted) {
+    proc_end(proc, BL_NO_CALLBACK_ERROR);
+    return;
+  }
+
+  if (proc->step == STEP_DESC) {
+    while (proc->next_primary && !sweep_range(proc, proc->next_primary->data,
+          &start, &end))
+      proc->next_primary = proc->next_primary->next;
+    if (proc->next_primary == NULL) {
+      proc_end(proc, BL_NO_ERROR);
+      return;
+    }
+  }
+
+  req = req_new(proc->ctx);
+  if (req == NULL) {
+    proc_end(proc, BL_MALLOC_ERROR);
+    return;
+  }
+  req->func      = proc_cb;
+  req->user_data = proc;
+  req->ret_free  = (GDestroyNotify) list_free;
+  req_unref(proc->req);
+  proc->req = req;
+
+  switch (proc->step) {
+    case STEP_PRIMARY:
+      sent = send_primary(NULL, req, &gerr);
+      break;
+    case STEP_INCLUDED:
+      sent = send_included(&proc->range, req, &gerr);
+      break;
+    case STEP_CHAR:
+      sent = send_char(NULL, &proc->range, req, &gerr);
+      break;
+    default:
+      req->sweep = TRUE;
+      sent = send_desc_range(start, end, req, &gerr);
+      break;
+  }
+  if (!sent) {
+    printf("%s", gerr->message);
+    proc_end(proc, gerr->code);
+    g_error_free(gerr);
+  }
+}
+
+// The range is widened to the services it overlaps.
+static void proc_widen_range(db_proc_t *proc)
+{
+  bl_primary_t *range = &proc->range;
+
+  for (GSList *l = proc->primaries; l; l = l->next) {
+    bl_primary_t *bl_primary = l->data;
+
+    if ((bl_primary->start_handle <= range->end_handle) &&
+        (bl_primary->end_handle >= range->start_handle)) {
+      range->start_handle = MIN(range->start_handle,
+          bl_primary->start_handle);
+      range->end_handle   = MAX(range->end_handle, bl_primary->end_handle);
+    }
+  }
+}
+
+// Called in the event loop at the end of each step.
+static void proc_cb(int status, void *result, void *user_data)
+{
+  db_proc_t *proc    = user_data;
+  GSList    *list    = result;
+  void     (*done_cb)(void *proc);
+
+  g_mutex_lock(&proc->mutex);
+  // No characteristic or no descriptor in the range
+  if ((status == BL_REQUEST_FAIL_ERROR) && (proc->step >= STEP_CHAR) &&
+      (proc->req->att_status == ATT_ECODE_ATTR_NOT_FOUND))
+    status = BL_NO_ERROR;
+  if (status) {
+    proc_end(proc, status);
+    goto exit;
+  }
+
+  switch (proc->step) {
+    case STEP_PRIMARY:
+      proc->primaries = list;
+      proc->step      = STEP_INCLUDED;
+      proc_widen_range(proc);
+      break;
+    case STEP_INCLUDED:
+      proc->included  = list;
+      proc->step      = STEP_CHAR;
+      break;
+    case STEP_CHAR:
+      proc->chars        = list;
+      proc->next_primary = proc->primaries;
+      proc->step         = STEP_DESC;
+      break;
+    default:
+      proc->descs        = g_slist_concat(proc->descs,
+          sweep_split(proc, proc->next_primary->data, list));
+      proc->next_primary = proc->next_primary->next;
+      break;
+  }
+
+  if (proc->primaries == NULL)
+    proc_end(proc, BL_NO_ERROR);
+  else
+    proc_next(proc);
+exit:
+  // A synchronous proc may be gone once unlocked
+  done_cb = proc->done ? proc->done_cb : NULL;
+  g_mutex_unlock(&proc->mutex);
+  if (done_cb)
+    done_cb(proc);
+}
+
+// Give the results to the cache, in place of what it knew in the range. The
+// characteristic value is added to the descriptors, as a Find Information
+// from the declaration would find it.
+static void proc_to_cache(db_proc_t *proc, gatt_cache_t *cache)
+{
+  uint16_t start    = proc->range.start_handle;
+  uint16_t end      = proc->range.end_handle;
+  gboolean complete = ((start == 0x0001) && (end == 0xffff)) ||
+    cache_is_complete(cache);
+  GSList  *d        = proc->descs;
+
+  cache_invalidate(cache, start, end);
+  cache_add_primaries(cache, proc->primaries);
+  cache_add_included(cache, start, end, proc->included);
+  cache_add_chars(cache, start, end, proc->chars);
+
+  for (GSList *c = proc->chars; c; c = c->next) {
+    bl_char_t *bl_char = c->data;
+    bl_desc_t  value   = { .handle = bl_char->value_handle };
+    GSList    *descs   = g_slist_prepend(NULL, &value);
+
+    strcpy(value.uuid_str, bl_char->uuid_str);
+    // The descriptors are found in the order of the characteristics
+    for (; d && (!c->next || (((bl_desc_t *) d->data)->handle <
+            ((bl_char_t *) c->next->data)->handle)); d = d->next)
+      descs = g_slist_prepend(descs, d->data);
+    descs = g_slist_reverse(descs);
+    cache_add_descs(cache, bl_char, descs);
+    g_slist_free(descs);
+  }
+  if (complete)
+    cache_set_complete(cache);
+}
+
+int database_discover(bl_ctx_t *ctx, gatt_cache_t *cache, GError **gerr)
+{
+  db_proc_t  proc;
+  bl_req_t  *req = NULL;
+
+  proc_init(&proc, ctx, 0x0001, 0xffff);
+  g_mutex_lock(&proc.mutex);
+  proc_next(&proc);
+  g_mutex_unlock(&proc.mutex);
+
+  if (wait_for_done(ctx, &proc.mutex, &proc.cond, &proc.done)) {
+    // The current step is expired, or the next one won't be sent
+    g_mutex_lock(&proc.mutex);
+    proc.aborted = TRUE;
+    if (!proc.done)
+      req = req_ref(proc.req);
+    g_mutex_unlock(&proc.mutex);
+    if (req) {
+      req_expire(req);
+      req_unref(req);
+    }
+    wait_for_expired(ctx, &proc.mutex, &proc.cond, &proc.done);
+  }
+
+  if (proc.status)
+    g_set_error(gerr, BL_ERROR_DOMAIN, proc.status,
+        "%s discovery failed\n", step_names[proc.step]);
+  else
+    proc_to_cache(&proc, cache);
+  proc_clear(&proc);
+  return proc.status;
+}
+
+
+/***************************** Service Changed *****************************/
+static void cccd_written_cb(int status, void *result, void *user_data)
+{
+  if (status)
+    printf("Notification not enabled again: %d\n", status);
+}
+
+// Write the Client Characteristic Configuration of the characteristic of l,
+// from the event loop.
+static void enable_again(db_proc_t *proc, GSList *l, guint8 opcode)
+{
+  bl_char_t *bl_char = l->data;
+  bl_desc_t *cccd    = NULL;
+  bl_req_t  *req;
+  GError    *gerr    = NULL;
+  uint8_t    value[2];
+
+  for (GSList *d = proc->descs; d && !cccd; d = d->next) {
+    bl_desc_t *bl_desc = d->data;
+
+    if (bl_desc->handle <= bl_char->value_handle)
+      continue;
+    if (l->next && (bl_desc->handle > ((bl_char_t *) l->next->data)->handle))
+      break;
+    if (!g_ascii_strcasecmp(bl_desc->uuid_str,
+          GATT_CLIENT_CHARAC_CFG_UUID_STR))
+      cccd = bl_desc;
+  }
+  if (cccd == NULL) {
+    printf("No configuration for %s\n", bl_char->uuid_str);
+    return;
+  }
+
+  req = req_new(proc->ctx);
+  if (req == NULL)
+    return;
+  req->func = cccd_written_cb;
+  att_put_u16((opcode == ATT_OP_HANDLE_IND) ?
+      GATT_CLIENT_CHARAC_CFG_IND_BIT :
+      GATT_CLIENT_CHARAC_CFG_NOTIF_BIT, value);
+  if (!send_write(cccd->handle, value, 2, WRITE_REQ, req, &gerr)) {
+    printf("%s", gerr->message);
+    g_error_free(gerr);
+  }
+  req_unref(req);
+}
+
+// A notification registered in the range follows the first characteristic
+// with the same UUID found there.
+static guint16 remap_event(const char *uuid_str, guint16 handle,
+    guint8 opcode, gpointer user_data)
+{
+  db_proc_t *proc = user_data;
+  bt_uuid_t  uuid;
+  bt_uuid_t  char_uuid;
+
+  if (bt_string_to_uuid(&uuid, uuid_str))
+    return GATTRIB_ALL_HANDLES;
+
+  for (GSList *l = proc->chars; l; l = l->next) {
+    bl_char_t *bl_char = l->data;
+
+    if (bt_string_to_uuid(&char_uuid, bl_char->uuid_str) ||
+        bt_uuid_cmp(&uuid, &char_uuid))
+      continue;
+    if (bl_char->value_handle != handle)
+      printf("Notification of %s moved from 0x%04x to 0x%04x\n", uuid_str,
+          handle, bl_char->value_handle);
+    enable_again(proc, l, opcode);
+    return bl_char->value_handle;
+  }
+  printf("Characteristic %s removed, notification dropped\n", uuid_str);
+  return GATTRIB_ALL_HANDLES;
+}
+
+static void change_start(bl_ctx_t *ctx, uint16_t start, uint16_t end);
+
+// End of the discovery of a range, the next range is discovered if the
+// device indicated another one meanwhile.
+static void change_done(void *data)
+{
+  db_proc_t *proc = data;
+  bl_ctx_t  *ctx  = proc->ctx;
+  gboolean   next;
+  uint16_t   start, end;
+
+  if ((proc->status == BL_NO_ERROR) && ctx->attrib)
+    g_attrib_remap_events(ctx->attrib, proc->range.start_handle,
+        proc->range.end_handle, remap_event, proc);
+
+  g_mutex_lock(&ctx->changed_mutex);
+  // Even a failed discovery invalidates its range
+  ctx->changes = g_slist_append(ctx->changes, proc);
+  next = (ctx->changed_end != 0) && (proc->status != BL_DISCONNECTED_ERROR);
+  start = ctx->changed_start;
+  end   = ctx->changed_end;
+  ctx->changed_end   = 0;
+  ctx->rediscovering = next;
+  g_mutex_unlock(&ctx->changed_mutex);
+
+  if (next)
+    change_start(ctx, start, end);
+}
+
+static void change_start(bl_ctx_t *ctx, uint16_t start, uint16_t end)
+{
+  db_proc_t *proc = g_new(db_proc_t, 1);
+  gboolean   done;
+
+  printf("Service changed from 0x%04x to 0x%04x\n", start, end);
+  proc_init(proc, ctx, start, end);
+  proc->done_cb = change_done;
+  g_mutex_lock(&proc->mutex);
+  proc_next(proc);
+  done = proc->done;
+  g_mutex_unlock(&proc->mutex);
+  if (done)
+    change_done(proc);
+}
+
+void database_changed(bl_ctx_t *ctx, uint16_t start, uint16_t end)
+{
+  gboolean now;
+
+  if (start > end)
+    return;
+
+  g_mutex_lock(&ctx->changed_mutex);
+  if (ctx->changed_end) {
+    start = MIN(start, ctx->changed_start);
+    end   = MAX(end, ctx->changed_end);
+  }
+  now = !ctx->rediscovering;
+  if (now) {
+    ctx->changed_end   = 0;
+    ctx->rediscovering = TRUE;
+  } else {
+    ctx->changed_start = start;
+    ctx->changed_end   = end;
+  }
+  g_mutex_unlock(&ctx->changed_mutex);
+
+  if (now)
+    change_start(ctx, start, end);
+}
+
+gboolean database_apply_changes(bl_ctx_t *ctx, gatt_cache_t *cache)
+{
+  GSList   *changes;
+  gboolean  applied;
+
+  g_mutex_lock(&ctx->changed_mutex);
+  changes      = ctx->changes;
+  ctx->changes = NULL;
+  g_mutex_unlock(&ctx->changed_mutex);
+
+  applied = (changes != NULL);
+  for (GSList *l = changes; l; l = l->next) {
+    db_proc_t *proc = l->data;
+
+    if (proc->status == BL_NO_ERROR)
+      proc_to_cache(proc, cache);
+    else
+      cache_invalidate(cache, proc->range.start_handle,
+          proc->range.end_handle);
+    proc_clear(proc);
+    g_free(proc);
+  }
+  g_slist_free(changes);
+  return applied;
+}
+
+void database_drop_changes(bl_ctx_t *ctx)
+{
+  GSList *changes;
+
+  g_mutex_lock(&ctx->changed_mutex);
+  changes            = ctx->changes;
+  ctx->changes       = NULL;
+  ctx->changed_end   = 0;
+  ctx->rediscovering = FALSE;
+  g_mutex_unlock(&ctx->changed_mutex);
+
+  for (GSList *l = changes; l; l = l->next) {
+    proc_clear(l->data);
+    g_free(l->data);
+  }
+  g_slist_free(changes);
+}
@@ -21,6 +21,9 @@
  */
 
 #include "bluelib.h"
+#include "cache.h"
+#include "callback.h"
+#include "ctx.h"
 
 #include <malloc.h>
 
@@ -30,28 +33,26 @@
 
 #define printf(...) printf("[NOTIF] " __VA_ARGS__)
 
-extern GAttrib *attrib;
-
 // Add a notification by UUID.
-int bl_add_notif(char *uuid_str, bl_primary_t *bl_primary,
+int bl_ctx_add_notif(bl_ctx_t *ctx, char *uuid_str, bl_primary_t *bl_primary,
     GAttribNotifyFunc func, void *user_data, uint8_t opcode)
 {
   GError *gerr = NULL;
 
   // Get the characteristic associated to the UUID
-  bl_char_t *bl_char= bl_get_char(uuid_str, bl_primary, &gerr);
+  bl_char_t *bl_char= bl_ctx_get_char(ctx, uuid_str, bl_primary, &gerr);
 
   if (gerr) {
     printf("%s\n", gerr->message);
     return gerr->code;
   }
 
-  if (has_event_by_uuid(attrib, uuid_str)) {
+  if (has_event_by_uuid(ctx->attrib, uuid_str)) {
     printf("Notification substitute\n");
-    g_attrib_unregister(attrib, uuid_str);
+    g_attrib_unregister(ctx->attrib, uuid_str);
   }
-  int ret = bl_add_notif_by_char(bl_char, NULL, bl_primary, func, user_data,
-      opcode);
+  int ret = bl_ctx_add_notif_by_char(ctx, bl_char, NULL, bl_primary, func,
+      user_data, opcode);
   bl_char_free(bl_char);
   return ret;
 }
@@ -59,9 +60,9 @@ int bl_add_notif(char *uuid_str, bl_primary_t *bl_primary,
 // Add notification by charasteristic.
 // Setting end_bl_char avoid uneeded packet by specifying the end of the zone
 // to search, but the result is the same with or without.
-int bl_add_notif_by_char(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
-    bl_primary_t *bl_primary, GAttribNotifyFunc func, void *user_data,
-    uint8_t opcode)
+int bl_ctx_add_notif_by_char(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GAttribNotifyFunc func,
+    void *user_data, uint8_t opcode)
 {
   GError *gerr = NULL;
   uint8_t value;
@@ -77,8 +78,7 @@ int bl_add_notif_by_char(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
     goto error;
 
   // Register to the notification
-  client_char_conf = bl_get_desc_by_char(start_bl_char, end_bl_char,
-      bl_primary, GATT_CLIENT_CHARAC_CFG_UUID_STR, &gerr);
+  client_char_conf = bl_ctx_get_cccd(ctx, start_bl_char, &gerr);
 
   if (gerr)
     goto gerror;
@@ -90,11 +90,11 @@ int bl_add_notif_by_char(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
       GATT_CLIENT_CHARAC_CFG_IND_BIT :
       GATT_CLIENT_CHARAC_CFG_NOTIF_BIT, &value);
 
-  if (bl_write_desc_by_desc(client_char_conf, &value, 2))
+  if (bl_ctx_write_desc_by_desc(ctx, client_char_conf, &value, 2))
     goto error;
 
-  if (!g_attrib_register(attrib, opcode, start_bl_char->uuid_str,
-        start_bl_char->value_handle, func, attrib, user_data)) {
+  if (!g_attrib_register(ctx->attrib, opcode, start_bl_char->uuid_str,
+        start_bl_char->value_handle, func, ctx->attrib, user_data)) {
     printf("Malloc error");
     return BL_MALLOC_ERROR;
   }
@@ -118,58 +118,303 @@ gerror:
   return gerr->code;
 }
 
-// Retrieve a UUID from a handle.
-char *bl_get_notif_uuid(uint16_t handle)
+// State of an asynchronous notification registration: the descriptors are
+// discovered, then the Client Characteristic Configuration is written.
+typedef struct {
+  bl_ctx_t          *ctx;
+  guint              id;          // Id given to the user, kept by each step
+  bl_char_t         *bl_char;
+  GAttribNotifyFunc  func;
+  void              *user_data;
+  uint8_t            opcode;
+  uint8_t            value[2];
+  bl_async_cb_t      cb;
+  void              *cb_user_data;
+} notif_req_t;
+
+static void notif_req_end(notif_req_t *notif_req, int status)
+{
+  notif_req->cb(status, NULL, notif_req->cb_user_data);
+  bl_char_free(notif_req->bl_char);
+  free(notif_req);
+}
+
+static void notif_write_cb(int status, void *result, void *user_data)
+{
+  notif_req_t *notif_req = user_data;
+
+  if (status == BL_NO_ERROR &&
+      !g_attrib_register(notif_req->ctx->attrib, notif_req->opcode,
+        notif_req->bl_char->uuid_str, notif_req->bl_char->value_handle,
+        notif_req->func, notif_req->ctx->attrib, notif_req->user_data)) {
+    printf("Malloc error");
+    status = BL_MALLOC_ERROR;
+  }
+  notif_req_end(notif_req, status);
+}
+
+// Called in the event loop, the request of the next step can be sent.
+static void notif_desc_cb(int status, void *result, void *user_data)
+{
+  notif_req_t *notif_req        = user_data;
+  GSList      *bl_desc_list     = result;
+  bl_desc_t   *client_char_conf = NULL;
+  bl_req_t    *req              = NULL;
+  GError      *gerr             = NULL;
+
+  if (status)
+    goto end;
+
+  for (GSList *l = bl_desc_list; l; l = l->next) {
+    bl_desc_t *bl_desc = l->data;
+    if (bl_desc && !g_ascii_strcasecmp(bl_desc->uuid_str,
+          GATT_CLIENT_CHARAC_CFG_UUID_STR))
+      client_char_conf = bl_desc;
+  }
+
+  if (!client_char_conf) {
+    status = (notif_req->opcode == ATT_OP_HANDLE_IND) ?
+      BL_NOT_INDICABLE_ERROR : BL_NOT_NOTIFIABLE_ERROR;
+    goto end;
+  }
+
+  req = req_new(notif_req->ctx);
+  if (req == NULL) {
+    status = BL_MALLOC_ERROR;
+    goto end;
+  }
+  req->id        = notif_req->id;
+  req->func      = notif_write_cb;
+  req->user_data = notif_req;
+
+  att_put_u16((notif_req->opcode == ATT_OP_HANDLE_IND) ?
+      GATT_CLIENT_CHARAC_CFG_IND_BIT :
+      GATT_CLIENT_CHARAC_CFG_NOTIF_BIT, notif_req->value);
+
+  if (!send_write(client_char_conf->handle, notif_req->value, 2, WRITE_REQ,
+        req, &gerr)) {
+    printf("%s\n", gerr->message);
+    status = gerr->code;
+    g_error_free(gerr);
+    req_unref(req);
+    goto end;
+  }
+  req_unref(req);
+  bl_desc_list_free(bl_desc_list);
+  return;
+
+end:
+  if (bl_desc_list)
+    bl_desc_list_free(bl_desc_list);
+  notif_req_end(notif_req, status);
+}
+
+// Asynchronous equivalent of bl_add_notif_by_char.
+guint bl_ctx_add_notif_by_char_async(bl_ctx_t *ctx, bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GAttribNotifyFunc func,
+    void *user_data, uint8_t opcode, bl_async_cb_t cb, void *cb_user_data)
+{
+  GError      *gerr      = NULL;
+  notif_req_t *notif_req = NULL;
+  bl_req_t    *req       = NULL;
+  guint        ret       = 0;
+
+  if (!cb || !start_bl_char) {
+    printf("Missing argument\n");
+    return 0;
+  }
+
+  if (((opcode == ATT_OP_HANDLE_NOTIFY) &&
+       !(start_bl_char->properties & ATT_CHAR_PROPER_NOTIFY)) ||
+      ((opcode == ATT_OP_HANDLE_IND) &&
+       !(start_bl_char->properties & ATT_CHAR_PROPER_INDICATE))) {
+    printf("Characteristic not %s\n",
+        (opcode == ATT_OP_HANDLE_IND) ? "indicable" : "notifiable");
+    return 0;
+  }
+
+  if (bluelib_lock(ctx)) {
+    printf("Not connected\n");
+    return 0;
+  }
+
+  notif_req = calloc(1, sizeof(notif_req_t));
+  req       = req_new(ctx);
+  if (!notif_req || !req) {
+    printf("Malloc error\n");
+    goto error;
+  }
+  notif_req->bl_char = bl_char_cpy(start_bl_char);
+  if (!notif_req->bl_char) {
+    printf("Malloc error\n");
+    goto error;
+  }
+  notif_req->ctx          = ctx;
+  notif_req->id           = req_new_id();
+  notif_req->func         = func;
+  notif_req->user_data    = user_data;
+  notif_req->opcode       = opcode;
+  notif_req->cb           = cb;
+  notif_req->cb_user_data = cb_user_data;
+
+  req->id        = notif_req->id;
+  req->func      = notif_desc_cb;
+  req->user_data = notif_req;
+  req->ret_free  = (GDestroyNotify) list_free;
+
+  // From there notif_req belongs to the callbacks
+  if (send_desc_discovery(start_bl_char, end_bl_char, bl_primary, req,
+        &gerr)) {
+    ret = notif_req->id;
+  } else {
+    printf("%s\n", gerr->message);
+    g_error_free(gerr);
+    bl_char_free(notif_req->bl_char);
+    free(notif_req);
+  }
+  req_unref(req);
+  bluelib_unlock(ctx);
+  return ret;
+
+error:
+  if (req)
+    req_drop(req);
+  req_unref(req);
+  if (notif_req) {
+    if (notif_req->bl_char)
+      bl_char_free(notif_req->bl_char);
+    free(notif_req);
+  }
+  bluelib_unlock(ctx);
+  return 0;
+}
+
+// Retrieve a UUID from a handle of the characteristic.
+char *bl_ctx_get_notif_uuid(bl_ctx_t *ctx, uint16_t handle)
 {
-  return event_get_uuid_by_handle(attrib, handle);
+  char      *uuid_str = event_get_uuid_by_handle(ctx->attrib, handle);
+  bl_char_t *bl_char  = NULL;
+
+  // The notifications are registered on the value of the characteristic.
+  // Other handles are looked up in the cache only, never discovered. Not
+  // from the event loop: a request waiting for it may hold the mutex.
+  if (uuid_str || g_main_context_is_owner(event_loop_context(ctx)) ||
+      bluelib_lock(ctx))
+    return uuid_str;
+  if (ctx->cache)
+    cache_lookup_handle(ctx->cache, handle, NULL, &bl_char);
+  bluelib_unlock(ctx);
+  if (bl_char == NULL)
+    return NULL;
+  uuid_str = event_get_uuid_by_handle(ctx->attrib, bl_char->value_handle);
+  bl_char_free(bl_char);
+  return uuid_str;
 }
 
 // Remove a notification by UUID.
-int bl_remove_notif(char *uuid_str)
+int bl_ctx_remove_notif(bl_ctx_t *ctx, char *uuid_str)
 {
-  if (!attrib)
+  if (!ctx || !ctx->attrib)
     return BL_DISCONNECTED_ERROR;
 
-  g_attrib_unregister(attrib, uuid_str);
+  g_attrib_unregister(ctx->attrib, uuid_str);
   return BL_NO_ERROR;
 }
 
 // Remove a notification by characteristic.
-int bl_remove_notif_by_char(bl_char_t *bl_char)
+int bl_ctx_remove_notif_by_char(bl_ctx_t *ctx, bl_char_t *bl_char)
 {
-  if (!attrib)
+  if (!ctx || !ctx->attrib)
     return BL_DISCONNECTED_ERROR;
 
-  char *uuid_str = bl_get_notif_uuid(bl_char->handle);
+  // Registered on the value, no lookup needed
+  char *uuid_str = event_get_uuid_by_handle(ctx->attrib,
+      bl_char->value_handle);
 
-  g_attrib_unregister(attrib, uuid_str);
+  if (uuid_str)
+    g_attrib_unregister(ctx->attrib, uuid_str);
   return BL_NO_ERROR;
 }
 
 // Remove all notification registered.
-int bl_remove_all_notif(void)
+int bl_ctx_remove_all_notif(bl_ctx_t *ctx)
 {
-  if (!attrib)
+  if (!ctx || !ctx->attrib)
     return BL_DISCONNECTED_ERROR;
 
-  g_attrib_unregister_all(attrib);
+  g_attrib_unregister_all(ctx->attrib);
   return BL_NO_ERROR;
 }
 
 // Print the notification list currently registered.
-void bl_notif_list_print(void)
+void bl_ctx_notif_list_print(bl_ctx_t *ctx)
 {
-  event_list_print(attrib);
+  event_list_print(ctx->attrib);
 }
 
-void bl_notif_indication_resp(void)
+void bl_ctx_notif_indication_resp(bl_ctx_t *ctx)
 {
   int16_t  olen;
 	uint8_t *opdu;
   size_t   plen;
-  opdu = g_attrib_get_buffer(attrib, &plen);
+  opdu = g_attrib_get_buffer(ctx->attrib, &plen);
 	olen = enc_confirmation(opdu, plen);
 
 	if (olen > 0)
-		g_attrib_send(attrib, 0, opdu, olen, NULL, NULL, NULL);
+		g_attrib_send(ctx->attrib, 0, opdu, olen, NULL, NULL, NULL);
+}
+
+
+/***************************** Default context *****************************/
+int bl_add_notif(char *uuid_str, bl_primary_t *bl_primary,
+    GAttribNotifyFunc func, void *user_data, uint8_t opcode)
+{
+  return bl_ctx_add_notif(bl_get_default_ctx(), uuid_str, bl_primary, func,
+      user_data, opcode);
+}
+
+int bl_add_notif_by_char(bl_char_t *start_bl_char, bl_char_t *end_bl_char,
+    bl_primary_t *bl_primary, GAttribNotifyFunc func, void *user_data,
+    uint8_t opcode)
+{
+  return bl_ctx_add_notif_by_char(bl_get_default_ctx(), start_bl_char,
+      end_bl_char, bl_primary, func, user_data, opcode);
+}
+
+guint bl_add_notif_by_char_async(bl_char_t *start_bl_char,
+    bl_char_t *end_bl_char, bl_primary_t *bl_primary, GAttribNotifyFunc func,
+    void *user_data, uint8_t opcode, bl_async_cb_t cb, void *cb_user_data)
+{
+  return bl_ctx_add_notif_by_char_async(bl_get_default_ctx(), start_bl_char,
+      end_bl_char, bl_primary, func, user_data, opcode, cb, cb_user_data);
+}
+
+char *bl_get_notif_uuid(uint16_t handle)
+{
+  return bl_ctx_get_notif_uuid(bl_get_default_ctx(), handle);
+}
+
+int bl_remove_notif(char *uuid_str)
+{
+  return bl_ctx_remove_notif(bl_get_default_ctx(), uuid_str);
+}
+
+int bl_remove_notif_by_char(bl_char_t *bl_char)
+{
+  return bl_ctx_remove_notif_by_char(bl_get_default_ctx(), bl_char);
+}
+
+int bl_remove_all_notif(void)
+{
+  return bl_ctx_remove_all_notif(bl_get_default_ctx());
+}
+
+void bl_notif_list_print(void)
+{
+  bl_ctx_notif_list_print(bl_get_default_ctx());
+}
+
+void bl_notif_indication_resp(void)
+{
+  bl_ctx_notif_indication_resp(bl_get_default_ctx());
 }
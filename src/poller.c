@@ -0,0 +1,420 @@
+/*
+ *  BlueLib - Abstraction layer for Bluetooth Low Energy softwares
+ *
+ *  Copyright (C) 2013  Netatmo
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <glib.h>
+#include <stdio.h>
+
+#include "bluelib.h"
+#include "callback.h"
+#include "ctx.h"
+#include "poller.h"
+
+#include "att.h"
+
+// The reads due within this window are sent together, a read is never
+// early by more than a quarter of its period.
+#define POLL_WINDOW_US 20000
+
+// One handle read periodically. With the mutex of the poller, except func
+// and user_data which don't change.
+typedef struct {
+  guint         id;
+  uint16_t      handle;
+  gint64        period_us;
+  gint64        next_due;   // Monotonic time of the next read
+  bl_poll_cb_t  func;
+  void         *user_data;
+  gboolean      busy;       // Read in progress, or func being called
+  gboolean      removed;    // Freed at the end of its read
+  guint         missed;     // Deadlines missed since the last read
+} poll_entry_t;
+
+struct poller {
+  GMutex           mutex;
+  GPtrArray       *entries;
+  guint            last_id;
+  GMainContext    *context;  // Of the event loop, while connected
+  GSource         *timer;
+  bl_poll_stats_t  stats;
+};
+
+// Reads sent together: by Read Multiple Variable Length requests, each one
+// for what the MTU allows, else by plain reads.
+typedef struct {
+  bl_ctx_t      *ctx;
+  int            n;
+  int            done;      // Entries given their value
+  gboolean       single;    // Plain reads for the rest
+  poll_entry_t **entries;
+  uint16_t      *handles;
+  bl_req_t      *req;       // Request in progress
+} poll_group_t;
+
+static void poll_send(poll_group_t *group);
+
+struct poller *poller_new(void)
+{
+  struct poller *poller = g_new0(struct poller, 1);
+
+  g_mutex_init(&poller->mutex);
+  poller->entries = g_ptr_array_new();
+  return poller;
+}
+
+void poller_free(struct poller *poller)
+{
+  if (poller == NULL)
+    return;
+
+  for (guint i = 0; i < poller->entries->len; i++)
+    g_free(g_ptr_array_index(poller->entries, i));
+  g_ptr_array_free(poller->entries, TRUE);
+  g_mutex_clear(&poller->mutex);
+  g_free(poller);
+}
+
+static poll_group_t *poll_group_new(bl_ctx_t *ctx, int n)
+{
+  poll_group_t *group = g_new0(poll_group_t, 1);
+
+  group->ctx     = ctx;
+  group->n       = n;
+  group->entries = g_new(poll_entry_t *, n);
+  group->handles = g_new(uint16_t, n);
+  return group;
+}
+
+static void poll_group_free(poll_group_t *group)
+{
+  g_free(group->entries);
+  g_free(group->handles);
+  g_free(group);
+}
+
+// Give the value, or the error, to the next entry of the group.
+static void poll_deliver(poll_group_t *group, int status, bl_value_t *value)
+{
+  struct poller *poller = group->ctx->poller;
+  poll_entry_t  *entry  = group->entries[group->done++];
+  gboolean       removed;
+  guint          missed;
+
+  g_mutex_lock(&poller->mutex);
+  removed       = entry->removed;
+  missed        = entry->missed;
+  entry->missed = 0;
+  poller->stats.reads++;
+  g_mutex_unlock(&poller->mutex);
+
+  if (!removed)
+    entry->func(status, value, missed, entry->user_data);
+
+  // bl_poll_remove frees the entry only if it is not busy
+  g_mutex_lock(&poller->mutex);
+  entry->busy = FALSE;
+  removed     = entry->removed;
+  g_mutex_unlock(&poller->mutex);
+  if (removed)
+    g_free(entry);
+}
+
+// The entries left in the group fail with status.
+static void poll_fail(poll_group_t *group, int status)
+{
+  while (group->done < group->n)
+    poll_deliver(group, status, NULL);
+  poll_group_free(group);
+}
+
+static void poll_read_cb(int status, void *result, void *user_data)
+{
+  poll_group_t *group = user_data;
+
+  req_unref(group->req);
+  group->req = NULL;
+  poll_deliver(group, status, result);
+  bl_value_free(result);
+  if (status)
+    poll_fail(group, status);
+  else
+    poll_send(group);
+}
+
+static void poll_multi_cb(int status, void *result, void *user_data)
+{
+  poll_group_t *group = user_data;
+  bl_ctx_t     *ctx   = group->ctx;
+
+  // Not supported by the device, or one of the handles can't be read: the
+  // rest is read handle by handle, only the failing one gets the error
+  if (status && group->req->att_status) {
+    if (group->req->att_status == ATT_ECODE_REQ_NOT_SUPP)
+      ctx->no_read_multi_var = TRUE;
+    group->single = TRUE;
+    status        = BL_NO_ERROR;
+  }
+  req_unref(group->req);
+  group->req = NULL;
+
+  for (GSList *l = result; l; l = l->next)
+    poll_deliver(group, BL_NO_ERROR, l->data);
+  bl_value_list_free(result);
+  if (status)
+    poll_fail(group, status);
+  else
+    poll_send(group);
+}
+
+// Send the next request of the group, from the event loop.
+static void poll_send(poll_group_t *group)
+{
+  bl_ctx_t      *ctx    = group->ctx;
+  struct poller *poller = ctx->poller;
+  int            left   = group->n - group->done;
+  GError        *gerr   = NULL;
+  bl_req_t      *req;
+  guint          sent;
+
+  if (left == 0) {
+    poll_group_free(group);
+    return;
+  }
+  if ((ctx->conn_state != STATE_CONNECTED) || (ctx->attrib == NULL)) {
+    poll_fail(group, BL_DISCONNECTED_ERROR);
+    return;
+  }
+
+  req = req_new(ctx);
+  if (req == NULL) {
+    poll_fail(group, BL_MALLOC_ERROR);
+    return;
+  }
+  req->id        = req_new_id();
+  req->user_data = group;
+  group->req     = req;
+  if ((left > 1) && !group->single && !ctx->no_read_multi_var) {
+    req->func     = poll_multi_cb;
+    req->ret_free = (GDestroyNotify) bl_value_list_free;
+    sent = send_read_multi(group->handles + group->done, left, req, &gerr);
+  } else {
+    req->func     = poll_read_cb;
+    req->ret_free = (GDestroyNotify) bl_value_free;
+    sent = send_read_by_hnd(group->handles[group->done], NULL, 0, req,
+        &gerr);
+  }
+  if (sent) {
+    g_mutex_lock(&poller->mutex);
+    poller->stats.requests++;
+    g_mutex_unlock(&poller->mutex);
+    return;
+  }
+
+  group->req = NULL;
+  req_unref(req);
+  poll_fail(group, gerr->code);
+  g_error_free(gerr);
+}
+
+static gboolean poller_tick(gpointer user_data);
+
+// Arm the timer for the next read due, with the mutex of the poller.
+static void poller_schedule(bl_ctx_t *ctx)
+{
+  struct poller *poller = ctx->poller;
+  gint64         next   = G_MAXINT64;
+  gint64         delay;
+
+  if (poller->timer) {
+    g_source_destroy(poller->timer);
+    g_source_unref(poller->timer);
+    poller->timer = NULL;
+  }
+  if (poller->context == NULL)
+    return;
+
+  for (guint i = 0; i < poller->entries->len; i++) {
+    poll_entry_t *entry = g_ptr_array_index(poller->entries, i);
+    next = MIN(next, entry->next_due);
+  }
+  if (next == G_MAXINT64)
+    return;
+
+  delay = MAX(next - g_get_monotonic_time(), 0);
+  poller->timer = g_timeout_source_new((delay + 999) / 1000);
+  g_source_set_callback(poller->timer, poller_tick, ctx, NULL);
+  g_source_attach(poller->timer, poller->context);
+}
+
+// Take the reads due, a read still in progress misses its deadline.
+static gboolean poller_tick(gpointer user_data)
+{
+  bl_ctx_t      *ctx    = user_data;
+  struct poller *poller = ctx->poller;
+  gint64         now    = g_get_monotonic_time();
+  GPtrArray     *due    = g_ptr_array_new();
+  poll_group_t  *group  = NULL;
+
+  g_mutex_lock(&poller->mutex);
+  for (guint i = 0; i < poller->entries->len; i++) {
+    poll_entry_t *entry = g_ptr_array_index(poller->entries, i);
+    gint64        late  = now - entry->next_due;
+
+    if (-late > MIN(POLL_WINDOW_US, entry->period_us / 4))
+      continue;
+
+    // The periods gone by without a read are missed
+    entry->next_due += entry->period_us;
+    if (late >= entry->period_us) {
+      guint skipped = late / entry->period_us;
+
+      entry->next_due += skipped * entry->period_us;
+      entry->missed   += skipped;
+      poller->stats.missed += skipped;
+    }
+    if (entry->busy) {
+      entry->missed++;
+      poller->stats.missed++;
+      continue;
+    }
+    entry->busy = TRUE;
+    g_ptr_array_add(due, entry);
+  }
+  poller_schedule(ctx);
+  g_mutex_unlock(&poller->mutex);
+
+  if (due->len) {
+    group = poll_group_new(ctx, due->len);
+    for (guint i = 0; i < due->len; i++) {
+      group->entries[i] = g_ptr_array_index(due, i);
+      group->handles[i] = group->entries[i]->handle;
+    }
+  }
+  g_ptr_array_free(due, TRUE);
+  if (group)
+    poll_send(group);
+  return G_SOURCE_REMOVE;
+}
+
+void poller_start(bl_ctx_t *ctx)
+{
+  struct poller *poller = ctx->poller;
+  gint64         now    = g_get_monotonic_time();
+
+  g_mutex_lock(&poller->mutex);
+  if ((poller->context == NULL) && event_loop_context(ctx))
+    poller->context = g_main_context_ref(event_loop_context(ctx));
+  // Read again from the connection, nothing is missed while disconnected
+  for (guint i = 0; i < poller->entries->len; i++) {
+    poll_entry_t *entry = g_ptr_array_index(poller->entries, i);
+    entry->next_due = now;
+  }
+  poller_schedule(ctx);
+  g_mutex_unlock(&poller->mutex);
+}
+
+// The groups in progress fail with the pending requests of the connection,
+// their entries are not busy anymore for the next one.
+void poller_stop(bl_ctx_t *ctx)
+{
+  struct poller *poller = ctx->poller;
+
+  g_mutex_lock(&poller->mutex);
+  if (poller->timer) {
+    g_source_destroy(poller->timer);
+    g_source_unref(poller->timer);
+    poller->timer = NULL;
+  }
+  if (poller->context)
+    g_main_context_unref(poller->context);
+  poller->context = NULL;
+  g_mutex_unlock(&poller->mutex);
+}
+
+guint bl_ctx_poll_add(bl_ctx_t *ctx, uint16_t handle, guint period_ms,
+    bl_poll_cb_t func, void *user_data)
+{
+  struct poller *poller;
+  poll_entry_t  *entry;
+  guint          id;
+
+  if ((ctx == NULL) || (func == NULL) || (handle == INVALID_HANDLE) ||
+      (period_ms == 0)) {
+    printf("Error: Invalid poll\n");
+    return 0;
+  }
+  poller = ctx->poller;
+
+  entry = g_new0(poll_entry_t, 1);
+  entry->handle    = handle;
+  entry->period_us = (gint64) period_ms * 1000;
+  entry->next_due  = g_get_monotonic_time();
+  entry->func      = func;
+  entry->user_data = user_data;
+
+  g_mutex_lock(&poller->mutex);
+  id = entry->id = ++poller->last_id;
+  g_ptr_array_add(poller->entries, entry);
+  poller_schedule(ctx);
+  g_mutex_unlock(&poller->mutex);
+  return id;
+}
+
+int bl_ctx_poll_remove(bl_ctx_t *ctx, guint id)
+{
+  struct poller *poller;
+  int            ret = BL_REQUEST_FAIL_ERROR;
+
+  if (ctx == NULL)
+    return BL_NOT_INIT_ERROR;
+  poller = ctx->poller;
+
+  g_mutex_lock(&poller->mutex);
+  for (guint i = 0; i < poller->entries->len; i++) {
+    poll_entry_t *entry = g_ptr_array_index(poller->entries, i);
+
+    if (entry->id != id)
+      continue;
+    // A busy entry is freed by the end of its read
+    entry->removed = TRUE;
+    g_ptr_array_remove_index_fast(poller->entries, i);
+    if (!entry->busy)
+      g_free(entry);
+    ret = BL_NO_ERROR;
+    break;
+  }
+  poller_schedule(ctx);
+  g_mutex_unlock(&poller->mutex);
+  return ret;
+}
+
+int bl_ctx_get_poll_stats(bl_ctx_t *ctx, bl_poll_stats_t *stats)
+{
+  if (ctx == NULL)
+    return BL_NOT_INIT_ERROR;
+  if (stats == NULL)
+    return BL_MISSING_ARGUMENT_ERROR;
+
+  g_mutex_lock(&ctx->poller->mutex);
+  *stats = ctx->poller->stats;
+  g_mutex_unlock(&ctx->poller->mutex);
+  return BL_NO_ERROR;
+}